@@ -0,0 +1,833 @@
+/*
+ * arrow.c
+ *
+ * Arrow IPC stream export (-o arrow:FILE) for drvlist.
+ *
+ * Copyright (c) 2024 Peter Eriksson <pen@lysator.liu.se>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * The drives are written as one Arrow IPC stream: a Schema message,
+ * one DictionaryBatch per dictionary encoded column, one RecordBatch
+ * with all rows and the end-of-stream marker. Columns:
+ *
+ *   ident       utf8
+ *   vendor      dictionary<int32, utf8>
+ *   product     dictionary<int32, utf8>
+ *   revision    dictionary<int32, utf8>
+ *   size        uint64 (bytes)
+ *   sectorsize  uint32
+ *   names       list<utf8>
+ *   driver      dictionary<int32, utf8>
+ *   path        utf8
+ *   phys        utf8
+ *
+ * Unknown values are null. Message metadata is FlatBuffers, written
+ * front to back: a table's vtable comes right before it and every
+ * table, vector or string it refers to is written after it, with the
+ * (forward) offset patched in. FlatBuffers data is always little
+ * endian, the column buffers are in host order and the schema says
+ * which that is.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <sys/types.h>
+
+#include "drvlist.h"
+
+
+/* Message header types */
+#define AH_SCHEMA      1
+#define AH_DICTIONARY  2
+#define AH_RECORDBATCH 3
+
+/* Field types */
+#define AT_INT         2
+#define AT_UTF8        5
+#define AT_LIST        12
+
+#define ARROW_V5       4
+
+/* Column kinds */
+#define AC_UTF8        0
+#define AC_DICT        1
+#define AC_U64         2
+#define AC_U32         3
+#define AC_LIST        4
+
+#define ARROW_MAXNODES 16
+#define ARROW_MAXBUFS  48
+
+
+static const struct {
+    const char *name;
+    int kind;
+} acols[] = {
+    { "ident",      AC_UTF8 },
+    { "vendor",     AC_DICT },
+    { "product",    AC_DICT },
+    { "revision",   AC_DICT },
+    { "size",       AC_U64 },
+    { "sectorsize", AC_U32 },
+    { "names",      AC_LIST },
+    { "driver",     AC_DICT },
+    { "path",       AC_UTF8 },
+    { "phys",       AC_UTF8 },
+};
+
+#define ARROW_NCOLS (int) (sizeof(acols)/sizeof(acols[0]))
+
+
+typedef struct {
+    uint8_t *p;
+    size_t len;
+    size_t size;
+    int err;
+} ABUF;
+
+/* Distinct values of a dictionary column, in order of appearance */
+typedef struct {
+    const char **sv;
+    uint32_t *lv;
+    int n;
+    uint32_t *hv;		/* Value index + 1, 0 = free slot */
+    size_t hsize;
+    int32_t *iv;		/* Index per row, -1 = null */
+} ADICT;
+
+/* Nodes and buffers of one record batch */
+typedef struct {
+    ABUF body;
+    int64_t nodes[ARROW_MAXNODES][2];
+    int64_t bufs[ARROW_MAXBUFS][2];
+    int nn;
+    int nb;
+} ABATCH;
+
+typedef struct {
+    size_t vt;			/* Position of the vtable */
+    size_t tb;			/* Position of the table */
+    int n;
+} FBTAB;
+
+
+static size_t
+abuf_zero(ABUF *bp,
+	  size_t n) {
+    size_t pos = bp->len;
+
+    if (bp->err)
+	return 0;
+    if (bp->len+n > bp->size) {
+	size_t nsize = bp->size ? bp->size*2 : 4096;
+	uint8_t *np;
+
+	while (nsize < bp->len+n)
+	    nsize *= 2;
+	np = realloc(bp->p, nsize);
+	if (!np) {
+	    bp->err = 1;
+	    return 0;
+	}
+	bp->p = np;
+	bp->size = nsize;
+    }
+    memset(bp->p+pos, 0, n);
+    bp->len += n;
+    return pos;
+}
+
+static size_t
+abuf_put(ABUF *bp,
+	 const void *p,
+	 size_t n) {
+    size_t pos = abuf_zero(bp, n);
+
+    if (!bp->err && n > 0)
+	memcpy(bp->p+pos, p, n);
+    return pos;
+}
+
+static void
+abuf_align(ABUF *bp,
+	   size_t a) {
+    if (bp->len % a)
+	abuf_zero(bp, a - bp->len % a);
+}
+
+static void
+le_put(ABUF *bp,
+       size_t pos,
+       uint64_t v,
+       int n) {
+    int i;
+
+    if (bp->err)
+	return;
+    for (i = 0; i < n; i++)
+	bp->p[pos+i] = (uint8_t) (v >> (8*i));
+}
+
+
+static void
+fb_begin(ABUF *bp,
+	 FBTAB *tp,
+	 int nfields) {
+    abuf_align(bp, 4);
+    tp->vt = abuf_zero(bp, 4 + 2*nfields);
+    tp->n = nfields;
+    abuf_align(bp, 4);
+    tp->tb = abuf_zero(bp, 4);
+    le_put(bp, tp->tb, tp->tb - tp->vt, 4);
+}
+
+static void
+fb_scalar(ABUF *bp,
+	  FBTAB *tp,
+	  int id,
+	  uint64_t v,
+	  int n) {
+    size_t pos;
+
+    abuf_align(bp, n);
+    pos = abuf_zero(bp, n);
+    le_put(bp, pos, v, n);
+    le_put(bp, tp->vt + 4 + 2*id, pos - tp->tb, 2);
+}
+
+/* Reserve an offset field, filled in later by fb_patch() */
+static size_t
+fb_ref(ABUF *bp,
+       FBTAB *tp,
+       int id) {
+    size_t pos;
+
+    abuf_align(bp, 4);
+    pos = abuf_zero(bp, 4);
+    le_put(bp, tp->vt + 4 + 2*id, pos - tp->tb, 2);
+    return pos;
+}
+
+static void
+fb_end(ABUF *bp,
+       FBTAB *tp) {
+    le_put(bp, tp->vt, 4 + 2*tp->n, 2);
+    le_put(bp, tp->vt+2, bp->len - tp->tb, 2);
+}
+
+static void
+fb_patch(ABUF *bp,
+	 size_t ref,
+	 size_t target) {
+    le_put(bp, ref, target - ref, 4);
+}
+
+static size_t
+fb_string(ABUF *bp,
+	  const char *s) {
+    size_t n = strlen(s), pos;
+
+    abuf_align(bp, 4);
+    pos = abuf_zero(bp, 4 + n + 1);
+    le_put(bp, pos, n, 4);
+    if (!bp->err)
+	memcpy(bp->p+pos+4, s, n);
+    return pos;
+}
+
+/* Vector length, placed so that the elements are aligned to 'align' */
+static size_t
+fb_vector(ABUF *bp,
+	  uint32_t n,
+	  int align) {
+    size_t pos;
+
+    abuf_align(bp, 4);
+    while ((bp->len + 4) % align)
+	abuf_zero(bp, 4);
+    pos = abuf_zero(bp, 4);
+    le_put(bp, pos, n, 4);
+    return pos;
+}
+
+
+/* Int { bitWidth, is_signed } */
+static void
+fb_int(ABUF *bp,
+       size_t ref,
+       int bits,
+       int sign) {
+    FBTAB t;
+
+    fb_begin(bp, &t, 2);
+    fb_patch(bp, ref, t.tb);
+    fb_scalar(bp, &t, 0, bits, 4);
+    fb_scalar(bp, &t, 1, sign, 1);
+    fb_end(bp, &t);
+}
+
+/* Field { name, nullable, type_type, type, dictionary, children } */
+static void
+fb_field(ABUF *bp,
+	 size_t slot,
+	 const char *name,
+	 int kind,
+	 int64_t dict) {
+    FBTAB t, x;
+    size_t nref, tref, dref = 0, cref, v;
+
+
+    fb_begin(bp, &t, 7);
+    fb_patch(bp, slot, t.tb);
+    nref = fb_ref(bp, &t, 0);
+    fb_scalar(bp, &t, 1, 1, 1);
+    fb_scalar(bp, &t, 2, kind == AC_U64 || kind == AC_U32 ? AT_INT :
+	      kind == AC_LIST ? AT_LIST : AT_UTF8, 1);
+    tref = fb_ref(bp, &t, 3);
+    if (kind == AC_DICT)
+	dref = fb_ref(bp, &t, 4);
+    cref = fb_ref(bp, &t, 5);
+    fb_end(bp, &t);
+
+    fb_patch(bp, nref, fb_string(bp, name));
+
+    if (kind == AC_U64 || kind == AC_U32)
+	fb_int(bp, tref, kind == AC_U64 ? 64 : 32, 0);
+    else {
+	/* Utf8 and List have no fields */
+	fb_begin(bp, &x, 0);
+	fb_patch(bp, tref, x.tb);
+	fb_end(bp, &x);
+    }
+
+    /* DictionaryEncoding { id, indexType } */
+    if (kind == AC_DICT) {
+	fb_begin(bp, &x, 2);
+	fb_patch(bp, dref, x.tb);
+	fb_scalar(bp, &x, 0, dict, 8);
+	v = fb_ref(bp, &x, 1);
+	fb_end(bp, &x);
+	fb_int(bp, v, 32, 1);
+    }
+
+    v = fb_vector(bp, kind == AC_LIST ? 1 : 0, 4);
+    fb_patch(bp, cref, v);
+    if (kind == AC_LIST) {
+	abuf_zero(bp, 4);
+	fb_field(bp, v+4, "item", AC_UTF8, 0);
+    }
+}
+
+
+/* Message { version, header_type, header, bodyLength }, returns the header ref */
+static size_t
+fb_message(ABUF *bp,
+	   int type,
+	   int64_t bodylen) {
+    FBTAB t;
+    size_t root, ref;
+
+    root = abuf_zero(bp, 4);
+    fb_begin(bp, &t, 4);
+    fb_patch(bp, root, t.tb);
+    fb_scalar(bp, &t, 0, ARROW_V5, 2);
+    fb_scalar(bp, &t, 1, type, 1);
+    ref = fb_ref(bp, &t, 2);
+    fb_scalar(bp, &t, 3, bodylen, 8);
+    fb_end(bp, &t);
+    return ref;
+}
+
+/* RecordBatch { length, nodes, buffers } */
+static void
+fb_recordbatch(ABUF *bp,
+	       size_t ref,
+	       int64_t length,
+	       const ABATCH *bt) {
+    FBTAB t;
+    size_t nref, bref, v;
+    int i;
+
+    fb_begin(bp, &t, 3);
+    fb_patch(bp, ref, t.tb);
+    fb_scalar(bp, &t, 0, length, 8);
+    nref = fb_ref(bp, &t, 1);
+    bref = fb_ref(bp, &t, 2);
+    fb_end(bp, &t);
+
+    v = fb_vector(bp, bt->nn, 8);
+    fb_patch(bp, nref, v);
+    for (i = 0; i < bt->nn; i++) {
+	v = abuf_zero(bp, 16);
+	le_put(bp, v, bt->nodes[i][0], 8);
+	le_put(bp, v+8, bt->nodes[i][1], 8);
+    }
+
+    v = fb_vector(bp, bt->nb, 8);
+    fb_patch(bp, bref, v);
+    for (i = 0; i < bt->nb; i++) {
+	v = abuf_zero(bp, 16);
+	le_put(bp, v, bt->bufs[i][0], 8);
+	le_put(bp, v+8, bt->bufs[i][1], 8);
+    }
+}
+
+
+/* Continuation marker, metadata length, metadata and body */
+static int
+arrow_write(FILE *fp,
+	    ABUF *mp,
+	    const ABUF *body) {
+    uint8_t pfx[8];
+    ABUF hp = { pfx, 0, sizeof(pfx), 0 };
+
+    abuf_align(mp, 8);
+    if (mp->err || (body && body->err)) {
+	errno = ENOMEM;
+	return -1;
+    }
+
+    le_put(&hp, 0, 0xFFFFFFFF, 4);
+    le_put(&hp, 4, mp->len, 4);
+    if (fwrite(pfx, 1, 8, fp) != 8 ||
+	fwrite(mp->p, 1, mp->len, fp) != mp->len ||
+	(body && body->len > 0 && fwrite(body->p, 1, body->len, fp) != body->len))
+	return -1;
+    return 0;
+}
+
+
+static void
+batch_buf(ABATCH *bt,
+	  const void *p,
+	  size_t n) {
+    abuf_align(&bt->body, 8);
+    bt->bufs[bt->nb][0] = bt->body.len;
+    bt->bufs[bt->nb][1] = n;
+    bt->nb++;
+    abuf_put(&bt->body, p, n);
+}
+
+static void
+batch_node(ABATCH *bt,
+	   int64_t len,
+	   int64_t nulls) {
+    bt->nodes[bt->nn][0] = len;
+    bt->nodes[bt->nn][1] = nulls;
+    bt->nn++;
+}
+
+/* Validity bitmap, or an empty buffer if nothing is null */
+static void
+batch_validity(ABATCH *bt,
+	       const uint8_t *bits,
+	       int n,
+	       int nulls) {
+    batch_buf(bt, bits, nulls > 0 ? (n+7)/8 : 0);
+}
+
+/* A utf8 column, NULL values are null */
+static int
+batch_utf8(ABATCH *bt,
+	   const char **sv,
+	   const uint32_t *lv,
+	   int n) {
+    uint8_t *bits;
+    int32_t *ov;
+    size_t data = 0;
+    int i, nulls = 0;
+
+
+    bits = calloc((n+7)/8 + 1, 1);
+    ov = malloc((n+1)*sizeof(int32_t));
+    if (!bits || !ov) {
+	free(bits);
+	free(ov);
+	return -1;
+    }
+
+    ov[0] = 0;
+    for (i = 0; i < n; i++) {
+	if (sv[i])
+	    bits[i/8] |= 1 << (i%8);
+	else
+	    ++nulls;
+	data += sv[i] ? lv[i] : 0;
+	ov[i+1] = data;
+    }
+
+    batch_node(bt, n, nulls);
+    batch_validity(bt, bits, n, nulls);
+    batch_buf(bt, ov, (n+1)*sizeof(int32_t));
+
+    abuf_align(&bt->body, 8);
+    bt->bufs[bt->nb][0] = bt->body.len;
+    bt->bufs[bt->nb][1] = data;
+    bt->nb++;
+    for (i = 0; i < n; i++)
+	if (sv[i])
+	    abuf_put(&bt->body, sv[i], lv[i]);
+
+    free(bits);
+    free(ov);
+    return 0;
+}
+
+
+static uint32_t
+str_hash(const char *s,
+	 size_t len) {
+    uint32_t h = 2166136261U;
+
+    while (len-- > 0)
+	h = (h ^ (uint8_t) *s++) * 16777619U;
+    return h;
+}
+
+static int
+dict_add(ADICT *dp,
+	 const char *s) {
+    uint32_t len = strlen(s), hash = str_hash(s, len);
+    size_t h;
+    int i;
+
+
+    if ((size_t) (dp->n+1)*2 > dp->hsize) {
+	size_t nsize = dp->hsize ? dp->hsize*2 : 64;
+	uint32_t *hv = calloc(nsize, sizeof(uint32_t));
+	const char **sv = realloc(dp->sv, nsize/2*sizeof(char *));
+	uint32_t *lv = realloc(dp->lv, nsize/2*sizeof(uint32_t));
+
+	if (sv)
+	    dp->sv = sv;
+	if (lv)
+	    dp->lv = lv;
+	if (!hv || !sv || !lv) {
+	    free(hv);
+	    return -1;
+	}
+	for (i = 0; i < dp->n; i++) {
+	    for (h = str_hash(dp->sv[i], dp->lv[i]) & (nsize-1); hv[h]; h = (h+1) & (nsize-1))
+		;
+	    hv[h] = i+1;
+	}
+	free(dp->hv);
+	dp->hv = hv;
+	dp->hsize = nsize;
+    }
+
+    for (h = hash & (dp->hsize-1); dp->hv[h]; h = (h+1) & (dp->hsize-1)) {
+	i = dp->hv[h]-1;
+	if (dp->lv[i] == len && memcmp(dp->sv[i], s, len) == 0)
+	    return i;
+    }
+
+    dp->sv[dp->n] = s;
+    dp->lv[dp->n] = len;
+    dp->hv[h] = ++dp->n;
+    return dp->n-1;
+}
+
+static void
+dict_free(ADICT *dp) {
+    free(dp->sv);
+    free(dp->lv);
+    free(dp->hv);
+    free(dp->iv);
+}
+
+
+/* String value of column 'c' (an index into acols), NULL if unknown */
+static const char *
+disk_str(const DISK *dp,
+	 int c) {
+    const char *s = NULL;
+
+    switch (c) {
+    case 0:
+	s = dp->ident;
+	break;
+    case 1:
+	s = dp->vendor;
+	break;
+    case 2:
+	s = dp->product;
+	break;
+    case 3:
+	s = dp->revision;
+	break;
+    case 7:
+	s = dp->driver;
+	break;
+    case 8:
+	s = dp->path;
+	break;
+    case 9:
+	s = dp->phys;
+	break;
+    }
+    return s && *s ? s : NULL;
+}
+
+
+/* A column of the record batch */
+static int
+batch_column(ABATCH *bt,
+	     int c,
+	     const DISK *dv,
+	     int dc,
+	     const ADICT *dict) {
+    uint8_t *bits = calloc((dc+7)/8 + 1, 1);
+    const char **sv = NULL;
+    uint32_t *lv = NULL;
+    int32_t *ov = NULL;
+    int i, k, n, nulls = 0, rc = -1;
+
+
+    if (!bits)
+	return -1;
+
+    switch (acols[c].kind) {
+    case AC_DICT:
+	for (i = 0; i < dc; i++)
+	    if (dict->iv[i] >= 0)
+		bits[i/8] |= 1 << (i%8);
+	    else
+		++nulls;
+	batch_node(bt, dc, nulls);
+	batch_validity(bt, bits, dc, nulls);
+	batch_buf(bt, dict->iv, dc*sizeof(int32_t));
+	break;
+
+    case AC_U64:
+    case AC_U32:
+	for (i = 0; i < dc; i++)
+	    if ((acols[c].kind == AC_U64 ? dv[i].msize : dv[i].sectorsize) > 0)
+		bits[i/8] |= 1 << (i%8);
+	    else
+		++nulls;
+	batch_node(bt, dc, nulls);
+	batch_validity(bt, bits, dc, nulls);
+	abuf_align(&bt->body, 8);
+	bt->bufs[bt->nb][0] = bt->body.len;
+	bt->bufs[bt->nb][1] = dc*(acols[c].kind == AC_U64 ? 8 : 4);
+	bt->nb++;
+	for (i = 0; i < dc; i++) {
+	    uint64_t v64 = dv[i].msize;
+	    uint32_t v32 = dv[i].sectorsize;
+
+	    if (acols[c].kind == AC_U64)
+		abuf_put(&bt->body, &v64, sizeof(v64));
+	    else
+		abuf_put(&bt->body, &v32, sizeof(v32));
+	}
+	break;
+
+    case AC_LIST:
+	/* The names, split on ',' into one child utf8 array */
+	for (n = i = 0; i < dc; i++) {
+	    const char *s = dv[i].danames;
+
+	    if (s && *s)
+		for (n++; (s = strchr(s, ',')) != NULL; s++)
+		    n++;
+	}
+	sv = malloc((n+1)*sizeof(*sv));
+	lv = malloc((n+1)*sizeof(*lv));
+	ov = malloc((dc+1)*sizeof(*ov));
+	if (!sv || !lv || !ov)
+	    goto End;
+
+	ov[0] = 0;
+	for (k = i = 0; i < dc; i++) {
+	    const char *s = dv[i].danames;
+
+	    if (s && *s) {
+		bits[i/8] |= 1 << (i%8);
+		for (;;) {
+		    size_t len = strcspn(s, ",");
+
+		    sv[k] = s;
+		    lv[k++] = len;
+		    if (!s[len])
+			break;
+		    s += len+1;
+		}
+	    } else
+		++nulls;
+	    ov[i+1] = k;
+	}
+	batch_node(bt, dc, nulls);
+	batch_validity(bt, bits, dc, nulls);
+	batch_buf(bt, ov, (dc+1)*sizeof(int32_t));
+	if (batch_utf8(bt, sv, lv, k) < 0)
+	    goto End;
+	break;
+
+    default:
+	sv = malloc((dc+1)*sizeof(*sv));
+	lv = malloc((dc+1)*sizeof(*lv));
+	if (!sv || !lv)
+	    goto End;
+	for (i = 0; i < dc; i++) {
+	    sv[i] = disk_str(&dv[i], c);
+	    lv[i] = sv[i] ? strlen(sv[i]) : 0;
+	}
+	if (batch_utf8(bt, sv, lv, dc) < 0)
+	    goto End;
+    }
+    rc = 0;
+
+ End:
+    free(bits);
+    free(sv);
+    free(lv);
+    free(ov);
+    return rc;
+}
+
+
+int
+arrow_export(const char *file,
+	     const DISK *dv,
+	     int dc) {
+    union { uint16_t s; uint8_t c[2]; } host = { 1 };
+    ADICT dicts[ARROW_NCOLS];
+    ABUF meta = { NULL, 0, 0, 0 };
+    ABATCH batch;
+    FBTAB t;
+    FILE *fp;
+    size_t ref, v;
+    uint8_t eos[8];
+    int c, i, nd, rc = -1;
+
+
+    memset(dicts, 0, sizeof(dicts));
+    memset(&batch, 0, sizeof(batch));
+
+    fp = strcmp(file, "-") == 0 ? stdout : fopen(file, "w");
+    if (!fp)
+	goto Fail;
+
+    /* Dictionary encode the columns that have few distinct values */
+    for (c = 0; c < ARROW_NCOLS; c++) {
+	ADICT *dp = &dicts[c];
+
+	if (acols[c].kind != AC_DICT)
+	    continue;
+	dp->iv = malloc((dc+1)*sizeof(int32_t));
+	if (!dp->iv)
+	    goto Fail;
+	for (i = 0; i < dc; i++) {
+	    const char *s = disk_str(&dv[i], c);
+
+	    if (!s)
+		dp->iv[i] = -1;
+	    else if ((dp->iv[i] = dict_add(dp, s)) < 0)
+		goto Fail;
+	}
+    }
+
+    /* Schema { endianness, fields } */
+    ref = fb_message(&meta, AH_SCHEMA, 0);
+    fb_begin(&meta, &t, 2);
+    fb_patch(&meta, ref, t.tb);
+    fb_scalar(&meta, &t, 0, host.c[0] == 0, 2);
+    ref = fb_ref(&meta, &t, 1);
+    fb_end(&meta, &t);
+    v = fb_vector(&meta, ARROW_NCOLS, 4);
+    fb_patch(&meta, ref, v);
+    abuf_zero(&meta, 4*ARROW_NCOLS);
+    for (nd = c = 0; c < ARROW_NCOLS; c++)
+	fb_field(&meta, v+4+4*c, acols[c].name, acols[c].kind,
+		 acols[c].kind == AC_DICT ? nd++ : 0);
+    if (arrow_write(fp, &meta, NULL) < 0)
+	goto Fail;
+
+    /* DictionaryBatch { id, data } per dictionary column */
+    for (nd = c = 0; c < ARROW_NCOLS; c++) {
+	if (acols[c].kind != AC_DICT)
+	    continue;
+
+	meta.len = 0;
+	batch.body.len = batch.nn = batch.nb = 0;
+	if (batch_utf8(&batch, dicts[c].sv, dicts[c].lv, dicts[c].n) < 0)
+	    goto Fail;
+	abuf_align(&batch.body, 8);
+
+	ref = fb_message(&meta, AH_DICTIONARY, batch.body.len);
+	fb_begin(&meta, &t, 3);
+	fb_patch(&meta, ref, t.tb);
+	fb_scalar(&meta, &t, 0, nd++, 8);
+	ref = fb_ref(&meta, &t, 1);
+	fb_end(&meta, &t);
+	fb_recordbatch(&meta, ref, dicts[c].n, &batch);
+	if (arrow_write(fp, &meta, &batch.body) < 0)
+	    goto Fail;
+    }
+
+    /* All rows in one RecordBatch */
+    meta.len = 0;
+    batch.body.len = batch.nn = batch.nb = 0;
+    for (c = 0; c < ARROW_NCOLS; c++)
+	if (batch_column(&batch, c, dv, dc, &dicts[c]) < 0)
+	    goto Fail;
+    abuf_align(&batch.body, 8);
+
+    ref = fb_message(&meta, AH_RECORDBATCH, batch.body.len);
+    fb_recordbatch(&meta, ref, dc, &batch);
+    if (arrow_write(fp, &meta, &batch.body) < 0)
+	goto Fail;
+
+    memset(eos, 0, sizeof(eos));
+    memset(eos, 0xFF, 4);
+    if (fwrite(eos, 1, sizeof(eos), fp) != sizeof(eos))
+	goto Fail;
+    if (fflush(fp) != 0)
+	goto Fail;
+    rc = 0;
+
+ Fail:
+    if (rc < 0)
+	fprintf(stderr, "drvlist: Error: %s: %s\n", file, strerror(errno ? errno : EIO));
+    if (fp && fp != stdout && fclose(fp) != 0 && rc == 0) {
+	fprintf(stderr, "drvlist: Error: %s: %s\n", file, strerror(errno));
+	rc = -1;
+    }
+    for (c = 0; c < ARROW_NCOLS; c++)
+	dict_free(&dicts[c]);
+    free(meta.p);
+    free(batch.body.p);
+    return rc;
+}
@@ -0,0 +1,691 @@
+/*
+ * bench.c
+ *
+ * Drive and controller benchmarks for drvlist.
+ *
+ * Copyright (c) 2024 Peter Eriksson <pen@lysator.liu.se>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/ioctl.h>
+#include <sys/disk.h>
+#include <sys/param.h>
+
+#include "drvlist.h"
+
+
+#define BENCH_BLKSIZE 4096
+
+/*
+ * Log-linear latency histogram (in nanoseconds).
+ *
+ * Values below 2^HIST_SUBBITS get one bucket each. Above that every
+ * power of two is split into 2^HIST_SUBBITS linear sub-buckets, which
+ * gives a constant relative error (~6%) over the whole range.
+ */
+#define HIST_SUBBITS  4
+#define HIST_SUBCOUNT (1 << HIST_SUBBITS)
+#define HIST_MAXEXP   48
+#define HIST_BUCKETS  ((HIST_MAXEXP - HIST_SUBBITS + 1) * HIST_SUBCOUNT)
+
+typedef struct {
+    uint64_t n;
+    uint64_t errors;
+    uint64_t v[HIST_BUCKETS];
+} HIST;
+
+
+int f_bench_qd = 4;
+int f_bench_ios = 1000;
+int f_bench_jobs = 16;
+int f_bench_secs = 5;
+int f_bench_step = 1;
+
+
+static int
+hist_bucket(uint64_t ns) {
+    int e, b;
+
+    if (ns < HIST_SUBCOUNT)
+	return (int) ns;
+
+    e = 63 - __builtin_clzll(ns);
+    if (e >= HIST_MAXEXP)
+	return HIST_BUCKETS-1;
+
+    b = (e - HIST_SUBBITS + 1) * HIST_SUBCOUNT +
+	(int) ((ns >> (e - HIST_SUBBITS)) & (HIST_SUBCOUNT-1));
+    return b;
+}
+
+/* Upper bound (in ns) of the values stored in bucket b */
+static uint64_t
+hist_value(int b) {
+    int e;
+    uint64_t sub;
+
+    if (b < HIST_SUBCOUNT)
+	return (uint64_t) b;
+
+    e = b / HIST_SUBCOUNT + HIST_SUBBITS - 1;
+    sub = (uint64_t) (b % HIST_SUBCOUNT);
+
+    return ((HIST_SUBCOUNT + sub + 1) << (e - HIST_SUBBITS)) - 1;
+}
+
+static void
+hist_add(HIST *h,
+	 uint64_t ns) {
+    h->v[hist_bucket(ns)]++;
+    h->n++;
+}
+
+static void
+hist_merge(HIST *dst,
+	   const HIST *src) {
+    int i;
+
+    for (i = 0; i < HIST_BUCKETS; i++)
+	dst->v[i] += src->v[i];
+    dst->n += src->n;
+    dst->errors += src->errors;
+}
+
+static uint64_t
+hist_percentile(const HIST *h,
+		double pct) {
+    uint64_t want, sum = 0;
+    int i;
+
+    if (h->n == 0)
+	return 0;
+
+    want = (uint64_t) ((h->n * pct) / 100.0);
+    if (want < 1)
+	want = 1;
+
+    for (i = 0; i < HIST_BUCKETS; i++) {
+	sum += h->v[i];
+	if (sum >= want)
+	    return hist_value(i);
+    }
+
+    return hist_value(HIST_BUCKETS-1);
+}
+
+
+static char *
+lat2str(uint64_t ns) {
+    char buf[64];
+    double us = ns / 1000.0;
+
+    if (us < 1000)
+	sprintf(buf, "%.0fus", us);
+    else if (us < 1000000)
+	sprintf(buf, "%.1fms", us / 1000);
+    else
+	sprintf(buf, "%.2fs", us / 1000000);
+
+    return strdup(buf);
+}
+
+
+static uint64_t
+now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+
+typedef struct {
+    int fd;
+    off_t nblocks;
+    u_int blksize;
+    int ios;
+    uint64_t seed;
+    int error;
+    HIST hist;
+} BENCHIO;
+
+static void *
+bench_io_thread(void *vp) {
+    BENCHIO *bp = (BENCHIO *) vp;
+    void *buf = NULL;
+    uint64_t x = bp->seed;
+    uint64_t t0, t1;
+    off_t off;
+    ssize_t n;
+    int i;
+
+
+    if ((bp->error = posix_memalign(&buf, bp->blksize, bp->blksize)) != 0) {
+	bp->hist.errors += bp->ios;
+	return NULL;
+    }
+
+    for (i = 0; i < bp->ios; i++) {
+	/* xorshift64 */
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+
+	off = (off_t) (x % (uint64_t) bp->nblocks) * bp->blksize;
+
+	t0 = now_ns();
+	n = pread(bp->fd, buf, bp->blksize, off);
+	if (n != (ssize_t) bp->blksize) {
+	    if (!bp->error)
+		bp->error = n < 0 ? errno : EIO;
+	    bp->hist.errors++;
+	    continue;
+	}
+	t1 = now_ns();
+
+	hist_add(&bp->hist, t1-t0);
+    }
+
+    free(buf);
+    return NULL;
+}
+
+
+/*
+ * Run the random read benchmark against one drive, using the first
+ * of its device names.
+ */
+static int
+bench_rand_disk(DISK *dp) {
+    char path[MAXPATHLEN];
+    char *cp;
+    int fd, i, qd, nt, rc, error = 0;
+    off_t msize = 0;
+    u_int secsize = 0;
+    BENCHIO *bv;
+    pthread_t *tv;
+    HIST *hp;
+
+
+    if (!dp->danames) {
+	fprintf(stderr, "drvlist: Error: %s: No device to benchmark\n",
+		dp->ident);
+	return -1;
+    }
+
+    strcpy(path, "/dev/");
+    strncat(path, dp->danames, sizeof(path)-6);
+    cp = strchr(path+5, ',');
+    if (cp)
+	*cp = '\0';
+
+    fd = open(path, O_RDONLY|O_DIRECT);
+    if (fd < 0) {
+	fprintf(stderr, "drvlist: Error: %s: Open: %s\n", path, strerror(errno));
+	return -1;
+    }
+
+    if (ioctl(fd, DIOCGMEDIASIZE, &msize) < 0) {
+	fprintf(stderr, "drvlist: Error: %s: DIOCGMEDIASIZE: %s\n", path, strerror(errno));
+	close(fd);
+	return -1;
+    }
+    if (msize < BENCH_BLKSIZE) {
+	fprintf(stderr, "drvlist: Error: %s: Media too small to benchmark\n", path);
+	close(fd);
+	return -1;
+    }
+    if (ioctl(fd, DIOCGSECTORSIZE, &secsize) < 0 || secsize < BENCH_BLKSIZE)
+	secsize = BENCH_BLKSIZE;
+
+    qd = f_bench_qd > 0 ? f_bench_qd : 1;
+    if (qd > f_bench_ios)
+	qd = f_bench_ios;
+
+    bv = calloc(qd, sizeof(*bv));
+    tv = calloc(qd, sizeof(*tv));
+    hp = calloc(1, sizeof(*hp));
+    if (!bv || !tv || !hp) {
+	fprintf(stderr, "drvlist: Error: %s: Memory allocation failure: %s\n",
+		path, strerror(errno));
+	free(bv);
+	free(tv);
+	free(hp);
+	close(fd);
+	return -1;
+    }
+
+    for (nt = 0; nt < qd; nt++) {
+	bv[nt].fd = fd;
+	bv[nt].blksize = secsize;
+	bv[nt].nblocks = msize / secsize;
+	bv[nt].ios = f_bench_ios / qd + (nt < f_bench_ios % qd ? 1 : 0);
+	bv[nt].seed = now_ns() ^ ((uint64_t) (nt+1) << 32) ^ (uintptr_t) dp;
+	if (bv[nt].seed == 0)
+	    bv[nt].seed = 1;
+
+	if ((rc = pthread_create(&tv[nt], NULL, bench_io_thread, &bv[nt])) != 0) {
+	    fprintf(stderr, "drvlist: Error: %s: Unable to start reader thread: %s\n",
+		    path, strerror(rc));
+	    break;
+	}
+    }
+
+    for (i = 0; i < nt; i++) {
+	pthread_join(tv[i], NULL);
+	hist_merge(hp, &bv[i].hist);
+	if (!error)
+	    error = bv[i].error;
+    }
+
+    close(fd);
+
+    if (hp->errors > 0)
+	fprintf(stderr, "drvlist: Error: %s: %llu of %llu reads failed: %s\n",
+		path,
+		(unsigned long long) hp->errors,
+		(unsigned long long) (hp->n + hp->errors),
+		strerror(error ? error : EIO));
+
+    if (f_debug)
+	fprintf(stderr, "*** bench %s: %llu reads, %llu errors\n",
+		path,
+		(unsigned long long) hp->n,
+		(unsigned long long) hp->errors);
+
+    if (hp->n > 0) {
+	dp->lat_p50 = lat2str(hist_percentile(hp, 50.0));
+	dp->lat_p99 = lat2str(hist_percentile(hp, 99.0));
+	dp->lat_p999 = lat2str(hist_percentile(hp, 99.9));
+    }
+
+    free(hp);
+    free(tv);
+    free(bv);
+    return 0;
+}
+
+
+typedef struct {
+    DISK *dv;
+    int dc;
+    int next;
+    pthread_mutex_t mtx;
+} BENCHJOBS;
+
+static void *
+bench_job_thread(void *vp) {
+    BENCHJOBS *jp = (BENCHJOBS *) vp;
+    int i;
+
+    for (;;) {
+	pthread_mutex_lock(&jp->mtx);
+	i = jp->next++;
+	pthread_mutex_unlock(&jp->mtx);
+
+	if (i >= jp->dc)
+	    break;
+
+	(void) bench_rand_disk(&jp->dv[i]);
+    }
+
+    return NULL;
+}
+
+
+/*
+ * Benchmark 4K random read latency on all drives, at most f_bench_jobs
+ * drives at the same time with f_bench_qd outstanding reads each.
+ */
+int
+bench_rand(DISK *dv,
+	   int dc) {
+    BENCHJOBS jobs;
+    pthread_t *tv;
+    int i, nj;
+
+
+    if (dc <= 0)
+	return 0;
+
+    nj = f_bench_jobs > 0 ? f_bench_jobs : 1;
+    if (nj > dc)
+	nj = dc;
+
+    tv = calloc(nj, sizeof(*tv));
+    if (!tv)
+	return -1;
+
+    jobs.dv = dv;
+    jobs.dc = dc;
+    jobs.next = 0;
+    pthread_mutex_init(&jobs.mtx, NULL);
+
+    for (i = 0; i < nj; i++)
+	if (pthread_create(&tv[i], NULL, bench_job_thread, &jobs) != 0)
+	    break;
+
+    if (i == 0)
+	bench_job_thread(&jobs);
+
+    while (--i >= 0)
+	pthread_join(tv[i], NULL);
+
+    pthread_mutex_destroy(&jobs.mtx);
+    free(tv);
+    return 0;
+}
+
+
+
+/*
+ * Controller bandwidth ramp.
+ *
+ * For every controller (CAM SIM) the number of drives read from at the
+ * same time is increased step by step, and the aggregate sequential
+ * read bandwidth is measured at each step. The knee is the last step
+ * where adding drives still added a useful amount of bandwidth.
+ */
+
+#define HBA_BLKSIZE   (1024*1024)
+
+/* Adding drives must add at least this fraction of one drive's bandwidth */
+#define HBA_KNEE_GAIN 0.25
+
+typedef struct {
+    char *name;
+    int fd;
+    off_t msize;
+    off_t off;
+    uint64_t deadline;
+    uint64_t bytes;
+    int error;
+} HBAIO;
+
+typedef struct {
+    char *ctrl;
+    char **names;
+    int nc;
+} HBAGROUP;
+
+
+static void *
+hba_io_thread(void *vp) {
+    HBAIO *hp = (HBAIO *) vp;
+    void *buf = NULL;
+    ssize_t n;
+
+
+    if ((hp->error = posix_memalign(&buf, 4096, HBA_BLKSIZE)) != 0)
+	return NULL;
+
+    while (now_ns() < hp->deadline) {
+	if (hp->off + HBA_BLKSIZE > hp->msize)
+	    hp->off = 0;
+
+	n = pread(hp->fd, buf, HBA_BLKSIZE, hp->off);
+	if (n <= 0) {
+	    hp->error = n < 0 ? errno : EIO;
+	    break;
+	}
+
+	hp->off += n;
+	hp->bytes += n;
+    }
+
+    free(buf);
+    return NULL;
+}
+
+
+static int
+hba_group_add(HBAGROUP **gvp,
+	      int *gcp,
+	      const char *ctrl,
+	      const char *name) {
+    HBAGROUP *gp;
+    char **nv;
+    int i;
+
+    for (i = 0; i < *gcp && strcmp((*gvp)[i].ctrl, ctrl); i++)
+	;
+
+    if (i >= *gcp) {
+	gp = realloc(*gvp, (*gcp+1)*sizeof(HBAGROUP));
+	if (!gp)
+	    return -1;
+	*gvp = gp;
+	gp = &gp[(*gcp)++];
+	gp->ctrl = strdup(ctrl);
+	gp->names = NULL;
+	gp->nc = 0;
+    } else
+	gp = &(*gvp)[i];
+
+    nv = realloc(gp->names, (gp->nc+1)*sizeof(char *));
+    if (!nv)
+	return -1;
+    gp->names = nv;
+    gp->names[gp->nc++] = strdup(name);
+    return 0;
+}
+
+
+/* Read from the first 'n' drives of the group for f_bench_secs seconds. Returns MB/s or -1 */
+static double
+hba_step(HBAIO *iov,
+	 int n) {
+    pthread_t *tv;
+    uint64_t t0, t1, deadline, bytes = 0;
+    int i, nt, rc;
+
+
+    tv = calloc(n, sizeof(*tv));
+    if (!tv) {
+	fprintf(stderr, "drvlist: Error: Memory allocation failure: %s\n", strerror(errno));
+	return -1;
+    }
+
+    t0 = now_ns();
+    deadline = t0 + (uint64_t) f_bench_secs * 1000000000ULL;
+
+    for (nt = 0; nt < n; nt++) {
+	iov[nt].deadline = deadline;
+	iov[nt].bytes = 0;
+	iov[nt].error = 0;
+	if ((rc = pthread_create(&tv[nt], NULL, hba_io_thread, &iov[nt])) != 0) {
+	    fprintf(stderr, "drvlist: Error: %s: Unable to start reader thread: %s\n",
+		    iov[nt].name, strerror(rc));
+	    break;
+	}
+    }
+
+    for (i = 0; i < nt; i++) {
+	pthread_join(tv[i], NULL);
+	bytes += iov[i].bytes;
+	if (iov[i].error)
+	    fprintf(stderr, "drvlist: Error: /dev/%s: Read: %s\n",
+		    iov[i].name, strerror(iov[i].error));
+    }
+
+    t1 = now_ns();
+    free(tv);
+
+    if (nt == 0)
+	return -1;
+
+    return (bytes / 1000000.0) / ((t1 - t0) / 1000000000.0);
+}
+
+
+static void
+hba_ramp(HBAGROUP *gp) {
+    HBAIO *iov;
+    double mbs, prev = 0, single = 0;
+    int i, n, step, pn = 0, knee = 0, nd = 0;
+    double kneembs = 0;
+
+
+    iov = calloc(gp->nc, sizeof(*iov));
+    if (!iov) {
+	fprintf(stderr, "drvlist: Error: %s: Memory allocation failure: %s\n",
+		gp->ctrl, strerror(errno));
+	return;
+    }
+
+    for (i = 0; i < gp->nc; i++) {
+	char path[MAXPATHLEN];
+
+	snprintf(path, sizeof(path), "/dev/%s", gp->names[i]);
+	iov[nd].fd = open(path, O_RDONLY|O_DIRECT);
+	if (iov[nd].fd < 0) {
+	    fprintf(stderr, "drvlist: Error: %s: Open: %s\n", path, strerror(errno));
+	    continue;
+	}
+	if (ioctl(iov[nd].fd, DIOCGMEDIASIZE, &iov[nd].msize) < 0) {
+	    fprintf(stderr, "drvlist: Error: %s: DIOCGMEDIASIZE: %s\n", path, strerror(errno));
+	    close(iov[nd].fd);
+	    continue;
+	}
+	if (iov[nd].msize < HBA_BLKSIZE) {
+	    fprintf(stderr, "drvlist: Error: %s: Media too small to benchmark\n", path);
+	    close(iov[nd].fd);
+	    continue;
+	}
+	iov[nd].name = gp->names[i];
+	++nd;
+    }
+
+    step = f_bench_step > 0 ? f_bench_step : 1;
+
+    n = 1;
+    while (n <= nd) {
+	/* Start every step at a new offset to avoid hitting drive caches */
+	for (i = 0; i < n; i++)
+	    iov[i].off = (((off_t) n * 1024*1024*1024) % iov[i].msize) & ~((off_t) HBA_BLKSIZE-1);
+
+	mbs = hba_step(iov, n);
+	if (mbs < 0) {
+	    printf("%s: Ramp aborted at %d drives\n", gp->ctrl, n);
+	    goto End;
+	}
+	if (n == 1)
+	    single = mbs;
+
+	printf("%-10s : %6d : %9.1f : %9.1f : %5.0f%%\n",
+	       gp->ctrl, n, mbs, mbs/n,
+	       single > 0 ? 100.0*mbs/(n*single) : 0.0);
+	fflush(stdout);
+
+	if (!knee && n > 1 && mbs - prev < HBA_KNEE_GAIN * (n - pn) * single) {
+	    knee = pn;
+	    kneembs = prev;
+	}
+
+	prev = mbs;
+	pn = n;
+
+	if (n == nd)
+	    break;
+	n = (n == 1 && step > 1) ? step : n + step;
+	if (n > nd)
+	    n = nd;
+    }
+
+    if (nd == 0)
+	printf("%s: No readable drives\n", gp->ctrl);
+    else if (knee)
+	printf("%s: Knee at %d drives (%.1f MB/s)\n", gp->ctrl, knee, kneembs);
+    else
+	printf("%s: No knee found, scales to %d drives (%.1f MB/s)\n", gp->ctrl, pn, prev);
+    fflush(stdout);
+
+ End:
+    for (i = 0; i < nd; i++)
+	close(iov[i].fd);
+    free(iov);
+}
+
+
+/*
+ * Ramp the number of concurrently read drives behind each controller,
+ * one controller at a time, and report aggregate bandwidth per step.
+ */
+int
+bench_hba(DISK *dv,
+	  int dc) {
+    HBAGROUP *gv = NULL;
+    int gc = 0;
+    int i, j, k;
+
+
+    for (i = 0; i < dc; i++) {
+	for (j = 0; j < dv[i].pc; j++) {
+	    DPATH *pp = &dv[i].pv[j];
+
+	    if (!pp->ctrl)
+		continue;
+
+	    /* Only one path per drive and controller */
+	    for (k = 0; k < j && (!dv[i].pv[k].ctrl || strcmp(dv[i].pv[k].ctrl, pp->ctrl)); k++)
+		;
+	    if (k < j)
+		continue;
+
+	    if (hba_group_add(&gv, &gc, pp->ctrl, pp->name) < 0)
+		return -1;
+	}
+    }
+
+    if (isatty(1))
+	printf("\033[1;4m%-10s : %6s : %9s : %9s : %6s\033[0m\n",
+	       "CONTROLLER", "DRIVES", "MB/S", "PER-DRIVE", "EFFIC.");
+
+    for (i = 0; i < gc; i++) {
+	hba_ramp(&gv[i]);
+
+	for (j = 0; j < gv[i].nc; j++)
+	    free(gv[i].names[j]);
+	free(gv[i].names);
+	free(gv[i].ctrl);
+    }
+
+    free(gv);
+    return 0;
+}
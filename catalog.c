@@ -0,0 +1,459 @@
+/*
+ * catalog.c
+ *
+ * Firmware catalog compliance checks for drvlist.
+ *
+ * Copyright (c) 2024 Peter Eriksson <pen@lysator.liu.se>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Catalog file format, one entry per line:
+ *
+ *   vendor : product : minimum : blessed : bad[,bad...]
+ *
+ * Empty fields are allowed. Lines starting with '#' are comments.
+ * Vendor and product are matched case-insensitively.
+ *
+ * The file is mmap()ed on first use and indexed in place - no field
+ * is copied, every entry just points into the mapping.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "drvlist.h"
+
+
+typedef struct {
+    const char *p;
+    size_t len;
+} SLICE;
+
+typedef struct {
+    SLICE vendor;
+    SLICE product;
+    SLICE minimum;
+    SLICE blessed;
+    SLICE bad;
+    uint32_t hash;
+} CATENT;
+
+typedef struct {
+    char *path;
+    int loaded;
+    char *buf;
+    size_t size;
+    CATENT *ev;
+    size_t ec;
+    uint32_t *hv;	/* Entry index + 1, 0 = free slot */
+    size_t hsize;
+} CATALOG;
+
+
+static CATALOG catalog;
+
+
+static SLICE
+slice_trim(const char *p,
+	   size_t len) {
+    SLICE s;
+
+    while (len > 0 && isspace((unsigned char) *p)) {
+	++p;
+	--len;
+    }
+    while (len > 0 && isspace((unsigned char) p[len-1]))
+	--len;
+
+    s.p = p;
+    s.len = len;
+    return s;
+}
+
+static int
+slice_caseeq(SLICE a,
+	     SLICE b) {
+    return a.len == b.len && strncasecmp(a.p, b.p, a.len) == 0;
+}
+
+
+/* FNV-1a over vendor and product, case folded */
+static uint32_t
+key_hash(SLICE vendor,
+	 SLICE product) {
+    uint32_t h = 2166136261U;
+    size_t i;
+
+    for (i = 0; i < vendor.len; i++)
+	h = (h ^ (uint8_t) tolower((unsigned char) vendor.p[i])) * 16777619U;
+    h = (h ^ 0) * 16777619U;
+    for (i = 0; i < product.len; i++)
+	h = (h ^ (uint8_t) tolower((unsigned char) product.p[i])) * 16777619U;
+
+    return h;
+}
+
+
+/*
+ * Compare firmware revisions, treating digit sequences as numbers
+ * so that "C9A10" sorts after "C9A9".
+ */
+static int
+rev_cmp(SLICE a,
+	SLICE b) {
+    size_t i = 0, j = 0;
+
+    while (i < a.len && j < b.len) {
+	if (isdigit((unsigned char) a.p[i]) && isdigit((unsigned char) b.p[j])) {
+	    size_t si, sj, ni, nj;
+
+	    while (i < a.len && a.p[i] == '0')
+		++i;
+	    while (j < b.len && b.p[j] == '0')
+		++j;
+	    for (si = i; i < a.len && isdigit((unsigned char) a.p[i]); i++)
+		;
+	    for (sj = j; j < b.len && isdigit((unsigned char) b.p[j]); j++)
+		;
+	    ni = i-si;
+	    nj = j-sj;
+	    if (ni != nj)
+		return ni < nj ? -1 : 1;
+	    if (ni > 0) {
+		int d = memcmp(a.p+si, b.p+sj, ni);
+		if (d)
+		    return d;
+	    }
+	} else {
+	    int ca = toupper((unsigned char) a.p[i]);
+	    int cb = toupper((unsigned char) b.p[j]);
+
+	    if (ca != cb)
+		return ca < cb ? -1 : 1;
+	    ++i;
+	    ++j;
+	}
+    }
+
+    if (i < a.len)
+	return 1;
+    if (j < b.len)
+	return -1;
+    return 0;
+}
+
+
+static int
+catalog_load(CATALOG *cp) {
+    struct stat sb;
+    int fd;
+    char *p, *end, *eol;
+    size_t i, n;
+
+
+    cp->loaded = 1;
+
+    fd = open(cp->path, O_RDONLY);
+    if (fd < 0)
+	return -1;
+
+    if (fstat(fd, &sb) < 0) {
+	close(fd);
+	return -1;
+    }
+
+    cp->size = sb.st_size;
+    if (cp->size == 0) {
+	close(fd);
+	return 0;
+    }
+
+    cp->buf = mmap(NULL, cp->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (cp->buf == MAP_FAILED) {
+	cp->buf = NULL;
+	return -1;
+    }
+    (void) madvise(cp->buf, cp->size, MADV_SEQUENTIAL);
+
+    /* Upper bound on the number of entries */
+    n = 1;
+    for (p = cp->buf, end = cp->buf+cp->size; (p = memchr(p, '\n', end-p)) != NULL; p++)
+	++n;
+
+    cp->ev = calloc(n, sizeof(CATENT));
+    if (!cp->ev)
+	return -1;
+
+    for (p = cp->buf; p < end; p = eol+1) {
+	SLICE fv[5];
+	char *fp, *sep;
+	int nf;
+
+	eol = memchr(p, '\n', end-p);
+	if (!eol)
+	    eol = end;
+
+	memset(fv, 0, sizeof(fv));
+	for (nf = 0, fp = p; nf < 5 && fp <= eol; nf++, fp = sep+1) {
+	    sep = memchr(fp, ':', eol-fp);
+	    if (!sep || nf == 4)
+		sep = eol;
+	    fv[nf] = slice_trim(fp, sep-fp);
+	}
+
+	if (fv[0].len == 0 || fv[0].p[0] == '#' || fv[1].len == 0)
+	    continue;
+
+	cp->ev[cp->ec].vendor = fv[0];
+	cp->ev[cp->ec].product = fv[1];
+	cp->ev[cp->ec].minimum = fv[2];
+	cp->ev[cp->ec].blessed = fv[3];
+	cp->ev[cp->ec].bad = fv[4];
+	cp->ev[cp->ec].hash = key_hash(fv[0], fv[1]);
+	cp->ec++;
+    }
+
+    /* Open addressing, load factor <= 0.5 */
+    for (cp->hsize = 16; cp->hsize < cp->ec*2; cp->hsize <<= 1)
+	;
+    cp->hv = calloc(cp->hsize, sizeof(uint32_t));
+    if (!cp->hv)
+	return -1;
+
+    for (i = 0; i < cp->ec; i++) {
+	size_t h = cp->ev[i].hash & (cp->hsize-1);
+
+	while (cp->hv[h])
+	    h = (h+1) & (cp->hsize-1);
+	cp->hv[h] = i+1;
+    }
+
+    if (f_debug)
+	fprintf(stderr, "*** catalog %s: %lu entries\n", cp->path, (unsigned long) cp->ec);
+    return 0;
+}
+
+
+static CATENT *
+catalog_lookup(CATALOG *cp,
+	       SLICE vendor,
+	       SLICE product) {
+    uint32_t hash;
+    size_t h;
+
+    if (!cp->hv)
+	return NULL;
+
+    hash = key_hash(vendor, product);
+    for (h = hash & (cp->hsize-1); cp->hv[h]; h = (h+1) & (cp->hsize-1)) {
+	CATENT *ep = &cp->ev[cp->hv[h]-1];
+
+	if (ep->hash == hash &&
+	    slice_caseeq(ep->vendor, vendor) &&
+	    slice_caseeq(ep->product, product))
+	    return ep;
+    }
+
+    return NULL;
+}
+
+
+static int
+rev_inlist(SLICE list,
+	   SLICE rev) {
+    const char *p = list.p, *end = list.p+list.len, *sep;
+
+    while (p < end) {
+	sep = memchr(p, ',', end-p);
+	if (!sep)
+	    sep = end;
+	if (rev_cmp(slice_trim(p, sep-p), rev) == 0)
+	    return 1;
+	p = sep+1;
+    }
+
+    return 0;
+}
+
+
+static SLICE
+str_slice(const char *s) {
+    return slice_trim(s ? s : "", s ? strlen(s) : 0);
+}
+
+
+int
+catalog_open(const char *path) {
+    catalog.path = strdup(path);
+    return catalog.path ? 0 : -1;
+}
+
+
+/*
+ * Annotate a drive with its firmware status from the catalog. The
+ * catalog is loaded on the first call.
+ */
+int
+catalog_check(DISK *dp) {
+    CATENT *ep;
+    SLICE rev, target;
+
+
+    if (!catalog.loaded && catalog_load(&catalog) < 0) {
+	fprintf(stderr, "drvlist: Error: %s: Unable to load catalog: %s\n",
+		catalog.path, strerror(errno));
+	return -1;
+    }
+
+    ep = catalog_lookup(&catalog, str_slice(dp->vendor), str_slice(dp->product));
+    if (!ep) {
+	dp->fwstat = NULL;
+	return 0;
+    }
+
+    rev = str_slice(dp->revision);
+    if (ep->bad.len > 0 && rev_inlist(ep->bad, rev))
+	dp->fwstat = "BAD";
+    else if (ep->minimum.len > 0 && rev_cmp(rev, ep->minimum) < 0)
+	dp->fwstat = "OUTDATED";
+    else
+	dp->fwstat = "OK";
+
+    /* Upgrade target: the blessed revision, or else the minimum one */
+    target = ep->blessed.len > 0 ? ep->blessed : ep->minimum;
+
+    dp->fwwant = NULL;
+    if (target.len > 0 && rev_cmp(rev, target) < 0 &&
+	(strcmp(dp->fwstat, "OK") != 0 || ep->blessed.len > 0))
+	dp->fwwant = strndup(target.p, target.len);
+    else if (strcmp(dp->fwstat, "BAD") == 0)
+	dp->fwwant = strdup("?");
+
+    return 1;
+}
+
+
+/* Group key for the upgrade summary: vendor, product and revision */
+static uint32_t
+group_hash(const DISK *dp) {
+    SLICE rev = str_slice(dp->revision);
+    uint32_t h = key_hash(str_slice(dp->vendor), str_slice(dp->product));
+    size_t i;
+
+    h = (h ^ 0) * 16777619U;
+    for (i = 0; i < rev.len; i++)
+	h = (h ^ (uint8_t) toupper((unsigned char) rev.p[i])) * 16777619U;
+
+    return h;
+}
+
+static int
+group_eq(const DISK *a,
+	 const DISK *b) {
+    return slice_caseeq(str_slice(a->vendor), str_slice(b->vendor)) &&
+	slice_caseeq(str_slice(a->product), str_slice(b->product)) &&
+	slice_caseeq(str_slice(a->revision), str_slice(b->revision));
+}
+
+
+/*
+ * Print drives that are not running the blessed (or at least the
+ * minimum) firmware, grouped by vendor, product and revision.
+ */
+void
+catalog_summary(const DISK *dv,
+		int dc) {
+    int *gv, *gn;
+    uint32_t *hv;
+    size_t hsize, h;
+    int i, g, ng = 0;
+
+
+    /* Open addressing on group index + 1, load factor <= 0.5 */
+    for (hsize = 16; hsize < (size_t) dc*2; hsize <<= 1)
+	;
+
+    gv = calloc(dc > 0 ? dc : 1, sizeof(int));
+    gn = calloc(dc > 0 ? dc : 1, sizeof(int));
+    hv = calloc(hsize, sizeof(uint32_t));
+    if (!gv || !gn || !hv) {
+	fprintf(stderr, "drvlist: Error: Memory allocation failure: %s\n", strerror(errno));
+	free(gv);
+	free(gn);
+	free(hv);
+	return;
+    }
+
+    /* Groups are kept in order of first appearance */
+    for (i = 0; i < dc; i++) {
+	const DISK *dp = &dv[i];
+
+	if (!dp->fwwant)
+	    continue;
+
+	for (h = group_hash(dp) & (hsize-1); hv[h]; h = (h+1) & (hsize-1))
+	    if (group_eq(&dv[gv[hv[h]-1]], dp))
+		break;
+
+	if (!hv[h]) {
+	    gv[ng] = i;
+	    hv[h] = ++ng;
+	}
+	gn[hv[h]-1]++;
+    }
+
+    for (g = 0; g < ng; g++) {
+	const DISK *dp = &dv[gv[g]];
+
+	if (g == 0)
+	    printf("\nFirmware upgrade candidates:\n");
+	printf("  %s %s : %s -> %s : %d drive%s (%s)\n",
+	       *dp->vendor ? dp->vendor : "?",
+	       *dp->product ? dp->product : "?",
+	       *dp->revision ? dp->revision : "?",
+	       dp->fwwant,
+	       gn[g], gn[g] == 1 ? "" : "s",
+	       dp->fwstat);
+    }
+
+    free(hv);
+    free(gn);
+    free(gv);
+}
@@ -0,0 +1,504 @@
+/*
+ * columns.c
+ *
+ * Column store for the drvlist drive table.
+ *
+ * Copyright (c) 2024 Peter Eriksson <pen@lysator.liu.se>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * The table printer needs every field of every drive twice, once for
+ * the column widths and once for the output, and the sort one or two
+ * keys per drive. Rather than trimming the DISK strings in place and
+ * sorting whole DISK records, each field is extracted once into an
+ * array per column (value pointer and trimmed length). Widths are then
+ * a scan over a length array, and sorting reorders an index of small
+ * key records.
+ *
+ * Sorting is in natural order: digit runs compare by value, so "da9"
+ * comes before "da10". Large tables are sorted by encoding each row's
+ * keys into a fixed-length byte string that compares the same way with
+ * memcmp() and radix sorting the row index on it. A digit run becomes
+ * '0', its number of significant digits and the digits. Rows whose keys
+ * did not fit and compare equal are then sorted with the comparison
+ * function.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <limits.h>
+#include <sys/types.h>
+
+#include "drvlist.h"
+
+
+#define COLS_KEYLEN     64	/* Encoded sort key bytes per row */
+#define COLS_KEY1LEN    24	/* ... for the first of two keys */
+#define COLS_RADIX_MIN  1024	/* Sort fewer rows with qsort() */
+
+
+/* Minimum column widths */
+static const int col_minwidth[COL_MAX] = {
+    7,	/* IDENT */
+    6,	/* VENDOR */
+    7,	/* PRODUCT */
+    4,	/* REV. */
+    5,	/* NAMES */
+    3,	/* DRV. */
+    4,	/* PATH */
+    4,	/* PHYS */
+    3,	/* SIZE */
+    3,	/* P50 */
+    3,	/* P99 */
+    5,	/* P99.9 */
+    2,	/* FW */
+    4,	/* POOL */
+    9,	/* VDEV GUID */
+    9,	/* MULTIPATH */
+    6,	/* LABELS */
+    5,	/* PARTS */
+};
+
+
+typedef struct {
+    const char *s1;
+    const char *s2;
+    u_short l1;
+    u_short l2;
+    int row;
+} COLKEY;
+
+
+/* Store a value without leading and trailing whitespace, or 'def' if empty */
+static void
+col_set(COLS *cp,
+	int c,
+	int i,
+	const char *s,
+	const char *def) {
+    size_t off, len = 0;
+
+    if (s) {
+	len = drvlist_trimspan(s, strlen(s), &off);
+	s += off;
+    }
+    if (len == 0) {
+	s = def;
+	len = strlen(def);
+    }
+    if (len > USHRT_MAX)
+	len = USHRT_MAX;
+
+    cp->str[c][i] = s;
+    cp->len[c][i] = len;
+}
+
+/* Values that do not fit in maxwidth with room to spare are cut and end in ".." */
+static int
+col_cut(const COLS *cp,
+	int len) {
+    return cp->maxwidth > 2 && len+2 > cp->maxwidth;
+}
+
+
+int
+cols_build(COLS *cp,
+	   const DISK *dv,
+	   int dc,
+	   int maxwidth) {
+    const char **sv;
+    u_short *lv;
+    int c, i, w, n = dc > 0 ? dc : 1;
+
+
+    memset(cp, 0, sizeof(*cp));
+    sv = malloc(COL_MAX*n*sizeof(*sv));
+    lv = malloc(COL_MAX*n*sizeof(*lv));
+    cp->order = malloc(n*sizeof(*cp->order));
+    if (!sv || !lv || !cp->order) {
+	free(sv);
+	free(lv);
+	free(cp->order);
+	return -1;
+    }
+
+    cp->n = dc;
+    cp->maxwidth = maxwidth;
+    for (c = 0; c < COL_MAX; c++) {
+	cp->str[c] = sv + c*n;
+	cp->len[c] = lv + c*n;
+    }
+
+    for (i = 0; i < dc; i++) {
+	const DISK *dp = &dv[i];
+
+	col_set(cp, COL_IDENT, i, dp->ident, "");
+	col_set(cp, COL_VENDOR, i, dp->vendor, "?");
+	col_set(cp, COL_PRODUCT, i, dp->product, "?");
+	col_set(cp, COL_REVISION, i, dp->revision, "?");
+	col_set(cp, COL_NAMES, i, dp->danames, "");
+	col_set(cp, COL_DRIVER, i, dp->driver, "-");
+	col_set(cp, COL_PATH, i, dp->path, "-");
+	col_set(cp, COL_PHYS, i, dp->phys, "");
+	col_set(cp, COL_SIZE, i, dp->size, "?");
+	col_set(cp, COL_P50, i, dp->lat_p50, "-");
+	col_set(cp, COL_P99, i, dp->lat_p99, "-");
+	col_set(cp, COL_P999, i, dp->lat_p999, "-");
+	col_set(cp, COL_FW, i, dp->fwstat, "-");
+	col_set(cp, COL_ZPOOL, i, dp->zpool, "-");
+	col_set(cp, COL_ZGUID, i, dp->zguid, "-");
+	col_set(cp, COL_MPATH, i, dp->mpath, "-");
+	col_set(cp, COL_LABELS, i, dp->labels, "-");
+	col_set(cp, COL_PARTS, i, dp->parts, "-");
+	cp->order[i] = i;
+    }
+
+    for (c = 0; c < COL_MAX; c++) {
+	const u_short *lp = cp->len[c];
+	int max = 0;
+
+	for (i = 0; i < dc; i++)
+	    if (lp[i] > max)
+		max = lp[i];
+
+	w = col_cut(cp, max) ? cp->maxwidth : max;
+	cp->width[c] = w > col_minwidth[c] ? w : col_minwidth[c];
+    }
+
+    return 0;
+}
+
+void
+cols_free(COLS *cp) {
+    free(cp->str[0]);
+    free(cp->len[0]);
+    free(cp->order);
+    memset(cp, 0, sizeof(*cp));
+}
+
+
+/* Natural order comparison, digit runs compare by value */
+static int
+key_cmp(const char *a,
+	int alen,
+	const char *b,
+	int blen) {
+    int i = 0, j = 0;
+
+    while (i < alen && j < blen) {
+	if (isdigit((unsigned char) a[i]) && isdigit((unsigned char) b[j])) {
+	    int si, sj, d;
+
+	    while (i < alen && a[i] == '0')
+		++i;
+	    while (j < blen && b[j] == '0')
+		++j;
+	    for (si = i; i < alen && isdigit((unsigned char) a[i]); i++)
+		;
+	    for (sj = j; j < blen && isdigit((unsigned char) b[j]); j++)
+		;
+	    if (i-si != j-sj)
+		return (i-si) - (j-sj);
+	    d = memcmp(a+si, b+sj, i-si);
+	    if (d)
+		return d;
+	} else if (a[i] != b[j]) {
+	    /* A digit against a non-digit compares as '0' would */
+	    int ca = isdigit((unsigned char) a[i]) ? '0' : (unsigned char) a[i];
+	    int cb = isdigit((unsigned char) b[j]) ? '0' : (unsigned char) b[j];
+
+	    return ca - cb;
+	} else {
+	    ++i;
+	    ++j;
+	}
+    }
+
+    return (alen-i) - (blen-j);
+}
+
+/*
+ * Encode a key into 'size' bytes (zero padded) that memcmp() in the
+ * order of key_cmp(). Returns 1 if it did not fit: a digit run that
+ * does not fit still gets its '0' marker, and the rest is filled with
+ * 0xff, since its number is longer than that of any row that did fit
+ * with the same prefix.
+ */
+static int
+key_encode(uint8_t *out,
+	   int size,
+	   const char *s,
+	   int len) {
+    int i = 0, o = 0, si;
+
+    while (i < len) {
+	if (isdigit((unsigned char) s[i])) {
+	    while (i < len && s[i] == '0')
+		++i;
+	    for (si = i; i < len && isdigit((unsigned char) s[i]); i++)
+		;
+	    if (o+2+(i-si) > size || i-si > UCHAR_MAX) {
+		if (o < size)
+		    out[o++] = '0';
+		memset(out+o, 0xff, size-o);
+		return 1;
+	    }
+	    out[o++] = '0';
+	    out[o++] = i-si;
+	    memcpy(out+o, s+si, i-si);
+	    o += i-si;
+	} else {
+	    if (o >= size)
+		return 1;
+	    out[o++] = s[i++];
+	}
+    }
+
+    return 0;
+}
+
+static int
+colkey_cmp(const void *a,
+	   const void *b) {
+    const COLKEY *ka = (const COLKEY *) a;
+    const COLKEY *kb = (const COLKEY *) b;
+    int d;
+
+    d = key_cmp(ka->s1, ka->l1, kb->s1, kb->l1);
+    if (d)
+	return d;
+
+    d = key_cmp(ka->s2, ka->l2, kb->s2, kb->l2);
+    if (d)
+	return d;
+
+    return ka->row - kb->row;
+}
+
+static void
+colkey_set(COLKEY *kp,
+	   const COLS *cp,
+	   int c1,
+	   int c2,
+	   int i) {
+    kp->s1 = cp->str[c1][i];
+    kp->l1 = cp->len[c1][i];
+    kp->s2 = c2 < 0 ? "" : cp->str[c2][i];
+    kp->l2 = c2 < 0 ? 0 : cp->len[c2][i];
+    kp->row = i;
+}
+
+/*
+ * Stable MSD radix sort of iv[0..n-1] on key bytes p and on,
+ * with insertion sort for small buckets. tmp is scratch space.
+ */
+static void
+radix_sort(const uint8_t *keys,
+	   int *iv,
+	   int *tmp,
+	   int n,
+	   int p) {
+    int count[256], start[256];
+    int i, j, b;
+
+
+    while (n >= 32 && p < COLS_KEYLEN) {
+	memset(count, 0, sizeof(count));
+	for (i = 0; i < n; i++)
+	    count[keys[(size_t) iv[i]*COLS_KEYLEN + p]]++;
+
+	/* All rows have the same byte here: skip their common prefix */
+	if (count[keys[(size_t) iv[0]*COLS_KEYLEN + p]] == n) {
+	    const uint8_t *k0 = keys + (size_t) iv[0]*COLS_KEYLEN;
+	    int lcp = COLS_KEYLEN;
+
+	    for (i = 1; i < n && lcp > p+1; i++) {
+		const uint8_t *kp = keys + (size_t) iv[i]*COLS_KEYLEN;
+		int q;
+
+		for (q = p+1; q < lcp && kp[q] == k0[q]; q++)
+		    ;
+		lcp = q;
+	    }
+	    p = lcp;
+	    continue;
+	}
+
+	for (b = 0, j = 0; b < 256; b++) {
+	    start[b] = j;
+	    j += count[b];
+	}
+	for (i = 0; i < n; i++)
+	    tmp[start[keys[(size_t) iv[i]*COLS_KEYLEN + p]]++] = iv[i];
+	memcpy(iv, tmp, n*sizeof(*iv));
+
+	for (b = 0, j = 0; b < 256; j += count[b++])
+	    if (count[b] > 1)
+		radix_sort(keys, iv+j, tmp+j, count[b], p+1);
+	return;
+    }
+
+    for (i = 1; i < n && p < COLS_KEYLEN; i++) {
+	int r = iv[i];
+	const uint8_t *kp = keys + (size_t) r*COLS_KEYLEN + p;
+
+	for (j = i; j > 0 && memcmp(keys + (size_t) iv[j-1]*COLS_KEYLEN + p, kp, COLS_KEYLEN-p) > 0; j--)
+	    iv[j] = iv[j-1];
+	iv[j] = r;
+    }
+}
+
+/* Radix sort the row index on encoded keys */
+static int
+cols_radix(COLS *cp,
+	   int c1,
+	   int c2) {
+    uint8_t *keys, *trunc;
+    int *tmp;
+    int i, j, n = cp->n, k1 = c2 < 0 ? COLS_KEYLEN : COLS_KEY1LEN;
+
+
+    keys = calloc(n, COLS_KEYLEN);
+    trunc = calloc(n, 1);
+    tmp = malloc(n*sizeof(*tmp));
+    if (!keys || !trunc || !tmp) {
+	free(keys);
+	free(trunc);
+	free(tmp);
+	return -1;
+    }
+
+    for (i = 0; i < n; i++) {
+	uint8_t *kp = keys + (size_t) i*COLS_KEYLEN;
+
+	if (key_encode(kp, k1, cp->str[c1][i], cp->len[c1][i])) {
+	    /* Longer than any row with the same prefix that did fit */
+	    memset(kp+k1, 0xff, COLS_KEYLEN-k1);
+	    trunc[i] = 1;
+	} else if (c2 >= 0)
+	    trunc[i] = key_encode(kp+k1, COLS_KEYLEN-k1, cp->str[c2][i], cp->len[c2][i]);
+	cp->order[i] = i;
+    }
+
+    radix_sort(keys, cp->order, tmp, n, 0);
+
+    /* Rows with equal keys where one did not fit need a full compare */
+    for (i = 0; i < n; i = j) {
+	int t = trunc[cp->order[i]];
+
+	for (j = i+1; j < n && memcmp(keys + (size_t) cp->order[i]*COLS_KEYLEN,
+				      keys + (size_t) cp->order[j]*COLS_KEYLEN,
+				      COLS_KEYLEN) == 0; j++)
+	    t |= trunc[cp->order[j]];
+
+	if (t && j-i > 1) {
+	    COLKEY *kv = malloc((j-i)*sizeof(*kv));
+	    int k;
+
+	    if (!kv)
+		break;
+	    for (k = i; k < j; k++)
+		colkey_set(&kv[k-i], cp, c1, c2, cp->order[k]);
+	    qsort(kv, j-i, sizeof(*kv), colkey_cmp);
+	    for (k = i; k < j; k++)
+		cp->order[k] = kv[k-i].row;
+	    free(kv);
+	}
+    }
+
+    free(keys);
+    free(trunc);
+    free(tmp);
+    return 0;
+}
+
+/*
+ * Set the row order: by ident, or else by controller and path (the
+ * default), in natural order. Ties keep discovery order.
+ */
+int
+cols_sort(COLS *cp,
+	  const char *key) {
+    COLKEY *kv;
+    int c1, c2, i;
+
+
+    if (key && strcmp(key, "ident") == 0) {
+	c1 = COL_IDENT;
+	c2 = -1;
+    } else {
+	c1 = COL_DRIVER;
+	c2 = COL_PATH;
+    }
+
+    if (cp->n >= COLS_RADIX_MIN)
+	return cols_radix(cp, c1, c2);
+
+    kv = malloc((cp->n > 0 ? cp->n : 1)*sizeof(*kv));
+    if (!kv)
+	return -1;
+
+    for (i = 0; i < cp->n; i++)
+	colkey_set(&kv[i], cp, c1, c2, i);
+
+    qsort(kv, cp->n, sizeof(*kv), colkey_cmp);
+
+    for (i = 0; i < cp->n; i++)
+	cp->order[i] = kv[i].row;
+
+    free(kv);
+    return 0;
+}
+
+
+/* Move the drives into the row order (the index is used up) */
+void
+cols_reorder(COLS *cp,
+	     DISK *dv) {
+    DISK tmp;
+    int i, j, src;
+
+
+    for (i = 0; i < cp->n; i++) {
+	if (cp->order[i] < 0 || cp->order[i] == i)
+	    continue;
+
+	tmp = dv[i];
+	for (j = i; (src = cp->order[j]) != i; j = src) {
+	    dv[j] = dv[src];
+	    cp->order[j] = -1;
+	}
+	dv[j] = tmp;
+	cp->order[j] = -1;
+    }
+}
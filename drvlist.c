@@ -38,655 +38,692 @@
 #include <string.h>
 #include <ctype.h>
 #include <errno.h>
-#include <fcntl.h>
 #include <math.h>
 #include <unistd.h>
 #include <sys/types.h>
-#include <sys/ioctl.h>
-#include <sys/sysctl.h>
-#include <sys/disk.h>
-#include <sys/stat.h>
-#include <camlib.h>
-#include <cam/scsi/scsi_message.h>
-#include <cam/ata/ata_all.h>
-#include <cam/mmc/mmc_all.h>
-#include <dev/nvme/nvme.h>
 
+#include "drvlist.h"
 
 
 int f_verbose = 0;
 int f_debug = 0;
 int f_phys = 0;
 int f_maxwidth = 20;
+int f_bench_rand = 0;
+int f_bench_hba = 0;
+int f_topology = 0;
+int f_summary = 0;
+int f_catalog = 0;
+int f_lookup = 0;
+int f_zfs = 0;
+int f_geom = 0;
+int f_record = 0;
+int f_publish_secs = 0;
+char *f_publish = NULL;
+char *f_published = NULL;
+char *f_dump = NULL;
+char *f_load = NULL;
+char *f_negcache = NULL;
+int f_forget = 0;
+char *f_cached = NULL;
+char *f_forget_dev = NULL;
+char *f_history = NULL;
 
 char *f_sort = NULL;
+char *f_format = NULL;
+char *f_sqlite = NULL;
+char *f_arrow = NULL;
 
 
-typedef struct {
-    char *ident;
-    char *danames;
-    char *vendor;
-    char *product;
-    char *revision;
-    char *driver;
-    char *path;
-    char *phys;
-    char *size;
-} DISK;
-
-#define MAXDISK 2048
-
-int dc = 0;
-int ds = 0;
-DISK *dv;
-
 
+/* Enumeration callbacks, 'arg' is argv[0] */
 static int
-dv_sort_ident(const DISK *da, const DISK *db) {
-    return strcmp(da->ident, db->ident);
+cli_want(const char *serial,
+	 size_t len,
+	 void *arg) {
+    return lookup_want(serial, len);
 }
 
 static int
-dv_sort_devpath(const DISK *da, const DISK *db) {
-    int d;
-
-    d = strcmp(da->driver, db->driver);
-    if (d)
-	return d;
-    
-    return strcmp(da->path, db->path);
+cli_done(void *arg) {
+    return lookup_done();
 }
 
 static int
-dv_sort(const void *a, const void *b) {
-    if (f_sort) {
-	if (strcmp(f_sort, "ident") == 0)
-	    return dv_sort_ident((const DISK *) a, (const DISK *) b);
-    }
-    
-    return dv_sort_devpath((const DISK *) a, (const DISK *) b);
+cli_mediasize(const char *name,
+	      off_t *msize,
+	      void *arg) {
+    return geom_mediasize(name, msize);
 }
 
-
-char *
-strdupcat(char **old,
-	  char *add) {
-    size_t olen = 0;
-    size_t alen = 0;
-    
-    if (*old) {
-	if (strcmp(*old, add) == 0)
-	    return 0;
-	
-	olen += strlen(*old);
-    }
-    
-    if (olen > 0)
-	++alen;
-    alen += strlen(add);
-
-    if (*old && strcmp(*old, add) > 0) {
-	char *new = malloc(olen+alen+1);
-	if (!new)
-	    return NULL;
-	strcpy(new, add);
-	strcat(new, ",");
-	strcat(new, *old);
-	free(*old);
-	*old = new;
-    } else {
-	*old = realloc(*old, olen+alen+1);
-	if (!*old)
-	    return NULL;
-	
-	if (olen > 0)
-	    (*old)[olen++] = ',';
-	
-	strcpy((*old)+olen, add);
+static int
+cli_event(int ev,
+	  int idx,
+	  const DISK *dp,
+	  const DPATH *pp,
+	  void *arg) {
+    switch (ev) {
+    case DRVLIST_EV_PATH:
+	fprintf(stderr, "*** drive #%d %s: path %s\n", idx, dp->ident, pp->name);
+	break;
+    case DRVLIST_EV_MERGE:
+	fprintf(stderr, "*** drive #%d %s: path %s merged (%d paths)\n",
+		idx, dp->ident, pp->name, dp->pc);
+	break;
+    case DRVLIST_EV_DISK:
+	fprintf(stderr, "*** drive #%d %s: done (%s)\n", idx, dp->ident, dp->danames);
+	break;
     }
-    
-    return *old;
+    return 0;
 }
 
-int
-strtrim(char *str,
-	int *len) {
-    int i, j, n;
-
-    
-    if (!str)
-	return 0;
+static int
+cli_probe(const char *name,
+	  void *arg) {
+    return negcache_probe(name);
+}
 
-    /* Remove leading whitespace */
-    for (i = 0; str[i] && isspace(str[i]); i++)
-	;
-    if (i > 0) {
-	for (j = 0; str[i]; j++, i++)
-	    str[j] = str[i];
-	str[j] = '\0';
-    }
+static void
+cli_result(const char *name,
+	   int rc,
+	   const char *stage,
+	   int err,
+	   void *arg) {
+    negcache_result(name, rc, stage, err);
+}
 
-    /* Remove trailing whitespace */
-    n = strlen(str);
-    while (n > 0 && isspace(str[n-1]))
-	--n;
-    str[n] = '\0';
-    if (len && n > *len)
-	*len = n;
-    return n;
+static void
+cli_skipped(const char *name,
+	    void *arg) {
+    fprintf(stderr, "%s: Error: %s: Skipped: %s\n", (const char *) arg, name, strerror(errno));
 }
 
 
-int strntrim(char *str,
-	     int *len,
-	     int max) {
-    int rlen = strtrim(str, len);
+static DRVLIST *
+scan(const char *argv0,
+     const DRVLIST_OPTS *opts,
+     char **devv,
+     int devc) {
+    DRVLIST *ctx;
+    int rc, err;
 
-    if (max == 0)
-	return rlen;
-    
-    if (rlen+2 > max) {
-	str[max-2] = '.';
-	str[max-1] = '.';
-	str[max] = '\0';
-	rlen = max;
-	if (len)
-	    *len = rlen;
+    ctx = drvlist_create(opts);
+    if (!ctx) {
+	fprintf(stderr, "%s: Error: Memory allocation failure: %s\n",
+		argv0, strerror(errno));
+	exit(1);
     }
 
-    return rlen;
-}
-
-static int
-ata_cam_send(struct cam_device *device, union ccb *ccb)
-{
-	/* Disable freezing the device queue */
-	ccb->ccb_h.flags |= CAM_DEV_QFRZDIS;
+    rc = drvlist_enumerate(ctx, devv, devc);
+    err = errno;
+    if (negcache_save() < 0)
+	fprintf(stderr, "%s: Error: Unable to save negative cache: %s\n",
+		argv0, strerror(errno));
+    errno = err;
+
+    if (rc < 0) {
+	if (drvlist_errdev(ctx))
+	    fprintf(stderr, "%s: Error: %s: Unable to access: %s\n",
+		    argv0, drvlist_errdev(ctx), strerror(errno));
+	else
+	    fprintf(stderr, "%s: Error: Unable to get list of drives from kernel: %s\n",
+		    argv0, strerror(errno));
+	exit(1);
+    }
 
+    return ctx;
+}
 
-	if (cam_send_ccb(device, ccb) < 0) {
-		return (1);
-	}
 
-	/*
-	 * Consider any non-CAM_REQ_CMP status as error and report it here,
-	 * unless caller set AP_FLAG_CHK_COND, in which case it is responsible.
-	 */
-	if (!(ccb->ataio.cmd.flags & CAM_ATAIO_NEEDRESULT) &&
-	    (ccb->ccb_h.status & CAM_STATUS_MASK) != CAM_REQ_CMP) {
-		return (1);
+/*
+ * Publish the drive table in shared memory, once or every
+ * f_publish_secs seconds. Unchanged tables are not republished.
+ */
+static int
+publish(const char *argv0,
+	const DRVLIST_OPTS *opts,
+	char **devv,
+	int devc) {
+    DRVLIST *ctx;
+    DISK *dv;
+    int dc, rc;
+
+    for (;;) {
+	ctx = scan(argv0, opts, devv, devc);
+	dv = drvlist_disks(ctx, &dc);
+
+	rc = drvlist_shm_publish(f_publish, dv, dc);
+	if (rc < 0) {
+	    fprintf(stderr, "%s: Error: %s: Unable to publish: %s\n",
+		    argv0, f_publish, strerror(errno));
+	    exit(1);
 	}
+	if (f_debug)
+	    fprintf(stderr, "*** publish %s: %d drives, %s\n",
+		    f_publish, dc, rc ? "published" : "unchanged");
+	drvlist_destroy(ctx);
 
-	return (0);
+	if (f_publish_secs <= 0)
+	    return 0;
+	sleep(f_publish_secs);
+    }
 }
 
 
+/*
+ * Read the drives from a dump file. With -I only the requested drives
+ * are looked up. The dump stays open, the drives point into it.
+ */
 static int
-ata_do_cmd(struct cam_device *device, union ccb *ccb, int retries,
-	   uint32_t flags, uint8_t protocol, uint8_t ata_flags,
-	   uint8_t tag_action, uint8_t command, uint16_t features,
-	   u_int64_t lba, uint16_t sector_count, uint8_t *data_ptr,
-	   uint16_t dxfer_len, int timeout, int force48bit)
-{
-	CCB_CLEAR_ALL_EXCEPT_HDR(&ccb->ataio);
-	cam_fill_ataio(&ccb->ataio,
-		       retries,
-		       NULL,
-		       flags,
-		       tag_action,
-		       data_ptr,
-		       dxfer_len,
-		       timeout);
-
-	if (force48bit || lba > ATA_MAX_28BIT_LBA)
-		ata_48bit_cmd(&ccb->ataio, command, features, lba, sector_count);
-	else
-		ata_28bit_cmd(&ccb->ataio, command, features, lba, sector_count);
+load_dump(const char *argv0,
+	  const char *path,
+	  DISK **dvp) {
+    DRVLIST_DUMP *dp;
+    DISK *dv;
+    const char *s;
+    int n, dc = 0, rc = 0;
+
+
+    dp = drvlist_dump_open(path);
+    if (!dp)
+	goto Fail;
+
+    if (!lookup_active()) {
+	dc = drvlist_dump_read(dp, dvp);
+	if (dc < 0)
+	    goto Fail;
+	return dc;
+    }
 
-	if (ata_flags & AP_FLAG_CHK_COND)
-		ccb->ataio.cmd.flags |= CAM_ATAIO_NEEDRESULT;
+    for (n = 0; lookup_serial(n); n++)
+	;
+    dv = calloc(n+1, sizeof(DISK));
+    if (!dv)
+	goto Fail;
+    for (n = 0; (s = lookup_serial(n)) != NULL; n++) {
+	rc = drvlist_dump_find(dp, s, &dv[dc]);
+	if (rc < 0)
+	    goto Fail;
+	if (rc == 0 && lookup_want(s, strlen(s)))
+	    ++dc;
+    }
+    *dvp = dv;
+    return dc;
 
-	return ata_cam_send(device, ccb);
+ Fail:
+    fprintf(stderr, "%s: Error: %s: Unable to load dump: %s\n",
+	    argv0, path, strerror(errno));
+    exit(1);
 }
 
-int
-ata_identify(struct cam_device *cdb,
-	     char **vendor,
-	     char **model,
-	     char **revision) {
-    union ccb *ccb;
-    struct ata_params apb;
-    uint8_t *bp;
-    u_int i, error;
-    uint8_t command, retry_command;
-    
-    
-    if ((ccb = cam_getccb(cdb)) == NULL) {
-	return -1;
-    }
 
-    command = ATA_ATA_IDENTIFY;
-    retry_command = ATA_ATAPI_IDENTIFY;
-    
- retry:
-    error = ata_do_cmd(cdb,
-		       ccb,
-		       1, /*retries*/
-		       CAM_DIR_IN, /*flags*/
-		       AP_PROTO_PIO_IN, /*protocol*/
-		       AP_FLAG_BYT_BLOK_BLOCKS | AP_FLAG_TLEN_SECT_CNT, /*ata_flags*/
-		       MSG_SIMPLE_Q_TAG, /*tag_action*/
-		       command, /*command*/
-		       0, /*features*/
-		       0, /*lba*/
-		       sizeof(struct ata_params) / 512, /*sector_count*/
-		       (uint8_t *)&apb, /*data_ptr*/
-		       sizeof(apb), /*dxfer_len*/
-		       30000, /* timeout */
-		       0 /*force48bit*/);
-    
-    if (error != 0) {
-	if (retry_command != 0) {
-	    command = retry_command;
-	    retry_command = 0;
-	    goto retry;
-	}
-	return (1);
+/* Build the row template for the default table layout */
+static void
+table_format(char *buf,
+	     size_t size,
+	     const COLS *cp,
+	     int numlen) {
+    static const struct {
+	int col;
+	const char *name;
+	int right;
+    } cv[] = {
+	{ COL_VENDOR,   "vendor",    0 },
+	{ COL_PRODUCT,  "product",   0 },
+	{ COL_REVISION, "rev",       0 },
+	{ COL_IDENT,    "ident",     0 },
+	{ COL_SIZE,     "size",      1 },
+	{ COL_NAMES,    "names",     0 },
+	{ COL_PHYS,     "phys",      0 },
+	{ COL_P50,      "p50",       1 },
+	{ COL_P99,      "p99",       1 },
+	{ COL_P999,     "p99.9",     1 },
+	{ COL_FW,       "fw",        0 },
+	{ COL_MPATH,    "multipath", 0 },
+	{ COL_LABELS,   "labels",    0 },
+	{ COL_PARTS,    "parts",     0 },
+	{ COL_ZPOOL,    "pool",      0 },
+	{ COL_ZGUID,    "guid",      0 },
+	{ COL_DRIVER,   "drv",       0 },
+	{ COL_PATH,     "path",      0 },
+    };
+    size_t len;
+    int k, c;
+
+
+    len = snprintf(buf, size, "{n:>%d}", numlen);
+    for (k = 0; k < (int) (sizeof(cv)/sizeof(cv[0])) && len < size; k++) {
+	c = cv[k].col;
+	if ((c == COL_PHYS && !f_phys) ||
+	    ((c == COL_P50 || c == COL_P99 || c == COL_P999) && !f_bench_rand) ||
+	    (c == COL_FW && !f_catalog) ||
+	    ((c == COL_MPATH || c == COL_LABELS) && !f_geom) ||
+	    (c == COL_PARTS && !(f_geom && f_verbose)) ||
+	    (c == COL_ZPOOL && !f_zfs) ||
+	    (c == COL_ZGUID && !(f_zfs && f_verbose)) ||
+	    ((c == COL_DRIVER || c == COL_PATH) && !f_verbose))
+	    continue;
+
+	/* PHYS and PATH are not padded */
+	len += snprintf(buf+len, size-len, " : {%s:%s%d.%d}",
+			cv[k].name, cv[k].right ? ">" : "",
+			c == COL_PHYS || c == COL_PATH ? 0 : cp->width[c],
+			cp->maxwidth);
     }
-    
-    ata_param_fixup(&apb);
-    
-    error = 1;
-    bp = (uint8_t *) &apb;
-    for (i = 0; i < sizeof(apb); i++) {
-	if (bp[i] != 0)
-	    error = 0;
-    }
-    
-    /* check for invalid (all zero) response */
-    if (error != 0) {
-	return (error);
-    }
-    
-    cam_freeccb(ccb);
-    
-    *vendor = strdup("ATA");
-    *model = strndup((char *) apb.model, sizeof(apb.model));
-    *revision = strndup((char *) apb.revision, sizeof(apb.revision));
-    return 0;
 }
 
 
-
-int
-nvme_identify(int fd,
-	      char *daname,
-	      char *driver,
-	      char *pnbuf) {
-    struct nvme_pt_command pt;
-    struct nvme_controller_data cdata;
-    char *ident = NULL;
-    DISK *dp;
-    char *cp;
-    int i, j;
-    char pbuf[MAXPATHLEN];
-    
-    
-    memset(&pt, 0, sizeof(pt));
-    memset(&cdata, 0, sizeof(cdata));
-    
-    pt.cmd.opc = NVME_OPC_IDENTIFY;
-    pt.cmd.cdw10 = htole32(1);
-    pt.buf = &cdata;
-    pt.len = sizeof(cdata);
-    pt.is_read = 1;
-    
-    if (ioctl(fd, NVME_PASSTHROUGH_CMD, &pt) < 0) {
-	fprintf(stderr, "NVME ioctl: %s\n", strerror(errno));
-	return -1;
-    }
-	
-    if (nvme_completion_is_error(&pt.cpl)) {
-	fprintf(stderr, "NVME nvme_completion\n");
-	return -1;
-    }
-	
-    ident = strndup(((const char*)cdata.sn), NVME_SERIAL_NUMBER_LENGTH);
-    if (!ident) {
-	fprintf(stderr, "NVME No IDENTn\n");
-	return -1;
+/*
+ * Print the drive table (values cut to f_maxwidth) and leave the drives
+ * sorted in print order. Returns the number of lines printed.
+ */
+static int
+print_table(DISK *dv,
+	    int dc) {
+    COLS cols;
+    FMT fmt;
+    char tmpl[1024];
+    const char *err;
+    int i, numlen;
+
+
+    if (cols_build(&cols, dv, dc, f_maxwidth) < 0 ||
+	cols_sort(&cols, f_sort) < 0) {
+	fprintf(stderr, "drvlist: Error: %s\n", strerror(errno));
+	cols_free(&cols);
+	return 0;
     }
-    
-    for (i = 0; i < dc && strcmp(dv[i].ident, ident); i++)
-	;
-    
-    dp = &dv[i];
-    
-    if (i >= dc) {
-	dp->vendor = strndup(((const char*)cdata.mn), NVME_MODEL_NUMBER_LENGTH);
-	for (j = NVME_MODEL_NUMBER_LENGTH-1; j >= 0 && isspace(dp->vendor[j]) ; j--)
-	    ;
-	dp->vendor[j+1] = '\0';
-	for (cp = dp->vendor; *cp && !isspace(*cp); ++cp)
-	    ;
-	if (*cp) {
-	    *cp++ = '\0';
-	    while (isspace(*cp))
-		    ++cp;
-	    dp->product = strdup(cp);
-	}
+    numlen = (int) (log10(dc)+1);
 
-	if (!pnbuf) {
-	    sprintf(pbuf, "pci vendor 0x%04x:0x%04x oui %02x:%02x:%02x controller 0x%04x",
-		    cdata.vid, cdata.ssvid,
-		    cdata.ieee[0], cdata.ieee[1], cdata.ieee[2],
-		    cdata.ctrlr_id);
-	    pnbuf = pbuf;
+    if (isatty(1) && !f_format) {
+	printf("\033[1;4m%*s : %-*s : %-*s : %-*s : %-*s : %*s : %-*s",
+	       numlen, "#",
+	       cols.width[COL_VENDOR], "VENDOR",
+	       cols.width[COL_PRODUCT], "PRODUCT",
+	       cols.width[COL_REVISION], "REV.",
+	       cols.width[COL_IDENT], "IDENT",
+	       cols.width[COL_SIZE], "SIZE",
+	       cols.width[COL_NAMES], "NAMES");
+	if (f_phys) {
+	    printf(" : %-*s",
+		   cols.width[COL_PHYS], "PHYS");
+	}
+	if (f_bench_rand) {
+	    printf(" : %*s : %*s : %*s",
+		   cols.width[COL_P50], "P50",
+		   cols.width[COL_P99], "P99",
+		   cols.width[COL_P999], "P99.9");
+	}
+	if (f_catalog) {
+	    printf(" : %-*s",
+		   cols.width[COL_FW], "FW");
+	}
+	if (f_geom) {
+	    printf(" : %-*s : %-*s",
+		   cols.width[COL_MPATH], "MULTIPATH",
+		   cols.width[COL_LABELS], "LABELS");
+	    if (f_verbose)
+		printf(" : %-*s",
+		       cols.width[COL_PARTS], "PARTS");
+	}
+	if (f_zfs) {
+	    printf(" : %-*s",
+		   cols.width[COL_ZPOOL], "POOL");
+	    if (f_verbose)
+		printf(" : %-*s",
+		       cols.width[COL_ZGUID], "VDEV GUID");
 	}
+	if (f_verbose) {
+	    printf(" : %-*s : %-*s",
+		   cols.width[COL_DRIVER], "DRV.",
+		   cols.width[COL_PATH], "PATH");
+	}
+	puts("\033[0m");
+    }
 
-	dp->revision = strndup(((const char*)cdata.fr), NVME_FIRMWARE_REVISION_LENGTH);
-	dp->ident = ident;
-	dp->danames = strdup(daname);
-	dp->driver = strdup(driver);
-	dp->path = strdup(pnbuf);
-	dp->phys = NULL;
-	++dc;
-	return 1;
+    if (!f_format)
+	table_format(tmpl, sizeof(tmpl), &cols, numlen);
+    if (fmt_parse(&fmt, f_format ? f_format : tmpl, &err) < 0) {
+	fprintf(stderr, "drvlist: Error: %s: %s\n", f_format ? f_format : tmpl, err);
+	cols_free(&cols);
+	return 0;
     }
-    
-    strdupcat(&dp->danames, daname);
-    strdupcat(&dp->driver, driver);
-    strdupcat(&dp->path, pnbuf);
-    return 0;
-}
+    fmt_prepare(&fmt, &cols, numlen);
 
+    for (i = 0; i < dc; i++)
+	if (fmt_print(&fmt, &cols, cols.order[i], i+1) < 0)
+	    break;
 
-void
-p_strip(const char *s) {
-    while (*s) {
-	putchar(*s);
-	if (isspace(*s))
-	    while (isspace(*s))
-		++s;
-	else
-	    ++s;
-    }
+    fmt_free(&fmt);
+    cols_reorder(&cols, dv);
+    cols_free(&cols);
+    return dc + (isatty(1) && !f_format ? 1 : 0);
 }
 
-char *
-size2str(off_t size) {
-    char buf[256];
-    double ds = size;
-    
-    if (size < 2000) {
-	sprintf(buf, "%lu", size);
-	return strdup(buf);
-    }
 
-    ds /= 1000;
-    if (ds < 2000) {
-	sprintf(buf, "%.0fK", ds);
-	return strdup(buf);
-    }
-    
-    ds /= 1000;
-    if (ds < 2000) {
-	sprintf(buf, "%.0fM", ds);
-	return strdup(buf);
-    }
-    
-    ds /= 1000;
-    if (ds < 2000) {
-	sprintf(buf, "%.0fG", ds);
-	return strdup(buf);
-    }
-	
-    
-    ds /= 1000;
-    if (ds < 2000) {
-	sprintf(buf, "%.0fT", ds);
-	return strdup(buf);
-    }
-	
-    
-    ds /= 1000;
-    sprintf(buf, "%.0fP", ds);
-    return strdup(buf);
+static int
+str_same(const char *a,
+	 const char *b) {
+    return strcmp(a ? a : "", b ? b : "") == 0;
 }
 
+static int
+dv_cmp_ident(const void *a,
+	     const void *b) {
+    return strcmp(((const DISK *) a)->ident, ((const DISK *) b)->ident);
+}
 
-int
-do_device(char *daname) {
-    int fd, id, i;
-    char *ident = NULL;
-    struct cam_device *cam;
-    DISK *dp;
-    char path[2048];
-    char idbuf[DISK_IDENT_SIZE];
-    char pnbuf[MAXPATHLEN];
-    char drvbuf[MAXPATHLEN];
-    char physbuf[MAXPATHLEN];
-    off_t msize = 0;
+static void
+print_change(const char *field,
+	     const char *old,
+	     const char *new,
+	     int *np) {
+    if (str_same(old, new))
+	return;
+    printf("%s%s %s -> %s", (*np)++ ? ", " : " : ", field,
+	   old && *old ? old : "-", new && *new ? new : "-");
+}
 
-    
-    if (dc >= ds) {
-	dv = realloc(dv, (ds += 1024)*sizeof(DISK));
-	if (!dv)
-	    return -1;
+/*
+ * Print (or just count, if !f_print) the drives that were added,
+ * removed or changed between two tables. Both are sorted by ident.
+ */
+static int
+table_changes(DISK *ov,
+	      int oc,
+	      DISK *nv,
+	      int nc,
+	      int f_print) {
+    int i, j, k, n, nchg = 0;
+
+    qsort(ov, oc, sizeof(DISK), dv_cmp_ident);
+    qsort(nv, nc, sizeof(DISK), dv_cmp_ident);
+
+    for (i = j = 0; i < nc || j < oc; ) {
+	k = (i >= nc) ? 1 : (j >= oc) ? -1 : strcmp(nv[i].ident, ov[j].ident);
+	if (k < 0) {
+	    ++nchg;
+	    if (f_print)
+		printf("+ %s : %s %s : %s\n", nv[i].ident,
+		       *nv[i].vendor ? nv[i].vendor : "?", *nv[i].product ? nv[i].product : "?",
+		       nv[i].danames);
+	} else if (k > 0) {
+	    ++nchg;
+	    if (f_print)
+		printf("- %s : %s %s : %s\n", ov[j].ident,
+		       *ov[j].vendor ? ov[j].vendor : "?", *ov[j].product ? ov[j].product : "?",
+		       ov[j].danames);
+	} else if (!str_same(nv[i].danames, ov[j].danames) ||
+		   !str_same(nv[i].vendor, ov[j].vendor) ||
+		   !str_same(nv[i].product, ov[j].product) ||
+		   !str_same(nv[i].revision, ov[j].revision) ||
+		   !str_same(nv[i].size, ov[j].size) ||
+		   !str_same(nv[i].phys, ov[j].phys) ||
+		   !str_same(nv[i].driver, ov[j].driver) ||
+		   !str_same(nv[i].path, ov[j].path)) {
+	    ++nchg;
+	    if (f_print) {
+		n = 0;
+		printf("~ %s", nv[i].ident);
+		print_change("names", ov[j].danames, nv[i].danames, &n);
+		print_change("vendor", ov[j].vendor, nv[i].vendor, &n);
+		print_change("product", ov[j].product, nv[i].product, &n);
+		print_change("rev", ov[j].revision, nv[i].revision, &n);
+		print_change("size", ov[j].size, nv[i].size, &n);
+		print_change("phys", ov[j].phys, nv[i].phys, &n);
+		print_change("drv", ov[j].driver, nv[i].driver, &n);
+		print_change("path", ov[j].path, nv[i].path, &n);
+		putchar('\n');
+	    }
+	}
+	if (k <= 0)
+	    ++i;
+	if (k >= 0)
+	    ++j;
     }
 
-    if (strncmp(daname, "/dev/", 5) == 0) {
-	strcpy(path, daname);
-	daname = path+5;
-    } else {
-	strcpy(path, "/dev/");
-	strcpy(path+5, daname);
-    }
+    return nchg;
+}
 
-    if (1) {
-	int fd;
-	
-	fd = open(path, O_RDONLY);
-	if (fd >= 0 && ioctl(fd, DIOCGMEDIASIZE, &msize) >= 0) {
-	    if (f_debug)
-		fprintf(stderr, "*** path=%s msize=%s (%lu)\n", path, size2str(msize), msize);
-	}
-	close(fd);
-    }    
-    
-    cam = cam_open_device(path, O_RDWR);
-    if (cam) {
-	if (f_debug) {
-	    fprintf(stderr, "*** path=%s dev=%s%u pass=%s%u\n",
-		    path,
-		    cam->given_dev_name,
-		    cam->given_unit_number,
-		    cam->device_name,
-		    cam->dev_unit_num);
-	}
 
-	physbuf[0] = '\0';
-	if (f_phys) {
-	    int fd = open(path, O_RDONLY);
-	    
-	    if (fd >= 0) {
-		ioctl(fd, DIOCGPHYSPATH, physbuf);
-		close(fd);
-	    }
-	}
-	
-	ident = strndup((char *) &cam->serial_num[0], cam->serial_num_len);
-	if (!ident)
-	    return -1;
-	
-	for (i = 0; i < dc && strcmp(dv[i].ident, ident); i++)
-	    ;
-	dp = &dv[i];
-	
-	if (f_verbose > 1)
-	    sprintf(drvbuf, "%s%u @ bus %u",
-		    cam->sim_name, cam->sim_unit_number, cam->bus_id);
-	else
-	    sprintf(drvbuf, "%s%u",
-		    cam->sim_name, cam->sim_unit_number);
-	
-	sprintf(pnbuf, "scbus %2u target %3u lun %2jx",
-		cam->path_id,
-		cam->target_id,
-		cam->target_lun);
-	
-	if (sscanf(daname, "nda%u", &id) == 1) {
-	    sprintf(path+5, "nvme%d", id);
-	    
-	    fd = open(path, O_RDONLY);
-	    nvme_identify(fd, daname, drvbuf, pnbuf);
-	    free(ident);
-	    close(fd);
-	} else {
-	    if (sscanf(daname, "ada%u", &id) == 1) {
-		ata_identify(cam, &dp->vendor, &dp->product, &dp->revision);
-	    }
-	    if (i >= dc) {
-		char *cp;
-		dp->ident = ident;
-		
-		
-		if (!dp->vendor && cam->inq_data.vendor[0]) {
-		    dp->vendor = strndup(cam->inq_data.vendor, sizeof(cam->inq_data.vendor));
-		    strtrim(dp->vendor, NULL);
-		}
-		if (!dp->product && cam->inq_data.product[0]) {
-		    dp->product = strndup(cam->inq_data.product, sizeof(cam->inq_data.product));
-		    strtrim(dp->product, NULL);
-		}
+/*
+ * Print the table saved by the previous run at once, then rescan. On a
+ * terminal the table is redrawn if anything changed, else the changes
+ * are listed after it.
+ */
+static int
+cached(const char *argv0,
+       const DRVLIST_OPTS *opts,
+       char **devv,
+       int devc) {
+    DRVLIST *ctx;
+    DISK *ov = NULL, *dv;
+    char *obuf = NULL;
+    int oc, dc, lines = 0;
+
+
+    oc = drvlist_table_load(f_cached, &ov, &obuf);
+    if (oc >= 0) {
+	lines = print_table(ov, oc);
+	fflush(stdout);
+    }
 
-		if (!dp->revision && cam->inq_data.revision[0]) {
-		    dp->revision = strndup(cam->inq_data.revision, sizeof(cam->inq_data.revision));
-		    strtrim(dp->revision, NULL);
-		}
+    ctx = scan(argv0, opts, devv, devc);
+    dv = drvlist_disks(ctx, &dc);
 
-		if (dp->vendor && dp->product) {
-		    if ((strcmp(dp->vendor, "ATA") == 0 || strcmp(dp->vendor, "USB") == 0) &&
-			(cp = strchr(dp->product, ' ')) != NULL) {
-			if (cp[1] != '\0' && !isspace(cp[1])) {
-			    free(dp->vendor);
-			    *cp++ = '\0';
-			    dp->vendor = dp->product;
-			    dp->product = strdup(cp);
-			}
-		    }
-		    if ((strcmp(dp->vendor, "ATA") == 0 || strcmp(dp->vendor, "USB") == 0)) {
-			    /* Hack... */
-			if (strncmp(dp->product, "SSDSC", 5) == 0) {
-			    free(dp->vendor);
-			    dp->vendor = strdup("INTEL");
-			} else if (strncmp(dp->product, "MZ", 2) == 0) {
-			    free(dp->vendor);
-			    dp->vendor = strdup("SAMSUNG");
-			}
-		    }
-		}
-		
-		dp->danames = strdup(daname);
-		dp->phys = strdup(physbuf);
-		dp->driver = strdup(drvbuf);
-		dp->path = strdup(pnbuf);
-		dp->phys = strdup(physbuf);
-		if (msize > 0)
-		    dp->size = size2str(msize);
-		dc++;
-	    } else {
-		free(ident);
-		strdupcat(&dp->danames, daname);
-		strdupcat(&dp->path, pnbuf);
-		strdupcat(&dp->driver, drvbuf);
-	    }
+    if (drvlist_table_save(f_cached, dv, dc) < 0)
+	fprintf(stderr, "%s: Error: %s: Unable to save table: %s\n",
+		argv0, f_cached, strerror(errno));
+
+    if (oc < 0)
+	print_table(dv, dc);
+    else if (table_changes(ov, oc, dv, dc, 0) > 0) {
+	if (isatty(1)) {
+	    if (lines > 0)
+		printf("\033[%dA\033[J", lines);
+	    print_table(dv, dc);
+	} else {
+	    puts("Changed since the cached table:");
+	    table_changes(ov, oc, dv, dc, 1);
 	}
-	
-	cam_close_device(cam);
-	return 0;
     }
 
-    if (sscanf(daname, "nvd%d", &id) == 1)
-	sprintf(path+5, "nvme%d", id);
-    
-    
-    /* Non-CAM */
-    fd = open(path, O_RDONLY|O_DIRECT, 0);
-    if (fd < 0)
-	return -1;
-    
-    if (strncmp(daname, "nvd", 3) == 0) {
-	nvme_identify(fd, daname, path+5, NULL);
-	close(fd);
-	return 0;
-    }
+    free(ov);
+    free(obuf);
+    drvlist_destroy(ctx);
+    return 0;
+}
 
-    memset(idbuf, 0, sizeof(idbuf));
-    if (ioctl(fd, DIOCGIDENT, idbuf) >= 0)
-	ident = strndup(idbuf, sizeof(idbuf));
-    
-    if (!ident) {
-	close(fd);
-	return 1;
-    }
 
-    physbuf[0] = '\0';
-    if (f_phys)
-	(void) ioctl(fd, DIOCGPHYSPATH, physbuf);
-    
-    for (i = 0; i < dc && strcmp(dv[i].ident, ident); i++)
-	;
-    dp = &dv[i];
-    
-    if (i >= dc) {
-	dp->ident = ident;
-	dp->danames = strdup(daname);
-	dp->phys = strdup(physbuf);
-	if (msize > 0)
-	    dp->size = size2str(msize);
-	++dc;
-    } else {
-	free(ident);
-	strdupcat(&dp->danames, daname);
+static void
+get_intarg(const char *argv0,
+	   const char *opt,
+	   const char *val,
+	   int *vp) {
+    if (!val || sscanf(val, "%d", vp) != 1) {
+	fprintf(stderr, "%s: Error: --%s: Missing or invalid value\n", argv0, opt);
+	exit(1);
     }
-    
-    close(fd);
-    return 0;
 }
 
 
 int
 main(int argc,
      char *argv[]) {
-    char *daname;
-    char *buf, *bp;
-    size_t bsize = 0;
+    DRVLIST_OPTS opts;
+    DRVLIST *ctx = NULL;
+    DISK *dv;
+    int dc;
+    char *bp;
+    char *val;
+    FMT fmt;
+    const char *err;
     int i, j;
     int rc = 0;
-    int identlen = 7;
-    int vendorlen = 6;
-    int productlen = 7;
-    int revisionlen = 4;
-    int danameslen = 5;
-    int drvlen = 3;
-    int pathlen = 4;
-    int physlen = 4;
-    int numlen = 1;
-    int sizelen = 3;
-
-    dv = calloc((ds = 1024), sizeof(DISK));
-    if (!dv) {
-	fprintf(stderr, "%s: Error: calloc: %s\n",
-		argv[0], strerror(errno));
-	exit(1);
+
+    bp = strrchr(argv[0], '/');
+    if (strcmp(bp ? bp+1 : argv[0], "drvlist-merge") == 0)
+	return merge_main(argc, argv);
+    if (argc > 1 && strcmp(argv[1], "--merge") == 0) {
+	argv[1] = argv[0];
+	return merge_main(argc-1, argv+1);
     }
-    
+
     for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+	if (argv[i][1] == '-') {
+	    char *opt = argv[i]+2;
+
+	    if (!*opt) {
+		++i;
+		break;
+	    }
+
+	    val = strchr(opt, '=');
+	    if (val)
+		*val++ = '\0';
+
+	    if (strcmp(opt, "bench-rand") == 0) {
+		f_bench_rand++;
+		if (val)
+		    get_intarg(argv[0], opt, val, &f_bench_ios);
+	    } else if (strcmp(opt, "bench-qd") == 0)
+		get_intarg(argv[0], opt, val, &f_bench_qd);
+	    else if (strcmp(opt, "bench-jobs") == 0)
+		get_intarg(argv[0], opt, val, &f_bench_jobs);
+	    else if (strcmp(opt, "bench-hba") == 0) {
+		f_bench_hba++;
+		if (val)
+		    get_intarg(argv[0], opt, val, &f_bench_secs);
+	    } else if (strcmp(opt, "bench-step") == 0)
+		get_intarg(argv[0], opt, val, &f_bench_step);
+	    else if (strcmp(opt, "catalog") == 0) {
+		if (!val && i+1 < argc)
+		    val = argv[++i];
+		if (!val) {
+		    fprintf(stderr, "%s: Error: --%s: Missing catalog file\n",
+			    argv[0], opt);
+		    exit(1);
+		}
+		if (catalog_open(val) < 0) {
+		    fprintf(stderr, "%s: Error: --%s: %s: %s\n",
+			    argv[0], opt, val, strerror(errno));
+		    exit(1);
+		}
+		f_catalog++;
+	    } else if (strcmp(opt, "history") == 0) {
+		if (!val && i+1 < argc)
+		    val = argv[++i];
+		if (!val) {
+		    fprintf(stderr, "%s: Error: --%s: Missing serial number\n",
+			    argv[0], opt);
+		    exit(1);
+		}
+		f_history = val;
+	    } else if (strcmp(opt, "history-dir") == 0) {
+		if (!val && i+1 < argc)
+		    val = argv[++i];
+		if (!val) {
+		    fprintf(stderr, "%s: Error: --%s: Missing directory\n",
+			    argv[0], opt);
+		    exit(1);
+		}
+		f_history_dir = val;
+	    } else if (strcmp(opt, "publish") == 0) {
+		f_publish = val ? val : DRVLIST_SHM_NAME;
+	    } else if (strcmp(opt, "publish-interval") == 0) {
+		get_intarg(argv[0], opt, val, &f_publish_secs);
+	    } else if (strcmp(opt, "dump") == 0) {
+		if (!val && i+1 < argc)
+		    val = argv[++i];
+		if (!val) {
+		    fprintf(stderr, "%s: Error: --%s: Missing file\n",
+			    argv[0], opt);
+		    exit(1);
+		}
+		f_dump = val;
+	    } else if (strcmp(opt, "load") == 0) {
+		if (!val && i+1 < argc)
+		    val = argv[++i];
+		if (!val) {
+		    fprintf(stderr, "%s: Error: --%s: Missing file\n",
+			    argv[0], opt);
+		    exit(1);
+		}
+		f_load = val;
+	    } else if (strcmp(opt, "published") == 0) {
+		f_published = val ? val : DRVLIST_SHM_NAME;
+	    } else if (strcmp(opt, "negcache") == 0) {
+		f_negcache = val ? val : "/var/db/drvlist/negcache";
+	    } else if (strcmp(opt, "forget") == 0) {
+		f_forget++;
+		f_forget_dev = val;
+	    } else if (strcmp(opt, "cached") == 0) {
+		f_cached = val ? val : "/var/db/drvlist/table.cache";
+	    } else if (strcmp(opt, "record") == 0) {
+		f_record++;
+		f_phys++;
+	    } else if (strcmp(opt, "lookup") == 0) {
+		f_lookup++;
+		f_phys++;
+	    } else if (strcmp(opt, "vendor-rules") == 0) {
+		if (!val && i+1 < argc)
+		    val = argv[++i];
+		if (!val || drvlist_vendor_rules_load(val) < 0) {
+		    fprintf(stderr, "%s: Error: --%s: %s: Unable to load rules: %s\n",
+			    argv[0], opt, val ? val : "", val ? strerror(errno) : "Missing file");
+		    exit(1);
+		}
+	    } else if (strcmp(opt, "topology") == 0) {
+		if (!val || strcmp(val, "text") == 0)
+		    f_topology = 1;
+		else if (strcmp(val, "dot") == 0)
+		    f_topology = 2;
+		else {
+		    fprintf(stderr, "%s: Error: --%s: %s: Invalid format\n",
+			    argv[0], opt, val);
+		    exit(1);
+		}
+	    } else if (strcmp(opt, "summary") == 0) {
+		f_summary = 1;
+	    }
+	    else {
+		fprintf(stderr, "%s: Error: --%s: Invalid switch\n",
+			argv[0], opt);
+		exit(1);
+	    }
+	    continue;
+	}
+
 	for (j = 1; argv[i][j]; j++)
 	    switch (argv[i][j]) {
 	    case 'h':
-		printf("Usage: %s [-v] [-p] [-S<sort>] [-W<maxwidth>] [<devices>]\n", argv[0]);
+		printf("Usage: %s [-v] [-p] [-S<sort>] [-W<maxwidth>] [-f<format>] [-o sqlite|arrow:<file>] [-I<serial>[,<serial>]|@<file>] [-z] [-g] [<options>] [<devices>]\n", argv[0]);
+		puts("  -f<format>              Row template, e.g. '{ident}\\t{names}\\t{size:>8}'");
+		puts("  -o sqlite:<file>        Upsert drives and paths into an SQLite database");
+		puts("  -o arrow:<file>         Write the drives as an Arrow IPC stream ('-' = stdout)");
+		puts("Options:");
+		puts("  --bench-rand[=<reads>]  Measure 4K random read latency (p50/p99/p99.9)");
+		puts("  --bench-qd=<depth>      Outstanding reads per drive [4]");
+		puts("  --bench-jobs=<drives>   Drives benchmarked at the same time [16]");
+		puts("  --bench-hba[=<secs>]    Ramp concurrent reads per controller, find the knee [5]");
+		puts("  --bench-step=<drives>   Drives added per ramp step [1]");
+		puts("  --topology[=text|dot]   Show how drive paths spread over controllers");
+		puts("  --summary               Drive counts and capacity per model, controller and media type");
+		puts("  --catalog=<file>        Check firmware against a vendor/product catalog");
+		puts("  --vendor-rules=<file>   Extra product prefix -> vendor rules");
+		puts("  --lookup                Map serial numbers read from stdin to drives");
+		puts("  --merge [-j<jobs>] [-T<tmpdir>] [<files>]  Merge output files from many hosts (drvlist-merge)");
+		puts("  --publish[=<name>]      Publish the drive table in shared memory [/drvlist]");
+		puts("  --publish-interval=<s>  Keep rescanning, republish when something changed");
+		puts("  --published[=<name>]    Show the table published in shared memory");
+		puts("  --negcache[=<file>]     Back off from devices that failed or were slow [/var/db/drvlist/negcache]");
+		puts("  --forget[=<device>]     Clear negative cache entries (all or one device)");
+		puts("  --cached[=<file>]       Show the last table at once, then rescan and show changes");
+		puts("  --dump=<file>           Save the drives in a compact inventory dump file");
+		puts("  --load=<file>           Show the drives from a dump file instead of scanning");
+		puts("  --record                Append changes since the last snapshot to the history");
+		puts("  --history=<serial>      Show when and where a drive has been seen");
+		puts("  --history-dir=<dir>     History store location [/var/db/drvlist]");
 		exit(0);
 	    case 'S':
 		if (argv[i][j+1])
@@ -698,6 +735,59 @@ main(int argc,
 		    exit(1);
 		}
 		goto NextArg;
+	    case 'f':
+		if (argv[i][j+1])
+		    val = argv[i]+j+1;
+		else if (i+1 < argc)
+		    val = argv[++i];
+		else {
+		    fprintf(stderr, "%s: Error: Missing value for -f\n", argv[0]);
+		    exit(1);
+		}
+		if (fmt_parse(&fmt, val, &err) < 0) {
+		    fprintf(stderr, "%s: Error: -f %s: %s\n", argv[0], val, err);
+		    exit(1);
+		}
+		fmt_free(&fmt);
+		f_format = val;
+		goto NextArg;
+	    case 'o':
+		if (argv[i][j+1])
+		    val = argv[i]+j+1;
+		else if (i+1 < argc)
+		    val = argv[++i];
+		else {
+		    fprintf(stderr, "%s: Error: Missing value for -o\n", argv[0]);
+		    exit(1);
+		}
+		if (strncmp(val, "sqlite:", 7) == 0 && val[7]) {
+#if HAVE_SQLITE3
+		    f_sqlite = val+7;
+#else
+		    fprintf(stderr, "%s: Error: -o %s: Built without SQLite support\n", argv[0], val);
+		    exit(1);
+#endif
+		} else if (strncmp(val, "arrow:", 6) == 0 && val[6])
+		    f_arrow = val+6;
+		else {
+		    fprintf(stderr, "%s: Error: -o %s: Invalid output (sqlite:<file> or arrow:<file>)\n", argv[0], val);
+		    exit(1);
+		}
+		goto NextArg;
+	    case 'I':
+		if (argv[i][j+1])
+		    val = argv[i]+j+1;
+		else if (i+1 < argc)
+		    val = argv[++i];
+		else {
+		    fprintf(stderr, "%s: Error: Missing value for -I\n", argv[0]);
+		    exit(1);
+		}
+		if (lookup_add(val) < 0) {
+		    fprintf(stderr, "%s: Error: -I %s: %s\n", argv[0], val, strerror(errno));
+		    exit(1);
+		}
+		goto NextArg;
 	    case 'W':
 		if (argv[i][j+1] && sscanf(argv[i]+j+1, "%d", &f_maxwidth) != 1) {
 		    if (argv[i+1][0] && argv[i+1][0] != '-' && sscanf(argv[i+1], "%d", &f_maxwidth) != 1) {
@@ -714,6 +804,12 @@ main(int argc,
 	    case 'p':
 		f_phys++;
 		break;
+	    case 'z':
+		f_zfs++;
+		break;
+	    case 'g':
+		f_geom++;
+		break;
 	    case 'd':
 		f_debug++;
 		break;
@@ -725,114 +821,163 @@ main(int argc,
     NextArg:;
     }
 
-    if (i >= argc) {
-	if (sysctlbyname("kern.disks", NULL, &bsize, NULL, 0) < 0) {
-	    fprintf(stderr, "%s: Error: Unable to list of drives from kernel: %s\n",
-		    argv[0], strerror(errno));
+    if (f_history) {
+	rc = history_query(f_history, stdout);
+	if (rc < 0) {
+	    fprintf(stderr, "%s: Error: %s: Unable to read history: %s\n",
+		    argv[0], f_history_dir, strerror(errno));
+	    exit(1);
+	} else if (rc > 0) {
+	    fprintf(stderr, "%s: Error: %s: Not found in history\n",
+		    argv[0], f_history);
 	    exit(1);
 	}
+	exit(0);
+    }
+
+    if (f_record && (i < argc || lookup_active())) {
+	fprintf(stderr, "%s: Error: --record needs the full drive list (no devices or -I)\n",
+		argv[0]);
+	exit(1);
+    }
+
+    if (f_forget && !f_negcache)
+	f_negcache = "/var/db/drvlist/negcache";
 
-	buf = malloc(bsize);
-	if (!buf) {
-	    fprintf(stderr, "%s: Error: %lu: Memory allocation failure: %s\n",
-		    argv[0], bsize, strerror(errno));
+    if (f_negcache) {
+	if (negcache_load(f_negcache) < 0) {
+	    fprintf(stderr, "%s: Error: %s: Unable to load negative cache: %s\n",
+		    argv[0], f_negcache, strerror(errno));
 	    exit(1);
 	}
+	if (f_forget && negcache_forget(f_forget_dev) > 0)
+	    fprintf(stderr, "%s: Error: %s: Not in negative cache\n",
+		    argv[0], f_forget_dev);
+    }
 
-	if (sysctlbyname("kern.disks", buf, &bsize, NULL, 0) < 0) {
-	    fprintf(stderr, "%s: Error: Unable to get list of drives from kernel: %s\n",
-		    argv[0], strerror(errno));
+    if (f_geom && geom_load() < 0) {
+	fprintf(stderr, "%s: Error: Unable to get GEOM configuration from kernel: %s\n",
+		argv[0], strerror(errno));
+	exit(1);
+    }
+
+    memset(&opts, 0, sizeof(opts));
+    opts.verbose = f_verbose;
+    opts.debug = f_debug;
+    opts.phys = f_phys;
+    if (lookup_active()) {
+	opts.want = cli_want;
+	opts.done = cli_done;
+    }
+    if (f_geom)
+	opts.mediasize = cli_mediasize;
+    opts.skipped = cli_skipped;
+    if (f_debug)
+	opts.event = cli_event;
+    if (f_negcache) {
+	opts.probe = cli_probe;
+	opts.result = cli_result;
+    }
+    opts.arg = argv[0];
+
+    if (f_publish)
+	return publish(argv[0], &opts, argv+i, argc-i);
+
+    if (f_cached) {
+	if (f_bench_rand || f_bench_hba || f_topology || f_summary || f_sqlite || f_arrow || f_catalog || f_geom || f_zfs ||
+	    f_lookup || lookup_active() || f_record || f_published || f_dump || f_load) {
+	    fprintf(stderr, "%s: Error: --cached only works with the plain table (-v, -p)\n",
+		    argv[0]);
 	    exit(1);
 	}
+	return cached(argv[0], &opts, argv+i, argc-i);
+    }
 
-	bp = buf;
-	while ((daname = strsep(&bp, " ")) != NULL) {
-	    rc = do_device(daname);
-	    if (rc < 0) {
-		fprintf(stderr, "%s: Error: %s: Unable to access: %s\n", argv[0], daname, strerror(errno));
-		exit(1);
-	    } else if (rc > 0) {
-		fprintf(stderr, "%s: Error: %s: Skipped\n", argv[0], daname);
-	    }
+    if (f_published) {
+	DRVLIST_SHM *sp = drvlist_shm_open(f_published);
+
+	if (!sp || drvlist_shm_read(sp, &dv, &dc) < 0) {
+	    fprintf(stderr, "%s: Error: %s: Unable to read published drives: %s\n",
+		    argv[0], f_published, strerror(errno));
+	    exit(1);
 	}
 
-	free(buf);
-    } else {
-	for (; i < argc; i++) {
-	    rc = do_device(argv[i]);
-	    if (rc < 0) {
-		fprintf(stderr, "%s: Error: %s: Unable to access: %s\n",
-			argv[0], argv[i], strerror(errno));
-		exit(1);
-	    } else if (rc > 0) {
-		fprintf(stderr, "%s: Error: %s: Skipped\n",
-			argv[0], argv[i]);
-	    }
+	/* The handle owns the drives, so they can be filtered in place */
+	if (lookup_active()) {
+	    for (j = i = 0; i < dc; i++)
+		if (lookup_want(dv[i].ident, dv[i].identlen))
+		    dv[j++] = dv[i];
+	    dc = j;
 	}
+    } else if (f_load) {
+	dc = load_dump(argv[0], f_load, &dv);
+    } else {
+	ctx = scan(argv[0], &opts, argv+i, argc-i);
+	dv = drvlist_disks(ctx, &dc);
     }
     
-    if (!dc)
-	return 0;
-    
-    for (i = 0; i < dc; i++) {
-	strntrim(dv[i].ident, &identlen, f_maxwidth);
-	strntrim(dv[i].vendor, &vendorlen, f_maxwidth);
-	strntrim(dv[i].product, &productlen, f_maxwidth);
-	strntrim(dv[i].revision, &revisionlen, f_maxwidth);
-	strntrim(dv[i].danames, &danameslen, f_maxwidth);
-	strntrim(dv[i].driver, &drvlen, f_maxwidth);
-	strntrim(dv[i].path, &pathlen, f_maxwidth);
-	strntrim(dv[i].phys, &physlen, f_maxwidth);
-	strntrim(dv[i].size, &sizelen, f_maxwidth);
-    }
+    if (f_lookup)
+	return lookup_batch(stdin, stdout, dv, dc) == 0 ? 0 : 1;
 
-    numlen = (int) (log10(dc)+1);
-    qsort(&dv[0], dc, sizeof(dv[0]), dv_sort);
+    if (lookup_active() && lookup_missing(argv[0]) > 0)
+	rc = 1;
 
-    if (isatty(1)) {
-	printf("\033[1;4m%*s : %-*s : %-*s : %-*s : %-*s : %*s : %-*s",
-	       numlen, "#",
-	       vendorlen, "VENDOR",
-	       productlen, "PRODUCT",
-	       revisionlen, "REV.",
-	       identlen, "IDENT",
-	       sizelen, "SIZE",
-	       danameslen, "NAMES");
-	if (f_phys) {
-	    printf(" : %-*s",
-		   physlen, "PHYS");
-	}
-	if (f_verbose) {
-	    printf(" : %-*s : %-*s",
-		   drvlen, "DRV.",
-		   pathlen, "PATH");
+    if (f_dump) {
+	if (drvlist_dump_save(f_dump, dv, dc) < 0) {
+	    fprintf(stderr, "%s: Error: %s: Unable to save dump: %s\n",
+		    argv[0], f_dump, strerror(errno));
+	    exit(1);
 	}
-	puts("\033[0m");
+	return rc;
     }
 
-    for (i = 0; i < dc; i++) {
-	printf("%*u : %-*s : %-*s : %-*s : %-*s : %*s : %-*s",
-	       numlen, i+1,
-	       vendorlen, dv[i].vendor ? dv[i].vendor : "?",
-	       productlen, dv[i].product ? dv[i].product : "?",
-	       revisionlen, dv[i].revision ? dv[i].revision : "?",
-	       identlen, dv[i].ident,
-	       sizelen, dv[i].size ? dv[i].size : "?",
-	       danameslen, dv[i].danames);
-	if (f_phys) {
-	    printf(" : %.*s",
-		   physlen, dv[i].phys ? dv[i].phys : "");
-	}
-	if (f_verbose) {
-	    printf(" : %-*s : ",
-		   drvlen, dv[i].driver);
-	    if (dv[i].path)
-		p_strip(dv[i].path);
-	    else
-		putchar('-');
-	}
-	putchar('\n');
+    /* Before the empty table check: every drive gone is worth recording */
+    if (f_record && history_record(dv, dc) < 0) {
+	fprintf(stderr, "%s: Error: %s: Unable to record snapshot: %s\n",
+		argv[0], f_history_dir, strerror(errno));
+	exit(1);
+    }
+
+    if (!dc)
+	return rc;
+
+    if (f_topology)
+	return topology(dv, dc, f_topology > 1) < 0 ? 1 : 0;
+
+    if (f_summary)
+	return summary(dv, dc, !f_published && !f_load) < 0 ? 1 : 0;
+
+    if (f_bench_hba)
+	return bench_hba(dv, dc) < 0 ? 1 : 0;
+
+    if (f_bench_rand)
+	bench_rand(dv, dc);
+
+    if (f_geom)
+	geom_annotate(dv, dc);
+
+    if (f_zfs)
+	zfs_labels(dv, dc);
+
+    if (f_catalog) {
+	for (i = 0; i < dc && catalog_check(&dv[i]) >= 0; i++)
+	    ;
+	if (i < dc)
+	    exit(1);
     }
 
+    if (f_sqlite || f_arrow) {
+	if (f_sqlite && sqlite_export(f_sqlite, dv, dc) < 0)
+	    rc = 1;
+	if (f_arrow && arrow_export(f_arrow, dv, dc) < 0)
+	    rc = 1;
+	return rc;
+    }
+    
+    print_table(dv, dc);
+
+    if (f_catalog)
+	catalog_summary(dv, dc);
+
     return rc;
 }
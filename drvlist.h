@@ -0,0 +1,283 @@
+/*
+ * drvlist.h
+ *
+ * Shared definitions for the drvlist utility.
+ *
+ * Copyright (c) 2024 Peter Eriksson <pen@lysator.liu.se>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef DRVLIST_H
+#define DRVLIST_H 1
+
+#include <stdio.h>
+#include <sys/types.h>
+
+#include "libdrvlist.h"
+
+
+extern int f_verbose;
+extern int f_debug;
+extern int f_phys;
+
+
+/* arrow.c */
+extern int
+arrow_export(const char *file,
+	     const DISK *dv,
+	     int dc);
+
+
+/* bench.c */
+extern int f_bench_qd;
+extern int f_bench_ios;
+extern int f_bench_jobs;
+extern int f_bench_secs;
+extern int f_bench_step;
+
+extern int
+bench_rand(DISK *dv,
+	   int dc);
+
+extern int
+bench_hba(DISK *dv,
+	  int dc);
+
+
+/* catalog.c */
+extern int
+catalog_open(const char *path);
+
+extern int
+catalog_check(DISK *dp);
+
+extern void
+catalog_summary(const DISK *dv,
+		int dc);
+
+
+/* lookup.c */
+extern int
+lookup_add(const char *arg);
+
+extern int
+lookup_active(void);
+
+extern int
+lookup_want(const char *serial,
+	    size_t len);
+
+extern const char *
+lookup_serial(int i);
+
+extern int
+lookup_done(void);
+
+extern int
+lookup_missing(const char *argv0);
+
+extern int
+lookup_batch(FILE *in,
+	     FILE *out,
+	     const DISK *dv,
+	     int dc);
+
+
+/* zfs.c */
+extern int f_zfs_jobs;
+
+extern int
+zfs_labels(DISK *dv,
+	   int dc);
+
+
+/* columns.c */
+#define COL_IDENT     0
+#define COL_VENDOR    1
+#define COL_PRODUCT   2
+#define COL_REVISION  3
+#define COL_NAMES     4
+#define COL_DRIVER    5
+#define COL_PATH      6
+#define COL_PHYS      7
+#define COL_SIZE      8
+#define COL_P50       9
+#define COL_P99       10
+#define COL_P999      11
+#define COL_FW        12
+#define COL_ZPOOL     13
+#define COL_ZGUID     14
+#define COL_MPATH     15
+#define COL_LABELS    16
+#define COL_PARTS     17
+#define COL_MAX       18
+
+/* The drive table as one array per field */
+typedef struct {
+    int n;
+    int maxwidth;		/* Longer values are cut and end in "..", 0 = no limit */
+    const char **str[COL_MAX];	/* Values, leading whitespace skipped */
+    u_short *len[COL_MAX];	/* Value lengths, trailing whitespace excluded */
+    int width[COL_MAX];
+    int *order;			/* Rows in print order */
+} COLS;
+
+extern int
+cols_build(COLS *cp,
+	   const DISK *dv,
+	   int dc,
+	   int maxwidth);
+
+extern void
+cols_free(COLS *cp);
+
+extern int
+cols_sort(COLS *cp,
+	  const char *key);
+
+extern void
+cols_reorder(COLS *cp,
+	     DISK *dv);
+
+
+/* format.c */
+typedef struct {
+    int col;			/* COL_*, or literal text if < 0 */
+    int right;			/* Align right */
+    int width;			/* Pad to this width, -1 = widest value */
+    int max;			/* Cut longer values, 0 = no limit */
+    const char *text;		/* Literal text */
+    int len;
+} FMTOP;
+
+typedef struct {
+    FMTOP *ov;
+    int oc;
+    char *text;			/* Unescaped literal text */
+    char *buf;			/* Current row */
+    size_t size;
+    size_t len;
+} FMT;
+
+extern int
+fmt_parse(FMT *fp,
+	  const char *tmpl,
+	  const char **errp);
+
+extern void
+fmt_free(FMT *fp);
+
+extern void
+fmt_prepare(FMT *fp,
+	    const COLS *cp,
+	    int numlen);
+
+extern int
+fmt_print(FMT *fp,
+	  const COLS *cp,
+	  int r,
+	  int num);
+
+
+/* geom.c */
+extern int
+geom_parse(const char *buf,
+	   size_t len);
+
+extern int
+geom_load(void);
+
+extern int
+geom_mediasize(const char *name,
+	       off_t *msize);
+
+extern int
+geom_annotate(DISK *dv,
+	      int dc);
+
+
+/* history.c */
+extern char *f_history_dir;
+
+extern int
+history_record(const DISK *dv,
+	       int dc);
+
+extern int
+history_query(const char *serial,
+	      FILE *out);
+
+
+/* merge.c */
+extern int
+merge_main(int argc,
+	   char *argv[]);
+
+
+/* negcache.c */
+extern int
+negcache_load(const char *path);
+
+extern int
+negcache_save(void);
+
+extern int
+negcache_forget(const char *name);
+
+extern int
+negcache_probe(const char *name);
+
+extern void
+negcache_result(const char *name,
+		int rc,
+		const char *stage,
+		int err);
+
+
+/* sqlite.c */
+extern int
+sqlite_export(const char *file,
+	      const DISK *dv,
+	      int dc);
+
+
+/* summary.c */
+extern int
+summary(const DISK *dv,
+	int dc,
+	int local);
+
+
+/* topo.c */
+extern int
+topology(const DISK *dv,
+	 int dc,
+	 int f_dot);
+
+#endif
@@ -0,0 +1,969 @@
+/*
+ * dump.c
+ *
+ * Compact inventory dump files for libdrvlist.
+ *
+ * Copyright (c) 2024 Peter Eriksson <pen@lysator.liu.se>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * A dump holds the same fields as a table (table.c), but every string
+ * column is stored once as a sorted, front coded string table and the
+ * drives refer to its strings by index:
+ *
+ *   header    magic "DRVDUMP1", number of drives, of (size, sector
+ *             size) pairs and the record size, the record and size
+ *             offsets and for each string column the number of
+ *             strings, of blocks and the column offset.
+ *
+ *   columns   ident, danames, vendor, product, revision, driver, path
+ *             and phys. Each is an array of block offsets followed by
+ *             blocks of DUMP_BLOCK strings. The first string of a block
+ *             is stored whole, the others as the length of the prefix
+ *             shared with the previous string plus the rest (lengths
+ *             are varints). Any string can be decoded from the start
+ *             of its block.
+ *
+ *             danames, driver and path hold ','-separated lists, one
+ *             element per path, which share little as whole strings
+ *             ("da1,da201" after "da0,da200"). Their strings are stored
+ *             as the number of elements and then each element front
+ *             coded against the same element of the previous string
+ *             (or its last one, if it has fewer).
+ *
+ *   sizes     Distinct (uint64 size, uint32 sector size) pairs.
+ *
+ *   records   One per drive, sorted by ident: the index + 1 (0 = none)
+ *             of each string except ident, then the size pair index.
+ *             Each index is as many bytes as its column needs.
+ *
+ * The ident column has one string per drive, in record order, so the
+ * ident of record i is string i and a drive is found by a binary
+ * search over the first strings of the ident blocks. Numbers are
+ * little endian.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "libdrvlist.h"
+
+
+#define DUMP_MAGIC    "DRVDUMP1"
+#define DUMP_BLOCK    16	/* Strings per front coded block */
+#define DUMP_NSTR     8		/* String columns */
+#define DUMP_HDRSIZE  (40 + DUMP_NSTR*16)
+#define DUMP_PAIRSIZE 12	/* uint64 size + uint32 sector size */
+
+#define DC_IDENT      0
+#define DC_DANAMES    1
+#define DC_DRIVER     5
+#define DC_PATH       6
+
+/* Columns of ','-separated lists, front coded per element */
+#define DC_LIST(c)    ((c) == DC_DANAMES || (c) == DC_DRIVER || (c) == DC_PATH)
+
+
+typedef struct {
+    uint8_t *p;
+    size_t len;
+    size_t size;
+} DBUF;
+
+typedef struct {
+    uint32_t n;			/* Strings */
+    uint32_t nb;		/* Blocks */
+    const uint8_t *boff;	/* Block offsets, nb+1 */
+    const uint8_t *data;
+    uint32_t dlen;
+    int width;			/* Bytes per index in the records */
+} DCOL;
+
+struct drvlist_dump {
+    uint8_t *buf;
+    size_t size;
+    uint32_t nrec;
+    uint32_t nsizes;
+    uint32_t recsize;
+    const uint8_t *rec;
+    const uint8_t *sizes;
+    int swidth;
+    DCOL col[DUMP_NSTR];
+
+    char *str;			/* Last decoded string, in sbuf */
+    DBUF sbuf;			/* Strings of the block being decoded */
+
+    char **keep;		/* Strings handed out, freed on close */
+    int nkeep;
+    int skeep;
+
+    DISK *dv;
+};
+
+
+static uint64_t
+le_get(const uint8_t *p,
+       int n) {
+    uint64_t v = 0;
+
+    while (n-- > 0)
+	v = (v << 8) | p[n];
+    return v;
+}
+
+static int
+dbuf_grow(DBUF *bp,
+	  size_t n) {
+    if (bp->len+n > bp->size) {
+	size_t nsize = bp->size ? bp->size*2 : 65536;
+	uint8_t *np;
+
+	while (nsize < bp->len+n)
+	    nsize *= 2;
+	np = realloc(bp->p, nsize);
+	if (!np)
+	    return -1;
+	bp->p = np;
+	bp->size = nsize;
+    }
+    return 0;
+}
+
+static int
+dbuf_put(DBUF *bp,
+	 const void *p,
+	 size_t n) {
+    if (dbuf_grow(bp, n) < 0)
+	return -1;
+    memcpy(bp->p+bp->len, p, n);
+    bp->len += n;
+    return 0;
+}
+
+static void
+le_set(uint8_t *p,
+       uint64_t v,
+       int n) {
+    int i;
+
+    for (i = 0; i < n; i++)
+	p[i] = (uint8_t) (v >> (8*i));
+}
+
+static int
+dbuf_le(DBUF *bp,
+	uint64_t v,
+	int n) {
+    if (dbuf_grow(bp, n) < 0)
+	return -1;
+    le_set(bp->p+bp->len, v, n);
+    bp->len += n;
+    return 0;
+}
+
+static int
+dbuf_varint(DBUF *bp,
+	    uint32_t v) {
+    uint8_t b[5];
+    int n = 0;
+
+    while (v >= 0x80) {
+	b[n++] = (v & 0x7f) | 0x80;
+	v >>= 7;
+    }
+    b[n++] = v;
+    return dbuf_put(bp, b, n);
+}
+
+static int
+get_varint(const uint8_t **pp,
+	   const uint8_t *end,
+	   uint32_t *vp) {
+    const uint8_t *p = *pp;
+    uint32_t v = 0;
+    int shift;
+
+    for (shift = 0; p < end && shift < 35; shift += 7) {
+	v |= (uint32_t) (*p & 0x7f) << shift;
+	if (!(*p++ & 0x80)) {
+	    *pp = p;
+	    *vp = v;
+	    return 0;
+	}
+    }
+    return -1;
+}
+
+
+/* Bytes needed for indexes up to n */
+static int
+id_width(uint32_t n) {
+    return n < 0x100 ? 1 : n < 0x10000 ? 2 : n < 0x1000000 ? 3 : 4;
+}
+
+/* String column c of a drive, "" if unknown */
+static const char *
+dump_str(const DISK *dp,
+	 int c) {
+    const char *s = NULL;
+
+    switch (c) {
+    case 0:
+	s = dp->ident;
+	break;
+    case 1:
+	s = dp->danames;
+	break;
+    case 2:
+	s = dp->vendor;
+	break;
+    case 3:
+	s = dp->product;
+	break;
+    case 4:
+	s = dp->revision;
+	break;
+    case 5:
+	s = dp->driver;
+	break;
+    case 6:
+	s = dp->path;
+	break;
+    case 7:
+	s = dp->phys;
+	break;
+    }
+    return s ? s : "";
+}
+
+
+static int
+str_cmp(const void *a,
+	const void *b) {
+    return strcmp(*(const char **) a, *(const char **) b);
+}
+
+static const DISK *dump_sort_dv;
+
+static int
+rec_cmp(const void *a,
+	const void *b) {
+    int ia = *(const int *) a, ib = *(const int *) b;
+    int d = strcmp(dump_sort_dv[ia].ident, dump_sort_dv[ib].ident);
+
+    return d ? d : ia - ib;
+}
+
+static int
+pair_cmp(const void *a,
+	 const void *b) {
+    const uint64_t *pa = (const uint64_t *) a, *pb = (const uint64_t *) b;
+
+    if (pa[0] != pb[0])
+	return pa[0] < pb[0] ? -1 : 1;
+    if (pa[1] != pb[1])
+	return pa[1] < pb[1] ? -1 : 1;
+    return 0;
+}
+
+
+/* Length of the prefix shared by s (len bytes) and p (plen bytes) */
+static uint32_t
+prefix_len(const char *s,
+	   uint32_t len,
+	   const char *p,
+	   uint32_t plen) {
+    uint32_t i;
+
+    for (i = 0; i < len && i < plen && s[i] == p[i]; i++)
+	;
+    return i;
+}
+
+/*
+ * Write a list string element by element, each front coded against
+ * the same element of prev (or its last one), unless first in block
+ */
+static int
+put_list(DBUF *bp,
+	 const char *s,
+	 const char *prev) {
+    const char *e, *pe;
+    uint32_t m, len, plen;
+
+
+    for (m = 1, e = s; (e = strchr(e, ',')) != NULL; e++)
+	m++;
+    if (dbuf_varint(bp, m) < 0)
+	return -1;
+
+    for (;;) {
+	len = strcspn(s, ",");
+	if (prev) {
+	    pe = prev + strcspn(prev, ",");
+	    plen = prefix_len(s, len, prev, pe-prev);
+	    if (dbuf_varint(bp, plen) < 0)
+		return -1;
+	    if (*pe)
+		prev = pe+1;
+	} else
+	    plen = 0;
+	if (dbuf_varint(bp, len-plen) < 0 ||
+	    dbuf_put(bp, s+plen, len-plen) < 0)
+	    return -1;
+	if (!s[len])
+	    return 0;
+	s += len+1;
+    }
+}
+
+/* Write string column c, front coded in blocks */
+static int
+put_column(DBUF *bp,
+	   int c,
+	   const char **sv,
+	   uint32_t n) {
+    uint8_t *hp = bp->p + 40 + 16*c;
+    uint32_t nb = (n + DUMP_BLOCK-1) / DUMP_BLOCK, i, len, plen;
+    size_t boff, data;
+
+
+    le_set(hp, n, 4);
+    le_set(hp+4, nb, 4);
+    le_set(hp+8, bp->len, 8);
+
+    boff = bp->len;
+    if (dbuf_grow(bp, 4*(nb+1)) < 0)
+	return -1;
+    bp->len += 4*(nb+1);
+    data = bp->len;
+
+    for (i = 0; i < n; i++) {
+	if (i % DUMP_BLOCK == 0)
+	    le_set(bp->p + boff + 4*(i/DUMP_BLOCK), bp->len - data, 4);
+	if (DC_LIST(c)) {
+	    if (put_list(bp, sv[i], i % DUMP_BLOCK ? sv[i-1] : NULL) < 0)
+		return -1;
+	    continue;
+	}
+
+	len = strlen(sv[i]);
+	if (i % DUMP_BLOCK == 0)
+	    plen = 0;
+	else {
+	    for (plen = 0; plen < len && sv[i][plen] == sv[i-1][plen]; plen++)
+		;
+	    if (dbuf_varint(bp, plen) < 0)
+		return -1;
+	}
+	if (dbuf_varint(bp, len-plen) < 0 ||
+	    dbuf_put(bp, sv[i]+plen, len-plen) < 0)
+	    return -1;
+    }
+    le_set(bp->p + boff + 4*nb, bp->len - data, 4);
+    return 0;
+}
+
+
+int
+drvlist_dump_save(const char *path,
+		  const DISK *dv,
+		  int dc) {
+    DBUF b = { NULL, 0, 0 };
+    const char **sv[DUMP_NSTR];
+    uint32_t nv[DUMP_NSTR];
+    uint64_t *pv = NULL;
+    uint32_t np = 0;
+    int *order = NULL;
+    int width[DUMP_NSTR], swidth, recsize;
+    char tmp[1024];
+    ssize_t n;
+    int c, i, j, fd, rc = -1;
+
+
+    memset(sv, 0, sizeof(sv));
+    order = malloc((dc+1)*sizeof(int));
+    pv = malloc((dc+1)*2*sizeof(uint64_t));
+    if (!order || !pv)
+	goto End;
+
+    /* Records in ident order */
+    for (i = 0; i < dc; i++)
+	order[i] = i;
+    dump_sort_dv = dv;
+    qsort(order, dc, sizeof(int), rec_cmp);
+
+    /* Sorted distinct values per string column, all idents */
+    for (c = 0; c < DUMP_NSTR; c++) {
+	sv[c] = malloc((dc+1)*sizeof(char *));
+	if (!sv[c])
+	    goto End;
+	for (nv[c] = i = 0; i < dc; i++) {
+	    const char *s = dump_str(&dv[order[i]], c);
+
+	    if (c == DC_IDENT || *s)
+		sv[c][nv[c]++] = s;
+	}
+	if (c == DC_IDENT)
+	    continue;
+	qsort(sv[c], nv[c], sizeof(char *), str_cmp);
+	for (i = j = 0; i < (int) nv[c]; i++)
+	    if (j == 0 || strcmp(sv[c][j-1], sv[c][i]) != 0)
+		sv[c][j++] = sv[c][i];
+	nv[c] = j;
+    }
+
+    for (i = 0; i < dc; i++) {
+	pv[2*i] = dv[i].msize;
+	pv[2*i+1] = dv[i].sectorsize;
+    }
+    qsort(pv, dc, 2*sizeof(uint64_t), pair_cmp);
+    for (i = 0; i < dc; i++)
+	if (np == 0 || pair_cmp(&pv[2*(np-1)], &pv[2*i]) != 0) {
+	    pv[2*np] = pv[2*i];
+	    pv[2*np+1] = pv[2*i+1];
+	    np++;
+	}
+
+    recsize = 0;
+    for (c = 1; c < DUMP_NSTR; c++)
+	recsize += (width[c] = id_width(nv[c]));
+    recsize += (swidth = id_width(np));
+
+    /* Header, filled in as the sections are written */
+    if (dbuf_grow(&b, DUMP_HDRSIZE) < 0)
+	goto End;
+    memset(b.p, 0, DUMP_HDRSIZE);
+    memcpy(b.p, DUMP_MAGIC, 8);
+    le_set(b.p+8, dc, 4);
+    le_set(b.p+12, np, 4);
+    le_set(b.p+16, recsize, 4);
+    b.len = DUMP_HDRSIZE;
+
+    for (c = 0; c < DUMP_NSTR; c++)
+	if (put_column(&b, c, sv[c], nv[c]) < 0)
+	    goto End;
+
+    le_set(b.p+32, b.len, 8);
+    for (i = 0; i < (int) np; i++)
+	if (dbuf_le(&b, pv[2*i], 8) < 0 ||
+	    dbuf_le(&b, pv[2*i+1], 4) < 0)
+	    goto End;
+
+    le_set(b.p+24, b.len, 8);
+    for (i = 0; i < dc; i++) {
+	const DISK *dp = &dv[order[i]];
+	uint64_t pair[2], *pp;
+	const char *s, **fp;
+
+	for (c = 1; c < DUMP_NSTR; c++) {
+	    s = dump_str(dp, c);
+	    fp = *s ? bsearch(&s, sv[c], nv[c], sizeof(char *), str_cmp) : NULL;
+	    if (dbuf_le(&b, fp ? fp - sv[c] + 1 : 0, width[c]) < 0)
+		goto End;
+	}
+	pair[0] = dp->msize;
+	pair[1] = dp->sectorsize;
+	pp = bsearch(pair, pv, np, 2*sizeof(uint64_t), pair_cmp);
+	if (dbuf_le(&b, (pp - pv)/2, swidth) < 0)
+	    goto End;
+    }
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    fd = open(tmp, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+    if (fd >= 0) {
+	n = write(fd, b.p, b.len);
+	if (n >= 0 && n < (ssize_t) b.len)
+	    errno = ENOSPC;		/* Short write */
+
+	/* Close in any case, but a failed close fails the save */
+	if (close(fd) < 0)
+	    n = -1;
+	if (n == (ssize_t) b.len && rename(tmp, path) == 0)
+	    rc = 0;
+	else {
+	    int err = errno;
+
+	    unlink(tmp);
+	    errno = err;
+	}
+    }
+
+ End:
+    for (c = 0; c < DUMP_NSTR; c++)
+	free(sv[c]);
+    free(order);
+    free(pv);
+    free(b.p);
+    return rc;
+}
+
+
+DRVLIST_DUMP *
+drvlist_dump_open(const char *path) {
+    DRVLIST_DUMP *dp;
+    struct stat sb;
+    uint64_t off;
+    int c, fd, rs;
+
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+	return NULL;
+    if (fstat(fd, &sb) < 0) {
+	close(fd);
+	return NULL;
+    }
+    if (sb.st_size < DUMP_HDRSIZE) {
+	close(fd);
+	errno = EINVAL;
+	return NULL;
+    }
+
+    dp = calloc(1, sizeof(*dp));
+    if (!dp) {
+	close(fd);
+	return NULL;
+    }
+    dp->size = sb.st_size;
+    dp->buf = mmap(NULL, dp->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (dp->buf == MAP_FAILED) {
+	free(dp);
+	return NULL;
+    }
+
+    if (memcmp(dp->buf, DUMP_MAGIC, 8) != 0)
+	goto Invalid;
+    dp->nrec = le_get(dp->buf+8, 4);
+    dp->nsizes = le_get(dp->buf+12, 4);
+    dp->recsize = le_get(dp->buf+16, 4);
+
+    /* Check that every section is inside the file */
+    for (rs = c = 0; c < DUMP_NSTR; c++) {
+	DCOL *cp = &dp->col[c];
+	const uint8_t *hp = dp->buf + 40 + 16*c;
+
+	cp->n = le_get(hp, 4);
+	cp->nb = le_get(hp+4, 4);
+	off = le_get(hp+8, 8);
+	if (cp->nb != (cp->n + DUMP_BLOCK-1) / DUMP_BLOCK ||
+	    off > dp->size || (dp->size - off)/4 < (uint64_t) cp->nb+1)
+	    goto Invalid;
+	cp->boff = dp->buf + off;
+	cp->data = cp->boff + 4*((size_t) cp->nb+1);
+	cp->dlen = le_get(cp->boff + 4*cp->nb, 4);
+	if (cp->dlen > dp->buf + dp->size - cp->data)
+	    goto Invalid;
+	if (c != DC_IDENT)
+	    rs += (cp->width = id_width(cp->n));
+    }
+    dp->swidth = id_width(dp->nsizes);
+    rs += dp->swidth;
+
+    off = le_get(dp->buf+32, 8);
+    if (dp->col[DC_IDENT].n != dp->nrec || (uint32_t) rs != dp->recsize ||
+	off > dp->size || (dp->size - off)/DUMP_PAIRSIZE < dp->nsizes)
+	goto Invalid;
+    dp->sizes = dp->buf + off;
+
+    off = le_get(dp->buf+24, 8);
+    if (off > dp->size || (dp->size - off)/dp->recsize < dp->nrec)
+	goto Invalid;
+    dp->rec = dp->buf + off;
+
+    return dp;
+
+ Invalid:
+    drvlist_dump_close(dp);
+    errno = EINVAL;
+    return NULL;
+}
+
+void
+drvlist_dump_close(DRVLIST_DUMP *dp) {
+    int i;
+
+    if (!dp)
+	return;
+    munmap(dp->buf, dp->size);
+    for (i = 0; i < dp->nkeep; i++)
+	free(dp->keep[i]);
+    free(dp->keep);
+    free(dp->sbuf.p);
+    free(dp->dv);
+    free(dp);
+}
+
+
+/* Hand a malloc'd string to the handle */
+static int
+dump_keep(DRVLIST_DUMP *dp,
+	  char *s) {
+    if (dp->nkeep >= dp->skeep) {
+	int n = dp->skeep ? dp->skeep*2 : 64;
+	char **nk = realloc(dp->keep, n*sizeof(char *));
+
+	if (!nk)
+	    return -1;
+	dp->keep = nk;
+	dp->skeep = n;
+    }
+    dp->keep[dp->nkeep++] = s;
+    return 0;
+}
+
+/* Start and end of block b of a column */
+static int
+col_block(const DCOL *cp,
+	  uint32_t b,
+	  const uint8_t **pp,
+	  const uint8_t **endp) {
+    uint32_t start = le_get(cp->boff + 4*b, 4);
+    uint32_t end = le_get(cp->boff + 4*(b+1), 4);
+
+    if (start > end || end > cp->dlen)
+	return -1;
+    *pp = cp->data + start;
+    *endp = cp->data + end;
+    return 0;
+}
+
+/*
+ * Decode the next string of a block from *pp and append it, NUL
+ * terminated, to ap. prev is the offset in ap of the previous string
+ * of the block, or -1 for the first one. Returns the length or -1.
+ */
+static int
+get_string(DBUF *ap,
+	   ssize_t prev,
+	   int list,
+	   const uint8_t **pp,
+	   const uint8_t *end) {
+    size_t start = ap->len, ref, rlen = 0;
+    uint32_t m = 1, plen = 0, slen;
+
+
+    if (prev >= 0)
+	rlen = strlen((char *) ap->p + prev);
+    if (list && (get_varint(pp, end, &m) < 0 || m == 0 || m > (size_t) (end - *pp)))
+	goto Invalid;
+
+    for (ref = prev >= 0 ? prev : 0; m > 0; m--) {
+	size_t elen = rlen;
+
+	/* The element of prev to front code against */
+	if (list && prev >= 0) {
+	    const char *e = memchr(ap->p + ref, ',', rlen);
+
+	    elen = e ? (size_t) (e - (char *) ap->p - ref) : rlen;
+	}
+	if ((prev >= 0 && get_varint(pp, end, &plen) < 0) ||
+	    get_varint(pp, end, &slen) < 0 || plen > elen || slen > (size_t) (end - *pp))
+	    goto Invalid;
+	if (dbuf_grow(ap, plen+slen+1) < 0)
+	    return -1;
+	memcpy(ap->p + ap->len, ap->p + ref, plen);
+	memcpy(ap->p + ap->len + plen, *pp, slen);
+	ap->len += plen+slen;
+	*pp += slen;
+
+	if (m > 1)
+	    ap->p[ap->len++] = ',';
+	if (list && prev >= 0 && elen < rlen) {
+	    ref += elen+1;
+	    rlen -= elen+1;
+	}
+    }
+
+    ap->p[ap->len++] = '\0';
+    return ap->len - start - 1;
+
+ Invalid:
+    errno = EINVAL;
+    return -1;
+}
+
+/* Decode string i of column c into dp->str. Returns its length or -1 */
+static int
+col_string(DRVLIST_DUMP *dp,
+	   int c,
+	   uint32_t i) {
+    const DCOL *cp = &dp->col[c];
+    const uint8_t *p, *end;
+    ssize_t prev = -1;
+    uint32_t k;
+    int len = 0;
+
+
+    if (i >= cp->n || col_block(cp, i / DUMP_BLOCK, &p, &end) < 0)
+	goto Invalid;
+
+    dp->sbuf.len = 0;
+    for (k = i - i % DUMP_BLOCK; k <= i; k++) {
+	size_t start = dp->sbuf.len;
+
+	if ((len = get_string(&dp->sbuf, prev, DC_LIST(c), &p, end)) < 0)
+	    return -1;
+	prev = start;
+    }
+
+    dp->str = (char *) dp->sbuf.p + prev;
+    return len;
+
+ Invalid:
+    errno = EINVAL;
+    return -1;
+}
+
+/* Decode a whole column. The strings are kept by the handle */
+static char **
+col_all(DRVLIST_DUMP *dp,
+	int c) {
+    const DCOL *cp = &dp->col[c];
+    DBUF a = { NULL, 0, 0 };
+    const uint8_t *p, *end;
+    size_t *ov;
+    ssize_t prev;
+    uint32_t b, i;
+    char **sv;
+
+
+    ov = malloc((cp->n+1)*sizeof(size_t));
+    sv = malloc((cp->n+1)*sizeof(char *));
+    if (!ov || !sv)
+	goto Fail;
+
+    for (i = b = 0; b < cp->nb; b++) {
+	if (col_block(cp, b, &p, &end) < 0)
+	    goto Invalid;
+	for (prev = -1; i < cp->n && (prev < 0 || i % DUMP_BLOCK); i++) {
+	    ov[i] = a.len;
+	    if (get_string(&a, prev, DC_LIST(c), &p, end) < 0)
+		goto Fail;
+	    prev = ov[i];
+	}
+    }
+
+    if (a.p && dump_keep(dp, (char *) a.p) < 0)
+	goto Fail;
+    for (i = 0; i < cp->n; i++)
+	sv[i] = (char *) a.p + ov[i];
+    free(ov);
+    return sv;
+
+ Invalid:
+    errno = EINVAL;
+ Fail:
+    free(a.p);
+    free(ov);
+    free(sv);
+    return NULL;
+}
+
+
+/* Set string column c of a drive. 'keep' copies pointer fields */
+static int
+dump_set(DRVLIST_DUMP *dp,
+	 DISK *out,
+	 int c,
+	 char *s,
+	 size_t len,
+	 int keep) {
+    char **fp = NULL;
+
+    switch (c) {
+    case 0:
+	DISK_SETSTR(out, ident, s, len, 0);
+	return 0;
+    case 2:
+	DISK_SETSTR(out, vendor, s, len, 0);
+	return 0;
+    case 3:
+	DISK_SETSTR(out, product, s, len, 0);
+	return 0;
+    case 4:
+	DISK_SETSTR(out, revision, s, len, 0);
+	return 0;
+    case 1:
+	fp = &out->danames;
+	break;
+    case 5:
+	fp = &out->driver;
+	break;
+    case 6:
+	fp = &out->path;
+	break;
+    case 7:
+	fp = &out->phys;
+	break;
+    }
+
+    if (keep) {
+	s = strdup(s);
+	if (!s || dump_keep(dp, s) < 0) {
+	    free(s);
+	    return -1;
+	}
+    }
+    *fp = s;
+    return 0;
+}
+
+/* Fill in record r, from decoded columns (sv) or one string at a time */
+static int
+dump_record(DRVLIST_DUMP *dp,
+	    uint32_t r,
+	    char **sv[],
+	    DISK *out) {
+    const uint8_t *rp = dp->rec + (size_t) r*dp->recsize;
+    uint32_t id;
+    uint64_t msize;
+    int c, len;
+
+
+    memset(out, 0, sizeof(*out));
+    for (c = 0; c < DUMP_NSTR; c++) {
+	if (c == DC_IDENT)
+	    id = r+1;
+	else {
+	    id = le_get(rp, dp->col[c].width);
+	    rp += dp->col[c].width;
+	}
+	if (id == 0)
+	    continue;
+	if (id > dp->col[c].n) {
+	    errno = EINVAL;
+	    return -1;
+	}
+
+	if (sv) {
+	    if (dump_set(dp, out, c, sv[c][id-1], strlen(sv[c][id-1]), 0) < 0)
+		return -1;
+	} else if ((len = col_string(dp, c, id-1)) < 0 ||
+		   dump_set(dp, out, c, dp->str, len, 1) < 0)
+	    return -1;
+    }
+
+    id = le_get(rp, dp->swidth);
+    if (id >= dp->nsizes) {
+	errno = EINVAL;
+	return -1;
+    }
+    msize = le_get(dp->sizes + (size_t) id*DUMP_PAIRSIZE, 8);
+    out->msize = msize;
+    out->sectorsize = le_get(dp->sizes + (size_t) id*DUMP_PAIRSIZE + 8, 4);
+    if (out->msize > 0)
+	out->sizelen = drvlist_size2buf(out->msize, out->size, sizeof(out->size));
+    return 0;
+}
+
+
+/*
+ * Decode all drives. The drives and their strings belong to the
+ * handle. Returns the number of drives or -1.
+ */
+int
+drvlist_dump_read(DRVLIST_DUMP *dp,
+		  DISK **dvp) {
+    char **sv[DUMP_NSTR];
+    uint32_t r;
+    int c, rc = -1;
+
+
+    memset(sv, 0, sizeof(sv));
+    free(dp->dv);
+    dp->dv = calloc(dp->nrec+1, sizeof(DISK));
+    if (!dp->dv)
+	return -1;
+
+    for (c = 0; c < DUMP_NSTR; c++)
+	if (!(sv[c] = col_all(dp, c)))
+	    goto End;
+
+    for (r = 0; r < dp->nrec; r++)
+	if (dump_record(dp, r, sv, &dp->dv[r]) < 0)
+	    goto End;
+
+    *dvp = dp->dv;
+    rc = dp->nrec;
+
+ End:
+    for (c = 0; c < DUMP_NSTR; c++)
+	free(sv[c]);
+    return rc;
+}
+
+
+/*
+ * Look up one drive by serial number, decoding only the blocks that
+ * are needed. Its strings belong to the handle. Returns 0 if found,
+ * 1 if not or -1 on error.
+ */
+int
+drvlist_dump_find(DRVLIST_DUMP *dp,
+		  const char *ident,
+		  DISK *out) {
+    const DCOL *cp = &dp->col[DC_IDENT];
+    uint32_t lo = 0, hi = cp->nb, mid, i;
+    int d;
+
+
+    /* The last block that starts before ident */
+    while (lo < hi) {
+	mid = lo + (hi-lo)/2;
+	if (col_string(dp, DC_IDENT, mid*DUMP_BLOCK) < 0)
+	    return -1;
+	if (strcmp(dp->str, ident) < 0)
+	    lo = mid+1;
+	else
+	    hi = mid;
+    }
+
+    for (i = (lo > 0 ? lo-1 : 0)*DUMP_BLOCK; i < cp->n; i++) {
+	if (col_string(dp, DC_IDENT, i) < 0)
+	    return -1;
+	d = strcmp(dp->str, ident);
+	if (d == 0)
+	    return dump_record(dp, i, NULL, out) < 0 ? -1 : 0;
+	if (d > 0)
+	    break;
+    }
+
+    return 1;
+}
@@ -0,0 +1,248 @@
+/*
+ * fixstr.c
+ *
+ * Trimming and zero checks for fixed-width identify fields.
+ *
+ * Copyright (c) 2024 Peter Eriksson <pen@lysator.liu.se>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Inquiry, ATA and NVMe identify strings are fixed-width fields padded
+ * with spaces (or NULs), and an ATA IDENTIFY response has to be checked
+ * for being all zero. These helpers scan 16 bytes at a time with SSE2
+ * (x86) or NEON (ARM), and the zero check 32 bytes at a time with AVX2
+ * when the CPU has it. Other platforms use the plain loops, which are
+ * also used for the tails (and everywhere if built with -DFIXSTR_SCALAR).
+ * Whitespace is what isspace() means in the C locale.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#if defined(FIXSTR_SCALAR)
+/* Plain loops only, for comparing against the vector code */
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define FIXSTR_SSE2 1
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define FIXSTR_AVX2 1
+#endif
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define FIXSTR_NEON 1
+#endif
+
+#include "libdrvlist.h"
+
+
+static inline int
+is_blank(unsigned char c) {
+    return c == ' ' || (unsigned char) (c - '\t') <= '\r' - '\t';
+}
+
+
+#if FIXSTR_SSE2
+/* Bit i set if byte i is whitespace */
+static inline unsigned
+blank16(const char *s) {
+    __m128i v = _mm_loadu_si128((const __m128i *) s);
+    __m128i d = _mm_sub_epi8(v, _mm_set1_epi8('\t'));
+    __m128i ctl = _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8('\r' - '\t')), d);
+    __m128i sp = _mm_cmpeq_epi8(v, _mm_set1_epi8(' '));
+
+    return _mm_movemask_epi8(_mm_or_si128(ctl, sp));
+}
+#define HAVE_BLANK16 1
+
+#elif FIXSTR_NEON
+static inline unsigned
+blank16(const char *s) {
+    static const uint8_t bits[16] = { 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128 };
+    uint8x16_t v = vld1q_u8((const uint8_t *) s);
+    uint8x16_t m = vorrq_u8(vceqq_u8(v, vdupq_n_u8(' ')),
+			    vcleq_u8(vsubq_u8(v, vdupq_n_u8('\t')), vdupq_n_u8('\r' - '\t')));
+    uint8x16_t b = vandq_u8(m, vld1q_u8(bits));
+
+    /* Sum each half into one byte */
+    return vaddv_u8(vget_low_u8(b)) | (vaddv_u8(vget_high_u8(b)) << 8);
+}
+#define HAVE_BLANK16 1
+#endif
+
+
+/*
+ * Returns the length of s[0..n-1] without leading and trailing
+ * whitespace, and the offset of the first other character in *offp.
+ */
+size_t
+drvlist_trimspan(const char *s,
+		 size_t n,
+		 size_t *offp) {
+    size_t i = 0, e = n;
+#if HAVE_BLANK16
+    unsigned m = 0;
+#endif
+
+
+#if HAVE_BLANK16
+    while (i+16 <= n && (m = blank16(s+i)) == 0xffff)
+	i += 16;
+    if (i+16 <= n)
+	i += __builtin_ctz(~m);
+    else
+#endif
+	while (i < n && is_blank(s[i]))
+	    ++i;
+    *offp = i;
+
+#if HAVE_BLANK16
+    while (e >= i+16 && (m = blank16(s+e-16)) == 0xffff)
+	e -= 16;
+    if (e >= i+16)
+	e -= __builtin_clz(~m << 16);
+    else
+#endif
+	while (e > i && is_blank(s[e-1]))
+	    --e;
+
+    return e-i;
+}
+
+
+/*
+ * Copy s[0..n-1] to dst (which may be s) with every run of whitespace
+ * reduced to its first character. Returns the new length. Blocks of
+ * 16 without whitespace are copied, blocks of only whitespace reduced
+ * to one byte, and mixed ones use the whitespace mask.
+ */
+size_t
+drvlist_collapse(char *dst,
+		 const char *s,
+		 size_t n) {
+    size_t i = 0, o = 0;
+    unsigned prev = 0, b;
+#if HAVE_BLANK16
+    unsigned m;
+    int k;
+#endif
+
+
+#if HAVE_BLANK16
+    for (; i+16 <= n; i += 16) {
+	m = blank16(s+i);
+	if (m == 0) {
+	    memmove(dst+o, s+i, 16);
+	    o += 16;
+	    prev = 0;
+	} else if (m == 0xffff) {
+	    if (!prev)
+		dst[o++] = s[i];
+	    prev = 1;
+	} else
+	    for (k = 0; k < 16; k++) {
+		b = (m >> k) & 1;
+		if (!(b & prev))
+		    dst[o++] = s[i+k];
+		prev = b;
+	    }
+    }
+#endif
+    for (; i < n; i++) {
+	b = is_blank(s[i]);
+	if (!(b & prev))
+	    dst[o++] = s[i];
+	prev = b;
+    }
+
+    return o;
+}
+
+
+#if FIXSTR_AVX2
+__attribute__((target("avx2")))
+static size_t
+zero_avx2(const char *p,
+	  size_t len) {
+    __m256i acc = _mm256_setzero_si256();
+    size_t i;
+
+    for (i = 0; i+32 <= len; i += 32)
+	acc = _mm256_or_si256(acc, _mm256_loadu_si256((const __m256i *) (p+i)));
+    return _mm256_testz_si256(acc, acc) ? i : (size_t) -1;
+}
+#endif
+
+/* Returns 1 if all 'len' bytes at 'buf' are zero */
+int
+drvlist_allzero(const void *buf,
+		size_t len) {
+    const char *p = (const char *) buf;
+    size_t i = 0;
+
+
+#if FIXSTR_AVX2
+    static int avx2 = -1;
+
+    if (avx2 < 0)
+	avx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+    if (avx2 && len >= 32) {
+	i = zero_avx2(p, len);
+	if (i == (size_t) -1)
+	    return 0;
+    }
+#endif
+#if FIXSTR_SSE2
+    {
+	__m128i acc = _mm_setzero_si128();
+
+	for (; i+16 <= len; i += 16)
+	    acc = _mm_or_si128(acc, _mm_loadu_si128((const __m128i *) (p+i)));
+	if (_mm_movemask_epi8(_mm_cmpeq_epi8(acc, _mm_setzero_si128())) != 0xffff)
+	    return 0;
+    }
+#elif FIXSTR_NEON
+    {
+	uint8x16_t acc = vdupq_n_u8(0);
+
+	for (; i+16 <= len; i += 16)
+	    acc = vorrq_u8(acc, vld1q_u8((const uint8_t *) (p+i)));
+	if (vmaxvq_u8(acc) != 0)
+	    return 0;
+    }
+#endif
+    for (; i < len; i++)
+	if (p[i] != 0)
+	    return 0;
+
+    return 1;
+}
@@ -0,0 +1,334 @@
+/*
+ * format.c
+ *
+ * Row templates for the drvlist drive table.
+ *
+ * Copyright (c) 2024 Peter Eriksson <pen@lysator.liu.se>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * A template such as '{ident}\t{names}\t{size:>8}' is parsed once into
+ * a list of ops, each either literal text or a column, and every row
+ * is rendered by running through the ops into one buffer that is
+ * written with a single fwrite(). The default table layout is also
+ * built as a template, with the widths of the current table.
+ *
+ * Field modifiers: {name:[<|>][width|*][.max]}. '<' and '>' align left
+ * (default) and right in 'width' characters, '*' is the widest value
+ * in the table. Values that do not fit in 'max' are cut like with -W
+ * and end in "..". \t, \n and \\ are expanded, {{ and }} are literal
+ * braces.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <sys/types.h>
+
+#include "drvlist.h"
+
+
+#define FMT_TEXT  -1		/* Literal text op */
+#define FMT_NUM   -2		/* Row number */
+
+
+static const struct {
+    const char *name;
+    int col;
+} fmt_fields[] = {
+    { "n",         FMT_NUM },
+    { "vendor",    COL_VENDOR },
+    { "product",   COL_PRODUCT },
+    { "rev",       COL_REVISION },
+    { "ident",     COL_IDENT },
+    { "size",      COL_SIZE },
+    { "names",     COL_NAMES },
+    { "phys",      COL_PHYS },
+    { "p50",       COL_P50 },
+    { "p99",       COL_P99 },
+    { "p99.9",     COL_P999 },
+    { "fw",        COL_FW },
+    { "multipath", COL_MPATH },
+    { "labels",    COL_LABELS },
+    { "parts",     COL_PARTS },
+    { "pool",      COL_ZPOOL },
+    { "guid",      COL_ZGUID },
+    { "drv",       COL_DRIVER },
+    { "path",      COL_PATH },
+    { NULL,        0 }
+};
+
+
+static FMTOP *
+fmt_op(FMT *fp) {
+    FMTOP *ov = realloc(fp->ov, (fp->oc+1)*sizeof(*ov));
+
+    if (!ov)
+	return NULL;
+    fp->ov = ov;
+    memset(&ov[fp->oc], 0, sizeof(*ov));
+    return &ov[fp->oc++];
+}
+
+static int
+fmt_num(const char **pp) {
+    int n = 0;
+
+    while (isdigit((unsigned char) **pp))
+	n = n*10 + *(*pp)++ - '0';
+    return n;
+}
+
+
+/* Parse a template. Returns 0, or -1 with a message in *errp */
+int
+fmt_parse(FMT *fp,
+	  const char *tmpl,
+	  const char **errp) {
+    const char *p = tmpl;
+    char *tp;
+    FMTOP *op = NULL;
+    int i;
+
+
+    memset(fp, 0, sizeof(*fp));
+    fp->text = tp = malloc(strlen(tmpl)+1);
+    if (!tp)
+	goto Fail;
+
+    while (*p) {
+	if (*p == '{' && p[1] != '{') {
+	    size_t n;
+
+	    ++p;
+	    n = strcspn(p, ":}");
+	    for (i = 0; fmt_fields[i].name; i++)
+		if (strlen(fmt_fields[i].name) == n && strncmp(fmt_fields[i].name, p, n) == 0)
+		    break;
+	    if (!fmt_fields[i].name) {
+		*errp = "Unknown field";
+		goto Error;
+	    }
+	    if (!(op = fmt_op(fp)))
+		goto Fail;
+	    op->col = fmt_fields[i].col;
+	    p += n;
+
+	    if (*p == ':') {
+		++p;
+		if (*p == '<' || *p == '>')
+		    op->right = (*p++ == '>');
+		if (*p == '*') {
+		    op->width = -1;
+		    ++p;
+		} else
+		    op->width = fmt_num(&p);
+		if (*p == '.') {
+		    ++p;
+		    if (!isdigit((unsigned char) *p)) {
+			*errp = "Missing maximum width";
+			goto Error;
+		    }
+		    op->max = fmt_num(&p);
+		}
+	    }
+	    if (*p++ != '}') {
+		*errp = "Invalid field modifier";
+		goto Error;
+	    }
+	    op = NULL;
+	    continue;
+	}
+
+	/* Literal text, appended to the current text op */
+	if (!op) {
+	    if (!(op = fmt_op(fp)))
+		goto Fail;
+	    op->col = FMT_TEXT;
+	    op->text = tp;
+	}
+	if ((*p == '{' || *p == '}') && p[1] == *p)
+	    ++p;
+	else if (*p == '\\' && p[1]) {
+	    switch (*++p) {
+	    case 't':
+		*tp++ = '\t';
+		++p;
+		++op->len;
+		continue;
+	    case 'n':
+		*tp++ = '\n';
+		++p;
+		++op->len;
+		continue;
+	    case '\\':
+		break;
+	    default:
+		--p;
+	    }
+	}
+	*tp++ = *p++;
+	++op->len;
+    }
+
+    return 0;
+
+ Fail:
+    *errp = strerror(errno);
+ Error:
+    fmt_free(fp);
+    return -1;
+}
+
+void
+fmt_free(FMT *fp) {
+    free(fp->ov);
+    free(fp->text);
+    free(fp->buf);
+    memset(fp, 0, sizeof(*fp));
+}
+
+
+static int
+fmt_cut(int max,
+	int len) {
+    return max > 2 && len+2 > max;
+}
+
+/* Resolve '*' widths for a table, the row number is 'numlen' wide */
+void
+fmt_prepare(FMT *fp,
+	    const COLS *cp,
+	    int numlen) {
+    int k, i;
+
+
+    for (k = 0; k < fp->oc; k++) {
+	FMTOP *op = &fp->ov[k];
+	int w = 0;
+
+	if (op->width >= 0)
+	    continue;
+	if (op->col == FMT_NUM)
+	    w = numlen;
+	else if (op->col >= 0)
+	    for (i = 0; i < cp->n; i++) {
+		int len = cp->len[op->col][i];
+
+		if (fmt_cut(op->max, len))
+		    len = op->max;
+		if (len > w)
+		    w = len;
+	    }
+	op->width = w;
+    }
+}
+
+
+/* Render row 'r' (printed as number 'num') and write it to stdout */
+int
+fmt_print(FMT *fp,
+	  const COLS *cp,
+	  int r,
+	  int num) {
+    char nbuf[16];
+    size_t need;
+    int k;
+
+
+    /* Room for the longest possible row */
+    need = 2;
+    for (k = 0; k < fp->oc; k++) {
+	const FMTOP *op = &fp->ov[k];
+
+	need += op->width + 2;
+	need += op->col == FMT_TEXT ? op->len : op->col == FMT_NUM ? sizeof(nbuf) : cp->len[op->col][r];
+    }
+    if (need > fp->size) {
+	char *nb = realloc(fp->buf, need);
+
+	if (!nb)
+	    return -1;
+	fp->buf = nb;
+	fp->size = need;
+    }
+
+    fp->len = 0;
+    for (k = 0; k < fp->oc; k++) {
+	const FMTOP *op = &fp->ov[k];
+	const char *s;
+	char *bp;
+	int len, cut, pad;
+
+	if (op->col == FMT_TEXT) {
+	    memcpy(fp->buf + fp->len, op->text, op->len);
+	    fp->len += op->len;
+	    continue;
+	}
+
+	if (op->col == FMT_NUM) {
+	    s = nbuf;
+	    len = snprintf(nbuf, sizeof(nbuf), "%d", num);
+	} else {
+	    s = cp->str[op->col][r];
+	    len = cp->len[op->col][r];
+	}
+
+	cut = fmt_cut(op->max, len);
+	if (cut)
+	    len = op->max-2;
+
+	/* Copy, then align in place once the length is known */
+	bp = fp->buf + fp->len;
+	memcpy(bp, s, len);
+	if (op->col == COL_PATH)
+	    len = drvlist_collapse(bp, bp, len);
+	if (cut) {
+	    bp[len++] = '.';
+	    bp[len++] = '.';
+	}
+
+	pad = op->width - len;
+	if (pad > 0) {
+	    if (op->right) {
+		memmove(bp+pad, bp, len);
+		memset(bp, ' ', pad);
+	    } else
+		memset(bp+len, ' ', pad);
+	    len += pad;
+	}
+	fp->len += len;
+    }
+
+    fp->buf[fp->len++] = '\n';
+    return fwrite(fp->buf, 1, fp->len, stdout) == fp->len ? 0 : -1;
+}
@@ -0,0 +1,711 @@
+/*
+ * geom.c
+ *
+ * GEOM topology from kern.geom.confxml for drvlist.
+ *
+ * Copyright (c) 2024 Peter Eriksson <pen@lysator.liu.se>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * kern.geom.confxml describes every GEOM class, geom, provider and
+ * consumer in the system in one sysctl. It is parsed in a single
+ * streaming pass into flat provider/consumer tables, and the graph is
+ * then walked from each DISK provider to find its partitions, labels
+ * (gpt/..., gptid/..., diskid/...) and gmultipath geom - without
+ * opening any device.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/sysctl.h>
+
+#include "drvlist.h"
+
+
+typedef struct {
+    uint64_t id;
+    char *cls;		/* Class name, shared */
+    char *name;
+    int pfirst;		/* First provider of this geom */
+    int mark;		/* Drive (index + 1) that last walked this geom */
+} GGEOM;
+
+typedef struct {
+    uint64_t id;
+    uint64_t geom;
+    char *name;
+    off_t mediasize;
+    u_int sectorsize;
+    int g;		/* Index into geoms */
+    int gnext;		/* Next provider of the same geom */
+    int cfirst;		/* First consumer attached to this provider */
+} GPROV;
+
+typedef struct {
+    uint64_t geom;
+    uint64_t provider;
+    int g;
+    int p;
+    int pnext;		/* Next consumer attached to the same provider */
+} GCONS;
+
+typedef struct {
+    GGEOM *gv;
+    int gc;
+    GPROV *pv;
+    int pc;
+    GCONS *cv;
+    int cc;
+    int *phash;		/* Provider index + 1, by id */
+    size_t phsize;
+    int *nhash;		/* Provider index + 1, by name */
+    size_t nhsize;
+    int loaded;
+} GMESH;
+
+
+static GMESH mesh;
+
+
+/*
+ * Minimal streaming XML tokenizer, enough for confxml: elements with
+ * attributes, character data with the predefined entities, comments
+ * and processing instructions (skipped). No DTDs or CDATA.
+ */
+
+#define XML_MAXDEPTH 16
+
+typedef struct {
+    const char *p;
+    const char *end;
+    char *tag[XML_MAXDEPTH];	/* Open element names (pointers into a scratch copy) */
+    int depth;
+    char text[1024];
+    size_t tlen;
+    char attr_id[32];
+    char attr_ref[32];
+} XMLPARSER;
+
+typedef struct {
+    void (*start)(void *ctx, XMLPARSER *xp, const char *tag);
+    void (*end)(void *ctx, XMLPARSER *xp, const char *tag, const char *text);
+} XMLHANDLER;
+
+
+static void
+xml_text_add(XMLPARSER *xp,
+	     int c) {
+    if (xp->tlen+1 < sizeof(xp->text))
+	xp->text[xp->tlen++] = c;
+}
+
+static const char *
+xml_entity(XMLPARSER *xp,
+	   const char *p) {
+    static const struct { const char *s; int c; } ev[] = {
+	{ "&amp;", '&' }, { "&lt;", '<' }, { "&gt;", '>' },
+	{ "&quot;", '"' }, { "&apos;", '\'' }, { NULL, 0 }
+    };
+    int i;
+
+    for (i = 0; ev[i].s; i++) {
+	size_t n = strlen(ev[i].s);
+
+	if ((size_t) (xp->end-p) >= n && strncmp(p, ev[i].s, n) == 0) {
+	    xml_text_add(xp, ev[i].c);
+	    return p+n;
+	}
+    }
+
+    xml_text_add(xp, '&');
+    return p+1;
+}
+
+static void
+xml_attr(XMLPARSER *xp,
+	 const char *name,
+	 size_t nlen,
+	 const char *val,
+	 size_t vlen) {
+    char *dst = NULL;
+
+    if (nlen == 2 && strncmp(name, "id", 2) == 0)
+	dst = xp->attr_id;
+    else if (nlen == 3 && strncmp(name, "ref", 3) == 0)
+	dst = xp->attr_ref;
+    if (!dst)
+	return;
+
+    if (vlen >= sizeof(xp->attr_id))
+	vlen = sizeof(xp->attr_id)-1;
+    memcpy(dst, val, vlen);
+    dst[vlen] = '\0';
+}
+
+static int
+xml_parse(const char *buf,
+	  size_t len,
+	  const XMLHANDLER *hp,
+	  void *ctx) {
+    XMLPARSER x;
+    char tagbuf[XML_MAXDEPTH][64];
+    const char *p, *q;
+    int closing, empty;
+
+
+    memset(&x, 0, sizeof(x));
+    x.p = buf;
+    x.end = buf+len;
+
+    for (p = buf; p < x.end; ) {
+	if (*p != '<') {
+	    if (*p == '&')
+		p = xml_entity(&x, p);
+	    else
+		xml_text_add(&x, *p++);
+	    continue;
+	}
+
+	/* Comments and processing instructions */
+	if (p+4 <= x.end && strncmp(p, "<!--", 4) == 0) {
+	    for (q = p+4; q+3 <= x.end && strncmp(q, "-->", 3) != 0; q++)
+		;
+	    p = q+3;
+	    continue;
+	}
+	if (p+1 < x.end && (p[1] == '?' || p[1] == '!')) {
+	    q = memchr(p, '>', x.end-p);
+	    if (!q)
+		return -1;
+	    p = q+1;
+	    continue;
+	}
+
+	closing = (p+1 < x.end && p[1] == '/');
+	q = p + (closing ? 2 : 1);
+	p = q;
+	while (q < x.end && *q != '>' && *q != '/' && *q != ' ' && *q != '\t' && *q != '\n' && *q != '\r')
+	    ++q;
+	if (q >= x.end)
+	    return -1;
+
+	if (closing) {
+	    if (x.depth == 0)
+		return -1;
+	    --x.depth;
+	    if ((size_t) (q-p) != strlen(x.tag[x.depth]) ||
+		strncmp(p, x.tag[x.depth], q-p) != 0)
+		return -1;
+
+	    /* Trim character data */
+	    while (x.tlen > 0 && (x.text[x.tlen-1] == ' ' || x.text[x.tlen-1] == '\n' ||
+				  x.text[x.tlen-1] == '\t' || x.text[x.tlen-1] == '\r'))
+		--x.tlen;
+	    x.text[x.tlen] = '\0';
+	    {
+		char *t = x.text;
+		while (*t == ' ' || *t == '\n' || *t == '\t' || *t == '\r')
+		    ++t;
+		if (hp->end)
+		    hp->end(ctx, &x, x.tag[x.depth], t);
+	    }
+	    x.tlen = 0;
+
+	    q = memchr(q, '>', x.end-q);
+	    if (!q)
+		return -1;
+	    p = q+1;
+	    continue;
+	}
+
+	if (x.depth >= XML_MAXDEPTH)
+	    return -1;
+
+	snprintf(tagbuf[x.depth], sizeof(tagbuf[0]), "%.*s", (int) (q-p), p);
+	x.tag[x.depth] = tagbuf[x.depth];
+	x.attr_id[0] = x.attr_ref[0] = '\0';
+
+	/* Attributes */
+	empty = 0;
+	for (p = q; p < x.end && *p != '>'; ) {
+	    const char *an, *av;
+	    size_t anl;
+	    char quote;
+
+	    if (*p == '/') {
+		empty = 1;
+		++p;
+		continue;
+	    }
+	    if (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') {
+		++p;
+		continue;
+	    }
+
+	    for (an = p; p < x.end && *p != '=' && *p != '>' && *p != ' '; p++)
+		;
+	    anl = p-an;
+	    if (p >= x.end || *p != '=')
+		continue;
+	    ++p;
+	    if (p >= x.end || (*p != '"' && *p != '\''))
+		return -1;
+	    quote = *p++;
+	    for (av = p; p < x.end && *p != quote; p++)
+		;
+	    if (p >= x.end)
+		return -1;
+	    xml_attr(&x, an, anl, av, p-av);
+	    ++p;
+	}
+	if (p >= x.end)
+	    return -1;
+	++p;
+
+	x.depth++;
+	x.tlen = 0;
+	if (hp->start)
+	    hp->start(ctx, &x, x.tag[x.depth-1]);
+
+	if (empty) {
+	    x.depth--;
+	    if (hp->end)
+		hp->end(ctx, &x, x.tag[x.depth], "");
+	}
+    }
+
+    return x.depth == 0 ? 0 : -1;
+}
+
+
+/*
+ * confxml handlers. Element nesting:
+ *
+ *   mesh/class/{name,geom}
+ *   mesh/class/geom/{name,provider,consumer}
+ *   mesh/class/geom/provider/{name,mediasize,sectorsize}
+ *   mesh/class/geom/consumer/provider[@ref]
+ */
+
+typedef struct {
+    GMESH *mp;
+    char *cls;
+    int cls_used;	/* cls is shared by a geom */
+    int in_geom;
+    int in_prov;
+    int in_cons;
+} CONFCTX;
+
+
+static int
+grow(void **vp,
+     int n,
+     size_t size) {
+    void *np;
+
+    /* Grow by doubling */
+    if (n > 0 && (n & (n-1)) != 0)
+	return 0;
+
+    np = realloc(*vp, (n ? n*2 : 64)*size);
+    if (!np)
+	return -1;
+    *vp = np;
+    return 0;
+}
+
+static void
+conf_start(void *ctx,
+	   XMLPARSER *xp,
+	   const char *tag) {
+    CONFCTX *cp = (CONFCTX *) ctx;
+    GMESH *mp = cp->mp;
+
+    if (xp->depth == 2 && strcmp(tag, "class") == 0) {
+	cp->cls = NULL;
+	cp->cls_used = 0;
+    } else if (xp->depth == 3 && strcmp(tag, "geom") == 0) {
+	if (grow((void **) &mp->gv, mp->gc, sizeof(GGEOM)) < 0)
+	    return;
+	memset(&mp->gv[mp->gc], 0, sizeof(GGEOM));
+	mp->gv[mp->gc].id = strtoull(xp->attr_id, NULL, 0);
+	mp->gv[mp->gc].cls = cp->cls;
+	mp->gc++;
+	cp->cls_used = 1;
+	cp->in_geom = 1;
+    } else if (xp->depth == 4 && cp->in_geom && strcmp(tag, "provider") == 0) {
+	if (grow((void **) &mp->pv, mp->pc, sizeof(GPROV)) < 0)
+	    return;
+	memset(&mp->pv[mp->pc], 0, sizeof(GPROV));
+	mp->pv[mp->pc].id = strtoull(xp->attr_id, NULL, 0);
+	mp->pv[mp->pc].geom = mp->gv[mp->gc-1].id;
+	mp->pv[mp->pc].g = mp->gc-1;
+	mp->pc++;
+	cp->in_prov = 1;
+    } else if (xp->depth == 4 && cp->in_geom && strcmp(tag, "consumer") == 0) {
+	if (grow((void **) &mp->cv, mp->cc, sizeof(GCONS)) < 0)
+	    return;
+	memset(&mp->cv[mp->cc], 0, sizeof(GCONS));
+	mp->cv[mp->cc].geom = mp->gv[mp->gc-1].id;
+	mp->cv[mp->cc].g = mp->gc-1;
+	mp->cv[mp->cc].p = -1;
+	mp->cc++;
+	cp->in_cons = 1;
+    } else if (xp->depth == 5 && cp->in_cons && strcmp(tag, "provider") == 0) {
+	mp->cv[mp->cc-1].provider = strtoull(xp->attr_ref, NULL, 0);
+    }
+}
+
+static void
+conf_end(void *ctx,
+	 XMLPARSER *xp,
+	 const char *tag,
+	 const char *text) {
+    CONFCTX *cp = (CONFCTX *) ctx;
+    GMESH *mp = cp->mp;
+
+    /* xp->depth is the depth of the parent of the closed element */
+    switch (xp->depth) {
+    case 1:
+	if (strcmp(tag, "class") == 0) {
+	    if (!cp->cls_used)
+		free(cp->cls);
+	    cp->cls = NULL;
+	}
+	break;
+
+    case 2:
+	if (strcmp(tag, "name") == 0)
+	    cp->cls = strdup(text);
+	else if (strcmp(tag, "geom") == 0)
+	    cp->in_geom = 0;
+	break;
+
+    case 3:
+	if (strcmp(tag, "provider") == 0)
+	    cp->in_prov = 0;
+	else if (strcmp(tag, "consumer") == 0)
+	    cp->in_cons = 0;
+	else if (cp->in_geom && strcmp(tag, "name") == 0)
+	    mp->gv[mp->gc-1].name = strdup(text);
+	break;
+
+    case 4:
+	if (cp->in_prov) {
+	    GPROV *pp = &mp->pv[mp->pc-1];
+
+	    if (strcmp(tag, "name") == 0)
+		pp->name = strdup(text);
+	    else if (strcmp(tag, "mediasize") == 0)
+		pp->mediasize = strtoll(text, NULL, 10);
+	    else if (strcmp(tag, "sectorsize") == 0)
+		pp->sectorsize = strtoul(text, NULL, 10);
+	}
+	break;
+    }
+}
+
+
+static uint32_t
+id_hash(uint64_t id) {
+    id ^= id >> 33;
+    id *= 0xff51afd7ed558ccdULL;
+    id ^= id >> 33;
+    return (uint32_t) id;
+}
+
+static uint32_t
+name_hash(const char *s) {
+    uint32_t h = 2166136261U;
+
+    while (*s)
+	h = (h ^ (uint8_t) *s++) * 16777619U;
+    return h;
+}
+
+static int
+prov_by_id(const GMESH *mp,
+	   uint64_t id) {
+    size_t h;
+
+    for (h = id_hash(id) & (mp->phsize-1); mp->phash[h]; h = (h+1) & (mp->phsize-1))
+	if (mp->pv[mp->phash[h]-1].id == id)
+	    return mp->phash[h]-1;
+    return -1;
+}
+
+static int
+prov_by_name(const GMESH *mp,
+	     const char *name) {
+    size_t h;
+
+    if (!mp->nhash)
+	return -1;
+
+    for (h = name_hash(name) & (mp->nhsize-1); mp->nhash[h]; h = (h+1) & (mp->nhsize-1)) {
+	const GPROV *pp = &mp->pv[mp->nhash[h]-1];
+
+	if (pp->name && strcmp(pp->name, name) == 0 &&
+	    mp->gv[pp->g].cls && strcmp(mp->gv[pp->g].cls, "DISK") == 0)
+	    return mp->nhash[h]-1;
+    }
+    return -1;
+}
+
+
+/* Release the mesh. Geoms of one class are adjacent and share its name */
+static void
+geom_free(GMESH *mp) {
+    int i;
+
+    for (i = 0; i < mp->gc; i++) {
+	if (i == 0 || mp->gv[i].cls != mp->gv[i-1].cls)
+	    free(mp->gv[i].cls);
+	free(mp->gv[i].name);
+    }
+    for (i = 0; i < mp->pc; i++)
+	free(mp->pv[i].name);
+
+    free(mp->gv);
+    free(mp->pv);
+    free(mp->cv);
+    free(mp->phash);
+    free(mp->nhash);
+    memset(mp, 0, sizeof(*mp));
+}
+
+
+/*
+ * Parse a confxml document into a provider/consumer graph, replacing
+ * any mesh parsed before
+ */
+int
+geom_parse(const char *buf,
+	   size_t len) {
+    static const XMLHANDLER handler = { conf_start, conf_end };
+    CONFCTX ctx;
+    int i;
+    size_t h;
+
+
+    geom_free(&mesh);
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.mp = &mesh;
+
+    if (xml_parse(buf, len, &handler, &ctx) < 0) {
+	if (!ctx.cls_used)
+	    free(ctx.cls);
+	errno = EINVAL;
+	return -1;
+    }
+
+    for (mesh.phsize = 64; mesh.phsize < (size_t) mesh.pc*2; mesh.phsize <<= 1)
+	;
+    mesh.nhsize = mesh.phsize;
+    mesh.phash = calloc(mesh.phsize, sizeof(int));
+    mesh.nhash = calloc(mesh.nhsize, sizeof(int));
+    if (!mesh.phash || !mesh.nhash)
+	return -1;
+
+    for (i = 0; i < mesh.pc; i++) {
+	for (h = id_hash(mesh.pv[i].id) & (mesh.phsize-1); mesh.phash[h]; h = (h+1) & (mesh.phsize-1))
+	    ;
+	mesh.phash[h] = i+1;
+
+	if (mesh.pv[i].name) {
+	    for (h = name_hash(mesh.pv[i].name) & (mesh.nhsize-1); mesh.nhash[h]; h = (h+1) & (mesh.nhsize-1))
+		;
+	    mesh.nhash[h] = i+1;
+	}
+    }
+
+    /* Link providers to their geom, and consumers to their provider */
+    for (i = 0; i < mesh.gc; i++)
+	mesh.gv[i].pfirst = -1;
+    for (i = mesh.pc-1; i >= 0; i--) {
+	mesh.pv[i].cfirst = -1;
+	mesh.pv[i].gnext = mesh.gv[mesh.pv[i].g].pfirst;
+	mesh.gv[mesh.pv[i].g].pfirst = i;
+    }
+    for (i = mesh.cc-1; i >= 0; i--) {
+	GCONS *cp = &mesh.cv[i];
+
+	cp->p = prov_by_id(&mesh, cp->provider);
+	cp->pnext = -1;
+	if (cp->p >= 0) {
+	    cp->pnext = mesh.pv[cp->p].cfirst;
+	    mesh.pv[cp->p].cfirst = i;
+	}
+    }
+
+    mesh.loaded = 1;
+
+    if (f_debug)
+	fprintf(stderr, "*** geom: %d geoms, %d providers, %d consumers\n",
+		mesh.gc, mesh.pc, mesh.cc);
+    return 0;
+}
+
+
+/*
+ * Fetch and parse kern.geom.confxml
+ */
+int
+geom_load(void) {
+    char *buf;
+    size_t len = 0;
+    int rc;
+
+
+    if (sysctlbyname("kern.geom.confxml", NULL, &len, NULL, 0) < 0)
+	return -1;
+
+    /* The mesh may grow between the two calls */
+    len += len/8;
+    buf = malloc(len);
+    if (!buf)
+	return -1;
+
+    if (sysctlbyname("kern.geom.confxml", buf, &len, NULL, 0) < 0) {
+	free(buf);
+	return -1;
+    }
+
+    rc = geom_parse(buf, strnlen(buf, len));
+    free(buf);
+    return rc;
+}
+
+
+/*
+ * Media size of a DISK class provider, -1 if unknown
+ */
+int
+geom_mediasize(const char *name,
+	       off_t *msize) {
+    int p;
+
+    if (!mesh.loaded || (p = prov_by_name(&mesh, name)) < 0)
+	return -1;
+
+    *msize = mesh.pv[p].mediasize;
+    return 0;
+}
+
+
+/*
+ * Follow consumers of provider 'p' (recursively through PART geoms)
+ * and collect partition, label and multipath names. 'mark' identifies
+ * the drive, so that a multipath geom reached through several of its
+ * paths is only walked once.
+ */
+static void
+geom_walk(DISK *dp,
+	  int p,
+	  int level,
+	  int mark) {
+    int i, j;
+
+    if (level > 4)
+	return;
+
+    for (i = mesh.pv[p].cfirst; i >= 0; i = mesh.cv[i].pnext) {
+	GGEOM *gp = &mesh.gv[mesh.cv[i].g];
+
+	if (!gp->cls)
+	    continue;
+
+	/* Partitions and labels of a multipath disk are on the multipath provider */
+	if (strcmp(gp->cls, "MULTIPATH") == 0) {
+	    if (gp->mark == mark)
+		continue;
+	    gp->mark = mark;
+
+	    if (gp->name)
+		drvlist_strdupcat(&dp->mpath, gp->name);
+	    for (j = gp->pfirst; j >= 0; j = mesh.pv[j].gnext)
+		geom_walk(dp, j, level+1, mark);
+	    continue;
+	}
+
+	if (strcmp(gp->cls, "PART") != 0 && strcmp(gp->cls, "LABEL") != 0)
+	    continue;
+
+	for (j = gp->pfirst; j >= 0; j = mesh.pv[j].gnext) {
+	    if (!mesh.pv[j].name)
+		continue;
+
+	    if (strcmp(gp->cls, "PART") == 0) {
+		drvlist_strdupcat(&dp->parts, mesh.pv[j].name);
+		geom_walk(dp, j, level+1, mark);
+	    } else
+		drvlist_strdupcat(&dp->labels, mesh.pv[j].name);
+	}
+    }
+}
+
+
+/*
+ * Fill in sizes, partitions, labels and multipath names from the mesh
+ */
+int
+geom_annotate(DISK *dv,
+	      int dc) {
+    int i, j, p;
+
+    if (!mesh.loaded)
+	return -1;
+
+    for (i = 0; i < dc; i++) {
+	DISK *dp = &dv[i];
+
+	for (j = 0; j < dp->pc; j++) {
+	    p = prov_by_name(&mesh, dp->pv[j].name);
+	    if (p < 0)
+		continue;
+
+	    if (!dp->msize && mesh.pv[p].mediasize > 0) {
+		dp->msize = mesh.pv[p].mediasize;
+		dp->sizelen = drvlist_size2buf(dp->msize, dp->size, sizeof(dp->size));
+	    }
+	    if (!dp->sectorsize)
+		dp->sectorsize = mesh.pv[p].sectorsize;
+
+	    geom_walk(dp, p, 0, i+1);
+	}
+    }
+
+    return 0;
+}
@@ -0,0 +1,601 @@
+/*
+ * history.c
+ *
+ * Inventory snapshot history for drvlist.
+ *
+ * Copyright (c) 2024 Peter Eriksson <pen@lysator.liu.se>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * The history store lives in a directory (default /var/db/drvlist) and
+ * consists of three files:
+ *
+ *   history.log   Append-only log. Each snapshot is a header line
+ *                 followed by one line per drive that was added,
+ *                 removed or changed since the previous snapshot:
+ *
+ *                   S <time> <host> <drives> <changes>
+ *                   R <prev> <snap> <+|-|~> <ident>\t<names>\t<phys>\t<vendor>\t<product>\t<rev>
+ *
+ *                 <snap> is the offset of the snapshot header, <prev>
+ *                 the offset of the previous row record in the same
+ *                 index bucket (0 = none).
+ *
+ *   history.idx   Header plus HIST_BUCKETS 64-bit offsets: the latest
+ *                 row record for each serial number hash bucket. A
+ *                 lookup follows one bucket chain backwards instead of
+ *                 scanning the log.
+ *
+ *   history.last  The rows of the previous snapshot, sorted by ident,
+ *                 used to compute the next diff.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <sys/param.h>
+
+#include "drvlist.h"
+
+
+#define HIST_MAGIC    "DRVHIDX1"
+#define HIST_BUCKETS  16384
+#define HIST_HDRSIZE  16
+#define HIST_MAXLINE  4096
+
+
+char *f_history_dir = "/var/db/drvlist";
+
+
+typedef struct {
+    char *ident;
+    char *names;
+    char *phys;
+    char *vendor;
+    char *product;
+    char *revision;
+    char *line;		/* Allocation holding the fields above, if read from file */
+} HROW;
+
+
+static uint32_t
+hist_hash(const char *s) {
+    uint32_t h = 2166136261U;
+
+    while (*s)
+	h = (h ^ (uint8_t) *s++) * 16777619U;
+    return h % HIST_BUCKETS;
+}
+
+
+static void
+hist_path(char *buf,
+	  size_t size,
+	  const char *file) {
+    snprintf(buf, size, "%s/%s", f_history_dir, file);
+}
+
+
+/* Field value safe for the tab separated line format */
+static const char *
+hist_field(const char *s,
+	   char *buf,
+	   size_t size) {
+    size_t i;
+
+    if (s)
+	while (*s == ' ')
+	    ++s;
+    if (!s || !*s)
+	return "-";
+
+    for (i = 0; s[i] && i < size-1; i++)
+	buf[i] = (s[i] == '\t' || s[i] == '\n') ? ' ' : s[i];
+    while (i > 0 && buf[i-1] == ' ')
+	--i;
+    buf[i] = '\0';
+    return buf;
+}
+
+
+static int
+hrow_cmp(const void *a,
+	 const void *b) {
+    return strcmp(((const HROW *) a)->ident, ((const HROW *) b)->ident);
+}
+
+static int
+hrow_same(const HROW *a,
+	  const HROW *b) {
+    return strcmp(a->names, b->names) == 0 &&
+	strcmp(a->phys, b->phys) == 0 &&
+	strcmp(a->revision, b->revision) == 0;
+}
+
+
+/* Split a "ident\tnames\tphys\tvendor\tproduct\trev" line (in place) */
+static int
+hrow_parse(char *line,
+	   HROW *rp) {
+    char *fv[6];
+    int i;
+
+    for (i = 0; i < 6; i++) {
+	fv[i] = strsep(&line, "\t\n");
+	if (!fv[i])
+	    return -1;
+    }
+
+    rp->ident = fv[0];
+    rp->names = fv[1];
+    rp->phys = fv[2];
+    rp->vendor = fv[3];
+    rp->product = fv[4];
+    rp->revision = fv[5];
+    return 0;
+}
+
+
+static int
+hist_last_load(HROW **rvp,
+	       int *rcp) {
+    char path[MAXPATHLEN], buf[HIST_MAXLINE];
+    FILE *fp;
+    HROW *rv = NULL, *nrv;
+    int rc = 0;
+
+
+    *rvp = NULL;
+    *rcp = 0;
+
+    hist_path(path, sizeof(path), "history.last");
+    fp = fopen(path, "r");
+    if (!fp)
+	return errno == ENOENT ? 0 : -1;
+
+    while (fgets(buf, sizeof(buf), fp)) {
+	nrv = realloc(rv, (rc+1)*sizeof(HROW));
+	if (!nrv)
+	    break;
+	rv = nrv;
+	rv[rc].line = strdup(buf);
+	if (!rv[rc].line || hrow_parse(rv[rc].line, &rv[rc]) < 0) {
+	    free(rv[rc].line);
+	    continue;
+	}
+	++rc;
+    }
+
+    fclose(fp);
+    *rvp = rv;
+    *rcp = rc;
+    return 0;
+}
+
+
+static int
+hist_last_save(const HROW *rv,
+	       int rc) {
+    char path[MAXPATHLEN], tmp[MAXPATHLEN+8];
+    FILE *fp;
+    int i;
+
+    hist_path(path, sizeof(path), "history.last");
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+    fp = fopen(tmp, "w");
+    if (!fp)
+	return -1;
+
+    for (i = 0; i < rc; i++)
+	fprintf(fp, "%s\t%s\t%s\t%s\t%s\t%s\n",
+		rv[i].ident, rv[i].names, rv[i].phys,
+		rv[i].vendor, rv[i].product, rv[i].revision);
+
+    if (fclose(fp) != 0 || rename(tmp, path) < 0) {
+	unlink(tmp);
+	return -1;
+    }
+    return 0;
+}
+
+
+static int
+hist_idx_open(void) {
+    char path[MAXPATHLEN];
+    char hdr[HIST_HDRSIZE];
+    struct stat sb;
+    int fd;
+
+    hist_path(path, sizeof(path), "history.idx");
+    fd = open(path, O_RDWR|O_CREAT, 0644);
+    if (fd < 0)
+	return -1;
+
+    if (fstat(fd, &sb) < 0) {
+	close(fd);
+	return -1;
+    }
+
+    if (sb.st_size == 0) {
+	memset(hdr, 0, sizeof(hdr));
+	memcpy(hdr, HIST_MAGIC, 8);
+	if (pwrite(fd, hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+	    ftruncate(fd, HIST_HDRSIZE + HIST_BUCKETS*sizeof(uint64_t)) < 0) {
+	    close(fd);
+	    return -1;
+	}
+    } else if (pread(fd, hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+	       memcmp(hdr, HIST_MAGIC, 8) != 0) {
+	close(fd);
+	errno = EINVAL;
+	return -1;
+    }
+
+    return fd;
+}
+
+
+/*
+ * Append one row record and link it into its bucket of the in-memory
+ * copy of the index
+ */
+static int
+hist_append_row(int lfd,
+		uint64_t *idx,
+		off_t *offp,
+		off_t snap,
+		int event,
+		const HROW *rp) {
+    char line[HIST_MAXLINE];
+    uint64_t *bp = &idx[hist_hash(rp->ident)];
+    int n;
+
+    n = snprintf(line, sizeof(line), "R %llu %llu %c %s\t%s\t%s\t%s\t%s\t%s\n",
+		 (unsigned long long) *bp,
+		 (unsigned long long) snap,
+		 event,
+		 rp->ident, rp->names, rp->phys,
+		 rp->vendor, rp->product, rp->revision);
+    if (n >= (int) sizeof(line))
+	n = sizeof(line)-1;
+
+    if (pwrite(lfd, line, n, *offp) != n)
+	return -1;
+
+    *bp = *offp;
+    *offp += n;
+    return 0;
+}
+
+
+/*
+ * Record a snapshot of the current inventory. Only drives that were
+ * added, removed or changed since the previous snapshot are written.
+ *
+ * The rows are appended to the log first, then the index and finally
+ * history.last are replaced. If any step fails the log is truncated
+ * back and the old index restored, so that the next run computes the
+ * same diff again instead of logging it twice.
+ */
+int
+history_record(const DISK *dv,
+	       int dc) {
+    char path[MAXPATHLEN], host[MAXHOSTNAMELEN], line[256];
+    char bv[6][1024];
+    HROW *cur, *last = NULL;
+    uint64_t *idx = NULL, *oidx = NULL;
+    size_t isize = HIST_BUCKETS*sizeof(uint64_t);
+    int lc = 0, i, j, k, nchg = 0;
+    int lfd = -1, ifd = -1, rc = -1, err;
+    int logged = 0, indexed = 0;
+    struct stat sb;
+    off_t off, snap = 0;
+    ssize_t n;
+
+
+    if (mkdir(f_history_dir, 0755) < 0 && errno != EEXIST)
+	return -1;
+
+    cur = calloc(dc > 0 ? dc : 1, sizeof(HROW));
+    if (!cur)
+	return -1;
+
+    for (i = 0; i < dc; i++) {
+	const DISK *dp = &dv[i];
+
+	cur[i].ident = strdup(hist_field(dp->ident, bv[0], sizeof(bv[0])));
+	cur[i].names = strdup(hist_field(dp->danames, bv[1], sizeof(bv[1])));
+	cur[i].phys = strdup(hist_field(dp->phys, bv[2], sizeof(bv[2])));
+	cur[i].vendor = strdup(hist_field(dp->vendor, bv[3], sizeof(bv[3])));
+	cur[i].product = strdup(hist_field(dp->product, bv[4], sizeof(bv[4])));
+	cur[i].revision = strdup(hist_field(dp->revision, bv[5], sizeof(bv[5])));
+    }
+    qsort(cur, dc, sizeof(HROW), hrow_cmp);
+
+    hist_path(path, sizeof(path), "history.log");
+    lfd = open(path, O_WRONLY|O_CREAT, 0644);
+    if (lfd < 0)
+	goto End;
+    if (flock(lfd, LOCK_EX) < 0)
+	goto End;
+
+    ifd = hist_idx_open();
+    if (ifd < 0)
+	goto End;
+
+    idx = malloc(isize);
+    oidx = malloc(isize);
+    if (!idx || !oidx)
+	goto End;
+    if ((n = pread(ifd, oidx, isize, HIST_HDRSIZE)) != (ssize_t) isize) {
+	if (n >= 0)
+	    errno = EINVAL;
+	goto End;
+    }
+    memcpy(idx, oidx, isize);
+
+    if (hist_last_load(&last, &lc) < 0)
+	goto End;
+    qsort(last, lc, sizeof(HROW), hrow_cmp);
+
+    /* Count changes first so the header can be written before the rows */
+    for (i = j = 0; i < dc || j < lc; ) {
+	k = (i >= dc) ? 1 : (j >= lc) ? -1 : strcmp(cur[i].ident, last[j].ident);
+	if (k != 0 || !hrow_same(&cur[i], &last[j]))
+	    ++nchg;
+	if (k <= 0)
+	    ++i;
+	if (k >= 0)
+	    ++j;
+    }
+
+    if (nchg == 0) {
+	rc = 0;
+	goto End;
+    }
+
+    if (fstat(lfd, &sb) < 0)
+	goto End;
+    snap = off = sb.st_size;
+    logged = 1;
+
+    if (gethostname(host, sizeof(host)) < 0)
+	strcpy(host, "-");
+    k = snprintf(line, sizeof(line), "S %lld %s %d %d\n",
+		 (long long) time(NULL), host, dc, nchg);
+    if (pwrite(lfd, line, k, off) != k)
+	goto End;
+    off += k;
+
+    for (i = j = 0; i < dc || j < lc; ) {
+	k = (i >= dc) ? 1 : (j >= lc) ? -1 : strcmp(cur[i].ident, last[j].ident);
+	if (k < 0) {
+	    if (hist_append_row(lfd, idx, &off, snap, '+', &cur[i]) < 0)
+		goto End;
+	} else if (k > 0) {
+	    if (hist_append_row(lfd, idx, &off, snap, '-', &last[j]) < 0)
+		goto End;
+	} else if (!hrow_same(&cur[i], &last[j])) {
+	    if (hist_append_row(lfd, idx, &off, snap, '~', &cur[i]) < 0)
+		goto End;
+	}
+	if (k <= 0)
+	    ++i;
+	if (k >= 0)
+	    ++j;
+    }
+
+    if (fsync(lfd) < 0)
+	goto End;
+
+    indexed = 1;
+    if ((n = pwrite(ifd, idx, isize, HIST_HDRSIZE)) != (ssize_t) isize) {
+	if (n >= 0)
+	    errno = EIO;
+	goto End;
+    }
+    if (fsync(ifd) < 0 || hist_last_save(cur, dc) < 0)
+	goto End;
+
+    rc = 0;
+
+ End:
+    if (rc < 0) {
+	err = errno;
+	if (indexed)
+	    (void) pwrite(ifd, oidx, isize, HIST_HDRSIZE);
+	if (logged)
+	    (void) ftruncate(lfd, snap);
+	errno = err;
+    }
+    free(idx);
+    free(oidx);
+    if (ifd >= 0)
+	close(ifd);
+    if (lfd >= 0)
+	close(lfd);
+    for (i = 0; i < dc; i++) {
+	free(cur[i].ident);
+	free(cur[i].names);
+	free(cur[i].phys);
+	free(cur[i].vendor);
+	free(cur[i].product);
+	free(cur[i].revision);
+    }
+    free(cur);
+    for (i = 0; i < lc; i++)
+	free(last[i].line);
+    free(last);
+    return rc;
+}
+
+
+/* Read the line starting at 'off' */
+static int
+hist_readline(int fd,
+	      off_t off,
+	      char *buf,
+	      size_t size) {
+    ssize_t n;
+    char *cp;
+
+    n = pread(fd, buf, size-1, off);
+    if (n <= 0)
+	return -1;
+    buf[n] = '\0';
+
+    cp = strchr(buf, '\n');
+    if (!cp)
+	return -1;
+    *cp = '\0';
+    return 0;
+}
+
+
+typedef struct {
+    long long time;
+    char host[MAXHOSTNAMELEN];
+    int event;
+    HROW row;
+    char line[HIST_MAXLINE];
+} HEVENT;
+
+
+/*
+ * Print the timeline for one serial number: when it appeared, moved
+ * (names or slot changed) and disappeared, and on which hosts.
+ */
+int
+history_query(const char *serial,
+	      FILE *out) {
+    char path[MAXPATHLEN], buf[HIST_MAXLINE];
+    int lfd, ifd;
+    uint64_t off = 0;
+    HEVENT *ev = NULL, *nev;
+    int ec = 0, i, j;
+    char **hosts = NULL;
+    int hc = 0;
+
+
+    hist_path(path, sizeof(path), "history.log");
+    lfd = open(path, O_RDONLY);
+    if (lfd < 0)
+	return -1;
+
+    hist_path(path, sizeof(path), "history.idx");
+    ifd = open(path, O_RDONLY);
+    if (ifd < 0) {
+	close(lfd);
+	return -1;
+    }
+
+    if (pread(ifd, &off, sizeof(off),
+	      HIST_HDRSIZE + (off_t) hist_hash(serial)*sizeof(uint64_t)) != sizeof(off))
+	off = 0;
+
+    /* Walk the bucket chain backwards in time */
+    while (off > 0) {
+	unsigned long long prev, snap;
+	char event;
+	int n;
+
+	if (hist_readline(lfd, off, buf, sizeof(buf)) < 0 ||
+	    sscanf(buf, "R %llu %llu %c %n", &prev, &snap, &event, &n) != 3)
+	    break;
+
+	if (strncmp(buf+n, serial, strlen(serial)) == 0 && buf[n+strlen(serial)] == '\t') {
+	    nev = realloc(ev, (ec+1)*sizeof(HEVENT));
+	    if (!nev)
+		break;
+	    ev = nev;
+	    memset(&ev[ec], 0, sizeof(HEVENT));
+	    ev[ec].event = event;
+	    strcpy(ev[ec].line, buf+n);
+	    hrow_parse(ev[ec].line, &ev[ec].row);
+
+	    if (hist_readline(lfd, snap, buf, sizeof(buf)) == 0)
+		sscanf(buf, "S %lld %255s", &ev[ec].time, ev[ec].host);
+	    ++ec;
+	}
+
+	if (prev >= off)
+	    break;
+	off = prev;
+    }
+
+    close(ifd);
+    close(lfd);
+
+    if (ec == 0) {
+	free(ev);
+	return 1;
+    }
+
+    for (i = ec-1; i >= 0; i--) {
+	char tbuf[64];
+	time_t t = (time_t) ev[i].time;
+	const HEVENT *ep = &ev[i];
+
+	strftime(tbuf, sizeof(tbuf), "%Y-%m-%d %H:%M:%S", localtime(&t));
+	fprintf(out, "%s : %s : %-7s : %s : %s : %s %s %s\n",
+		tbuf, ep->host,
+		ep->event == '+' ? "added" : ep->event == '-' ? "removed" : "changed",
+		ep->row.names, ep->row.phys,
+		ep->row.vendor, ep->row.product, ep->row.revision);
+
+	for (j = 0; j < hc && strcmp(hosts[j], ep->host); j++)
+	    ;
+	if (j == hc) {
+	    char **nh = realloc(hosts, (hc+1)*sizeof(char *));
+	    if (nh) {
+		hosts = nh;
+		hosts[hc++] = (char *) ep->host;
+	    }
+	}
+    }
+
+    fprintf(out, "Hosts:");
+    for (j = 0; j < hc; j++)
+	fprintf(out, " %s", hosts[j]);
+    fputc('\n', out);
+
+    free(hosts);
+    free(ev);
+    return 0;
+}
@@ -0,0 +1,792 @@
+/*
+ * libdrvlist.c
+ *
+ * Drive enumeration library behind the drvlist utility.
+ *
+ * Copyright (c) 2024 Peter Eriksson <pen@lysator.liu.se>
+ *
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/ioctl.h>
+#include <sys/sysctl.h>
+#include <sys/disk.h>
+#include <sys/stat.h>
+#include <camlib.h>
+#include <cam/scsi/scsi_message.h>
+#include <cam/ata/ata_all.h>
+#include <cam/mmc/mmc_all.h>
+#include <dev/nvme/nvme.h>
+
+#include "libdrvlist.h"
+
+
+#define STRBLOCK_SIZE  (16*1024)
+
+/* Block of the context's string arena */
+typedef struct strblock {
+    struct strblock *next;
+    size_t len;
+    size_t size;
+    char buf[];
+} STRBLOCK;
+
+/*
+ * All enumeration state lives in the context, so separate contexts
+ * may be used from different threads at the same time.
+ */
+struct drvlist {
+    DRVLIST_OPTS o;
+    DISK *dv;
+    int dc;
+    int ds;
+    STRBLOCK *strs;		/* Path strings, freed with the context */
+    int stop;			/* Event callback asked to stop */
+    int tail;			/* Every wanted drive found, only merge more paths */
+    char *errdev;
+
+    /* Current probe */
+    int quick;			/* Skip ATA identify */
+    const char *stage;		/* Step that failed, if the probe fails */
+    const char *soft;		/* Step that failed without failing the probe */
+    int softerr;
+};
+
+
+/* Drive wanted by the caller? */
+static int
+drv_want(DRVLIST *ctx,
+	 const char *serial,
+	 size_t len) {
+    return !ctx->o.want || ctx->o.want(serial, len, ctx->o.arg);
+}
+
+
+/* Copy a string into the context's arena */
+static char *
+ctx_strdup(DRVLIST *ctx,
+	   const char *s) {
+    size_t len = strlen(s)+1;
+    STRBLOCK *bp = ctx->strs;
+    char *cp;
+
+    if (!bp || bp->len+len > bp->size) {
+	size_t size = len > STRBLOCK_SIZE ? len : STRBLOCK_SIZE;
+
+	bp = malloc(sizeof(*bp)+size);
+	if (!bp)
+	    return NULL;
+	bp->next = ctx->strs;
+	bp->len = 0;
+	bp->size = size;
+	ctx->strs = bp;
+    }
+
+    cp = bp->buf+bp->len;
+    memcpy(cp, s, len);
+    bp->len += len;
+    return cp;
+}
+
+/*
+ * Add a path to a drive and report it to the event callback, as a new
+ * drive for its first path or else as merged into an existing one
+ */
+static int
+disk_add_path(DRVLIST *ctx,
+	      DISK *dp,
+	      const char *name,
+	      const char *ctrl,
+	      const char *path) {
+    DPATH *pp;
+    int ev;
+
+    pp = realloc(dp->pv, (dp->pc+1)*sizeof(DPATH));
+    if (!pp)
+	return -1;
+    dp->pv = pp;
+
+    pp = &dp->pv[dp->pc];
+    pp->name = ctx_strdup(ctx, name);
+    pp->ctrl = ctrl ? ctx_strdup(ctx, ctrl) : NULL;
+    pp->path = path ? ctx_strdup(ctx, path) : NULL;
+    if (!pp->name || (ctrl && !pp->ctrl) || (path && !pp->path))
+	return -1;
+
+    ev = dp->pc++ ? DRVLIST_EV_MERGE : DRVLIST_EV_PATH;
+
+    if (ctx->o.event &&
+	ctx->o.event(ev, dp - ctx->dv, dp, pp, ctx->o.arg) != 0)
+	ctx->stop = 1;
+    return 0;
+}
+
+static int
+ata_cam_send(struct cam_device *device, union ccb *ccb)
+{
+	/* Disable freezing the device queue */
+	ccb->ccb_h.flags |= CAM_DEV_QFRZDIS;
+
+
+	if (cam_send_ccb(device, ccb) < 0) {
+		return (1);
+	}
+
+	/*
+	 * Consider any non-CAM_REQ_CMP status as error and report it here,
+	 * unless caller set AP_FLAG_CHK_COND, in which case it is responsible.
+	 */
+	if (!(ccb->ataio.cmd.flags & CAM_ATAIO_NEEDRESULT) &&
+	    (ccb->ccb_h.status & CAM_STATUS_MASK) != CAM_REQ_CMP) {
+		return (1);
+	}
+
+	return (0);
+}
+
+
+static int
+ata_do_cmd(struct cam_device *device, union ccb *ccb, int retries,
+	   uint32_t flags, uint8_t protocol, uint8_t ata_flags,
+	   uint8_t tag_action, uint8_t command, uint16_t features,
+	   u_int64_t lba, uint16_t sector_count, uint8_t *data_ptr,
+	   uint16_t dxfer_len, int timeout, int force48bit)
+{
+	CCB_CLEAR_ALL_EXCEPT_HDR(&ccb->ataio);
+	cam_fill_ataio(&ccb->ataio,
+		       retries,
+		       NULL,
+		       flags,
+		       tag_action,
+		       data_ptr,
+		       dxfer_len,
+		       timeout);
+
+	if (force48bit || lba > ATA_MAX_28BIT_LBA)
+		ata_48bit_cmd(&ccb->ataio, command, features, lba, sector_count);
+	else
+		ata_28bit_cmd(&ccb->ataio, command, features, lba, sector_count);
+
+	if (ata_flags & AP_FLAG_CHK_COND)
+		ccb->ataio.cmd.flags |= CAM_ATAIO_NEEDRESULT;
+
+	return ata_cam_send(device, ccb);
+}
+
+static int
+ata_identify(struct cam_device *cdb,
+	     DISK *dp) {
+    union ccb *ccb;
+    struct ata_params apb;
+    u_int error;
+    uint8_t command, retry_command;
+    
+    
+    if ((ccb = cam_getccb(cdb)) == NULL) {
+	return -1;
+    }
+
+    command = ATA_ATA_IDENTIFY;
+    retry_command = ATA_ATAPI_IDENTIFY;
+    
+ retry:
+    error = ata_do_cmd(cdb,
+		       ccb,
+		       1, /*retries*/
+		       CAM_DIR_IN, /*flags*/
+		       AP_PROTO_PIO_IN, /*protocol*/
+		       AP_FLAG_BYT_BLOK_BLOCKS | AP_FLAG_TLEN_SECT_CNT, /*ata_flags*/
+		       MSG_SIMPLE_Q_TAG, /*tag_action*/
+		       command, /*command*/
+		       0, /*features*/
+		       0, /*lba*/
+		       sizeof(struct ata_params) / 512, /*sector_count*/
+		       (uint8_t *)&apb, /*data_ptr*/
+		       sizeof(apb), /*dxfer_len*/
+		       30000, /* timeout */
+		       0 /*force48bit*/);
+    
+    if (error != 0) {
+	if (retry_command != 0) {
+	    command = retry_command;
+	    retry_command = 0;
+	    goto retry;
+	}
+	cam_freeccb(ccb);
+	return (1);
+    }
+    
+    ata_param_fixup(&apb);
+    cam_freeccb(ccb);
+    
+    /* check for invalid (all zero) response */
+    if (drvlist_allzero(&apb, sizeof(apb)))
+	return (1);
+    
+    DISK_SETSTR(dp, vendor, "ATA", 3, 0);
+    DISK_SETSTR(dp, product, (char *) apb.model, sizeof(apb.model), 1);
+    DISK_SETSTR(dp, revision, (char *) apb.revision, sizeof(apb.revision), 1);
+    return 0;
+}
+
+
+
+static int
+nvme_identify(DRVLIST *ctx,
+	      int fd,
+	      const char *daname,
+	      const char *driver,
+	      const char *ctrl,
+	      const char *pnbuf) {
+    struct nvme_pt_command pt;
+    struct nvme_controller_data cdata;
+    char ident[NVME_SERIAL_NUMBER_LENGTH+1];
+    char vendor[DRV_VENDORSIZE], product[DRV_PRODUCTSIZE];
+    DISK *dp;
+    u_char len;
+    int i;
+    char pbuf[MAXPATHLEN];
+    
+    
+    memset(&pt, 0, sizeof(pt));
+    memset(&cdata, 0, sizeof(cdata));
+    
+    pt.cmd.opc = NVME_OPC_IDENTIFY;
+    pt.cmd.cdw10 = htole32(1);
+    pt.buf = &cdata;
+    pt.len = sizeof(cdata);
+    pt.is_read = 1;
+    
+    if (ioctl(fd, NVME_PASSTHROUGH_CMD, &pt) < 0)
+	return -1;
+	
+    if (nvme_completion_is_error(&pt.cpl)) {
+	errno = EIO;
+	return -1;
+    }
+	
+    drvlist_setstr(ident, sizeof(ident), &len,
+		   (const char *) cdata.sn, NVME_SERIAL_NUMBER_LENGTH, 1);
+
+    if (!drv_want(ctx, ident, NVME_SERIAL_NUMBER_LENGTH))
+	return 0;
+    
+    for (i = 0; i < ctx->dc && strcmp(ctx->dv[i].ident, ident); i++)
+	;
+    
+    dp = &ctx->dv[i];
+    
+    if (i >= ctx->dc) {
+	DISK_SETSTR(dp, vendor, (const char *) cdata.mn, NVME_MODEL_NUMBER_LENGTH, 1);
+	if (drvlist_vendor_normalize(dp->vendor, vendor, sizeof(vendor), product, sizeof(product)) > 0) {
+	    DISK_SETSTR(dp, vendor, vendor, sizeof(vendor), 0);
+	    DISK_SETSTR(dp, product, product, sizeof(product), 0);
+	}
+
+	if (!pnbuf) {
+	    sprintf(pbuf, "pci vendor 0x%04x:0x%04x oui %02x:%02x:%02x controller 0x%04x",
+		    cdata.vid, cdata.ssvid,
+		    cdata.ieee[0], cdata.ieee[1], cdata.ieee[2],
+		    cdata.ctrlr_id);
+	    pnbuf = pbuf;
+	}
+
+	DISK_SETSTR(dp, revision, (const char *) cdata.fr, NVME_FIRMWARE_REVISION_LENGTH, 1);
+	DISK_SETSTR(dp, ident, ident, len, 0);
+	dp->danames = strdup(daname);
+	dp->driver = strdup(driver);
+	dp->path = strdup(pnbuf);
+	dp->phys = NULL;
+	disk_add_path(ctx, dp, daname, ctrl, pnbuf);
+	++ctx->dc;
+	return 1;
+    }
+    
+    drvlist_strdupcat(&dp->danames, daname);
+    drvlist_strdupcat(&dp->driver, driver);
+    drvlist_strdupcat(&dp->path, pnbuf);
+    disk_add_path(ctx, dp, daname, ctrl, pnbuf);
+    return 0;
+}
+
+
+/* Note a failed step that did not stop the drive from being listed */
+static void
+drv_soft(DRVLIST *ctx,
+	 const char *stage,
+	 int err) {
+    if (!ctx->soft) {
+	ctx->soft = stage;
+	ctx->softerr = err;
+    }
+}
+
+
+static int
+drv_probe(DRVLIST *ctx,
+	  const char *daname) {
+    int fd, id, i;
+    struct cam_device *cam;
+    DISK *dp;
+    char path[2048];
+    char idbuf[DISK_IDENT_SIZE];
+    char vendor[DRV_VENDORSIZE], product[DRV_PRODUCTSIZE];
+    u_char len;
+    char pnbuf[MAXPATHLEN];
+    char drvbuf[MAXPATHLEN];
+    char ctrlbuf[64];
+    char physbuf[MAXPATHLEN];
+    off_t msize = 0;
+
+    
+    if (ctx->dc >= ctx->ds) {
+	ctx->dv = realloc(ctx->dv, (ctx->ds + 1024)*sizeof(DISK));
+	if (!ctx->dv)
+	    return -1;
+	memset(&ctx->dv[ctx->ds], 0, 1024*sizeof(DISK));
+	ctx->ds += 1024;
+    }
+
+    if (strncmp(daname, "/dev/", 5) == 0) {
+	strcpy(path, daname);
+	daname = path+5;
+    } else {
+	strcpy(path, "/dev/");
+	strcpy(path+5, daname);
+    }
+
+    /* The media size is only needed for new drives */
+    if (!ctx->tail &&
+	(!ctx->o.mediasize || ctx->o.mediasize(daname, &msize, ctx->o.arg) < 0)) {
+	int fd;
+	
+	fd = open(path, O_RDONLY);
+	if (fd >= 0 && ioctl(fd, DIOCGMEDIASIZE, &msize) >= 0) {
+	    if (ctx->o.debug) {
+		char sbuf[DRV_SIZESIZE];
+
+		drvlist_size2buf(msize, sbuf, sizeof(sbuf));
+		fprintf(stderr, "*** path=%s msize=%s (%lu)\n", path, sbuf, msize);
+	    }
+	}
+	close(fd);
+    }    
+    
+    cam = cam_open_device(path, O_RDWR);
+    if (cam) {
+	if (ctx->o.debug) {
+	    fprintf(stderr, "*** path=%s dev=%s%u pass=%s%u\n",
+		    path,
+		    cam->given_dev_name,
+		    cam->given_unit_number,
+		    cam->device_name,
+		    cam->dev_unit_num);
+	}
+
+	/* Skip unwanted drives before sending any commands to them */
+	if (!drv_want(ctx, (char *) &cam->serial_num[0], cam->serial_num_len)) {
+	    cam_close_device(cam);
+	    return 0;
+	}
+
+	physbuf[0] = '\0';
+	if (ctx->o.phys) {
+	    int fd = open(path, O_RDONLY);
+	    
+	    if (fd >= 0) {
+		ioctl(fd, DIOCGPHYSPATH, physbuf);
+		close(fd);
+	    }
+	}
+	
+	drvlist_setstr(idbuf, sizeof(idbuf), &len,
+		       (char *) &cam->serial_num[0], cam->serial_num_len, 0);
+	
+	for (i = 0; i < ctx->dc && strcmp(ctx->dv[i].ident, idbuf); i++)
+	    ;
+	dp = &ctx->dv[i];
+	
+	sprintf(ctrlbuf, "%s%u",
+		cam->sim_name, cam->sim_unit_number);
+	if (ctx->o.verbose > 1)
+	    snprintf(drvbuf, sizeof(drvbuf), "%s @ bus %u",
+		     ctrlbuf, cam->bus_id);
+	else
+	    strcpy(drvbuf, ctrlbuf);
+	
+	sprintf(pnbuf, "scbus %2u target %3u lun %2jx",
+		cam->path_id,
+		cam->target_id,
+		cam->target_lun);
+	
+	if (sscanf(daname, "nda%u", &id) == 1) {
+	    sprintf(path+5, "nvme%d", id);
+	    
+	    fd = open(path, O_RDONLY);
+	    if (fd < 0 || nvme_identify(ctx, fd, daname, drvbuf, ctrlbuf, pnbuf) < 0)
+		drv_soft(ctx, "nvme-identify", errno);
+	    close(fd);
+	} else {
+	    /* Only for a new drive - a further path keeps what was found */
+	    if (!ctx->quick && !ctx->tail && i >= ctx->dc &&
+		sscanf(daname, "ada%u", &id) == 1) {
+		if (ata_identify(cam, dp) != 0)
+		    drv_soft(ctx, "ata-identify", EIO);
+	    }
+	    if (i >= ctx->dc) {
+		DISK_SETSTR(dp, ident, idbuf, len, 0);
+		
+		if (!dp->vendor[0])
+		    DISK_SETSTR(dp, vendor, cam->inq_data.vendor, sizeof(cam->inq_data.vendor), 1);
+		if (!dp->product[0])
+		    DISK_SETSTR(dp, product, cam->inq_data.product, sizeof(cam->inq_data.product), 1);
+		if (!dp->revision[0])
+		    DISK_SETSTR(dp, revision, cam->inq_data.revision, sizeof(cam->inq_data.revision), 1);
+
+		if (dp->vendor[0] && dp->product[0] &&
+		    (strcmp(dp->vendor, "ATA") == 0 || strcmp(dp->vendor, "USB") == 0) &&
+		    drvlist_vendor_normalize(dp->product, vendor, sizeof(vendor), product, sizeof(product)) > 0) {
+		    DISK_SETSTR(dp, vendor, vendor, sizeof(vendor), 0);
+		    DISK_SETSTR(dp, product, product, sizeof(product), 0);
+		}
+		
+		dp->danames = strdup(daname);
+		dp->phys = strdup(physbuf);
+		dp->driver = strdup(drvbuf);
+		dp->path = strdup(pnbuf);
+		dp->msize = msize;
+		if (msize > 0)
+		    dp->sizelen = drvlist_size2buf(msize, dp->size, sizeof(dp->size));
+		ctx->dc++;
+	    } else {
+		drvlist_strdupcat(&dp->danames, daname);
+		drvlist_strdupcat(&dp->path, pnbuf);
+		drvlist_strdupcat(&dp->driver, drvbuf);
+	    }
+	    disk_add_path(ctx, dp, daname, ctrlbuf, pnbuf);
+	}
+	
+	cam_close_device(cam);
+	return 0;
+    }
+
+    /* Only CAM devices can be further paths of a drive already found */
+    if (ctx->tail)
+	return 0;
+
+    if (sscanf(daname, "nvd%d", &id) == 1) {
+	/* DIOCGIDENT on nvd is much cheaper than an NVMe identify */
+	if (ctx->o.want) {
+	    ctx->stage = "open";
+	    fd = open(path, O_RDONLY);
+	    if (fd < 0)
+		return -1;
+	    memset(idbuf, 0, sizeof(idbuf));
+	    if (ioctl(fd, DIOCGIDENT, idbuf) >= 0 &&
+		!drv_want(ctx, idbuf, sizeof(idbuf))) {
+		close(fd);
+		return 0;
+	    }
+	    close(fd);
+	}
+	sprintf(path+5, "nvme%d", id);
+    }
+    
+    
+    /* Non-CAM */
+    ctx->stage = "open";
+    fd = open(path, O_RDONLY|O_DIRECT, 0);
+    if (fd < 0)
+	return -1;
+    
+    if (strncmp(daname, "nvd", 3) == 0) {
+	ctx->stage = "nvme-identify";
+	if (nvme_identify(ctx, fd, daname, path+5, path+5, NULL) < 0) {
+	    int err = errno;
+
+	    close(fd);
+	    errno = err;
+	    return 1;
+	}
+	close(fd);
+	return 0;
+    }
+
+    ctx->stage = "ident";
+    memset(idbuf, 0, sizeof(idbuf));
+    if (ioctl(fd, DIOCGIDENT, idbuf) < 0) {
+	close(fd);
+	errno = ENXIO;
+	return 1;
+    }
+    idbuf[sizeof(idbuf)-1] = '\0';
+
+    if (!drv_want(ctx, idbuf, sizeof(idbuf))) {
+	close(fd);
+	return 0;
+    }
+
+    physbuf[0] = '\0';
+    if (ctx->o.phys)
+	(void) ioctl(fd, DIOCGPHYSPATH, physbuf);
+    
+    for (i = 0; i < ctx->dc && strcmp(ctx->dv[i].ident, idbuf); i++)
+	;
+    dp = &ctx->dv[i];
+    
+    if (i >= ctx->dc) {
+	DISK_SETSTR(dp, ident, idbuf, sizeof(idbuf), 0);
+	dp->danames = strdup(daname);
+	dp->phys = strdup(physbuf);
+	dp->msize = msize;
+	if (msize > 0)
+	    dp->sizelen = drvlist_size2buf(msize, dp->size, sizeof(dp->size));
+	++ctx->dc;
+    } else {
+	drvlist_strdupcat(&dp->danames, daname);
+    }
+    disk_add_path(ctx, dp, daname, NULL, NULL);
+    
+    close(fd);
+    return 0;
+}
+
+
+int
+drvlist_add(DRVLIST *ctx,
+	    const char *name) {
+    int rc, err, how = DRVLIST_PROBE_ALL;
+
+    if (ctx->o.probe) {
+	how = ctx->o.probe(name, ctx->o.arg);
+	if (how == DRVLIST_PROBE_SKIP)
+	    return 0;
+    }
+
+    ctx->quick = (how == DRVLIST_PROBE_QUICK);
+    ctx->stage = "probe";
+    ctx->soft = NULL;
+    ctx->softerr = 0;
+
+    rc = drv_probe(ctx, name);
+
+    if (ctx->o.result) {
+	err = errno;
+	if (rc != 0)
+	    ctx->o.result(name, rc, ctx->stage, err, ctx->o.arg);
+	else
+	    ctx->o.result(name, rc, ctx->soft, ctx->softerr, ctx->o.arg);
+	errno = err;
+    }
+    return rc;
+}
+
+
+DRVLIST *
+drvlist_create(const DRVLIST_OPTS *opts) {
+    DRVLIST *ctx;
+
+    ctx = calloc(1, sizeof(*ctx));
+    if (!ctx)
+	return NULL;
+
+    if (opts)
+	ctx->o = *opts;
+    return ctx;
+}
+
+
+static void
+disk_free(DISK *dp) {
+    free(dp->pv);
+    free(dp->danames);
+    free(dp->driver);
+    free(dp->path);
+    free(dp->phys);
+    free(dp->lat_p50);
+    free(dp->lat_p99);
+    free(dp->lat_p999);
+    free(dp->fwwant);
+    free(dp->zpool);
+    free(dp->zguid);
+    free(dp->parts);
+    free(dp->labels);
+    free(dp->mpath);
+}
+
+void
+drvlist_destroy(DRVLIST *ctx) {
+    int i;
+
+    if (!ctx)
+	return;
+
+    for (i = 0; i < ctx->dc; i++)
+	disk_free(&ctx->dv[i]);
+    free(ctx->dv);
+    while (ctx->strs) {
+	STRBLOCK *bp = ctx->strs;
+
+	ctx->strs = bp->next;
+	free(bp);
+    }
+    free(ctx->errdev);
+    free(ctx);
+}
+
+
+static int
+drv_add_one(DRVLIST *ctx,
+	    const char *name) {
+    int rc;
+
+    rc = drvlist_add(ctx, name);
+    if (rc < 0) {
+	int err = errno;
+
+	free(ctx->errdev);
+	ctx->errdev = strdup(name);
+	errno = err;
+	return -1;
+    }
+    if (rc > 0 && ctx->o.skipped)
+	ctx->o.skipped(name, ctx->o.arg);
+    return 0;
+}
+
+/*
+ * Once the caller has every drive it wants the rest of the devices are
+ * still looked at, but only through CAM: its identification data is
+ * cached by the kernel, so no command is sent to unwanted drives and
+ * the other paths of a multipath drive are still merged.
+ */
+static int
+drv_done(DRVLIST *ctx) {
+    if (!ctx->tail && ctx->o.done && ctx->o.done(ctx->o.arg))
+	ctx->tail = 1;
+    return ctx->stop;
+}
+
+
+/* No more paths can show up - report every drive as final */
+static void
+drv_final(DRVLIST *ctx) {
+    int i;
+
+    if (!ctx->o.event)
+	return;
+
+    for (i = 0; i < ctx->dc && !ctx->stop; i++)
+	if (ctx->o.event(DRVLIST_EV_DISK, i, &ctx->dv[i], NULL, ctx->o.arg) != 0)
+	    ctx->stop = 1;
+}
+
+int
+drvlist_enumerate(DRVLIST *ctx,
+		  char **devv,
+		  int devc) {
+    char *buf, *bp, *name;
+    size_t bsize = 0;
+    int i, rc = 0;
+
+
+    free(ctx->errdev);
+    ctx->errdev = NULL;
+    ctx->stop = 0;
+    ctx->tail = 0;
+
+    if (devc > 0) {
+	for (i = 0; i < devc && !drv_done(ctx); i++)
+	    if (drv_add_one(ctx, devv[i]) < 0)
+		return -1;
+	drv_final(ctx);
+	return 0;
+    }
+
+    if (sysctlbyname("kern.disks", NULL, &bsize, NULL, 0) < 0)
+	return -1;
+
+    buf = malloc(bsize);
+    if (!buf)
+	return -1;
+
+    if (sysctlbyname("kern.disks", buf, &bsize, NULL, 0) < 0) {
+	free(buf);
+	return -1;
+    }
+
+    bp = buf;
+    while (!drv_done(ctx) && (name = strsep(&bp, " ")) != NULL) {
+	if (!*name)
+	    continue;
+	if (drv_add_one(ctx, name) < 0) {
+	    rc = -1;
+	    break;
+	}
+    }
+
+    free(buf);
+    if (rc == 0)
+	drv_final(ctx);
+    return rc;
+}
+
+
+const char *
+drvlist_errdev(const DRVLIST *ctx) {
+    return ctx->errdev;
+}
+
+int
+drvlist_count(const DRVLIST *ctx) {
+    return ctx->dc;
+}
+
+DISK *
+drvlist_disks(DRVLIST *ctx,
+	      int *dc) {
+    if (dc)
+	*dc = ctx->dc;
+    return ctx->dv;
+}
+
+DISK *
+drvlist_next(DRVLIST *ctx,
+	     const DISK *dp) {
+    int i = dp ? dp - ctx->dv + 1 : 0;
+
+    return i < ctx->dc ? &ctx->dv[i] : NULL;
+}
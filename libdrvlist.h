@@ -0,0 +1,351 @@
+/*
+ * libdrvlist.h
+ *
+ * Public interface of the drvlist drive enumeration library.
+ *
+ * Copyright (c) 2024 Peter Eriksson <pen@lysator.liu.se>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LIBDRVLIST_H
+#define LIBDRVLIST_H 1
+
+#include <stddef.h>
+#include <sys/types.h>
+
+
+/*
+ * One path (device node) to a drive. The strings are carved from one
+ * arena in the context and freed by drvlist_destroy().
+ */
+typedef struct {
+    char *name;
+    char *ctrl;
+    char *path;
+} DPATH;
+
+/*
+ * Sizes (including the NUL) of the inline identification strings. They
+ * are large enough for what CAM, ATA and NVMe report (serial numbers up
+ * to DISK_IDENT_SIZE, 40 character ATA/NVMe models, 8 character firmware
+ * revisions); longer values are truncated.
+ */
+#define DRV_IDENTSIZE    256
+#define DRV_VENDORSIZE   48
+#define DRV_PRODUCTSIZE  48
+#define DRV_REVSIZE      16
+#define DRV_SIZESIZE     8
+
+/*
+ * One drive. The fixed size identification strings are stored inline
+ * ("" if unknown) with their lengths, so a probe result is a single
+ * allocation-free record. Lists that grow with the number of paths
+ * (danames, driver, path) and the optional columns are allocated.
+ */
+typedef struct {
+    char ident[DRV_IDENTSIZE];
+    char vendor[DRV_VENDORSIZE];
+    char product[DRV_PRODUCTSIZE];
+    char revision[DRV_REVSIZE];
+    char size[DRV_SIZESIZE];
+    u_char identlen;
+    u_char vendorlen;
+    u_char productlen;
+    u_char revisionlen;
+    u_char sizelen;
+    off_t msize;
+    u_int sectorsize;
+
+    char *danames;
+    char *driver;
+    char *path;
+    char *phys;
+
+    /* Individual paths, in discovery order */
+    DPATH *pv;
+    int pc;
+
+    /* Random read latency percentiles (--bench-rand) */
+    char *lat_p50;
+    char *lat_p99;
+    char *lat_p999;
+
+    /* Firmware catalog status (--catalog) */
+    const char *fwstat;
+    char *fwwant;
+
+    /* ZFS pool membership and vdev GUID(s) from on-disk labels (-z) */
+    char *zpool;
+    char *zguid;
+
+    /* GEOM partitions, labels and gmultipath name (-g) */
+    char *parts;
+    char *labels;
+    char *mpath;
+} DISK;
+
+
+/* Enumeration events */
+#define DRVLIST_EV_PATH   1	/* First path to a new drive */
+#define DRVLIST_EV_MERGE  2	/* Another path to an already seen drive */
+#define DRVLIST_EV_DISK   3	/* Drive is final (enumeration done), no path */
+
+/* Return values for the probe callback */
+#define DRVLIST_PROBE_SKIP   0	/* Do not touch the device */
+#define DRVLIST_PROBE_ALL    1	/* Normal probe */
+#define DRVLIST_PROBE_QUICK  2	/* No ATA IDENTIFY, use the CAM inquiry data */
+
+/*
+ * Enumeration options. All callbacks are optional and get 'arg' as
+ * their last argument.
+ */
+typedef struct {
+    int verbose;		/* >1: add the bus number to controller names */
+    int debug;			/* Trace to stderr */
+    int phys;			/* Get physical paths (DIOCGPHYSPATH) */
+
+    /* Return 0 to skip a drive before any command is sent to it */
+    int (*want)(const char *serial, size_t len, void *arg);
+
+    /*
+     * Return 1 when every wanted drive has been found. The remaining
+     * devices are then only checked for more paths of those drives,
+     * through CAM and without sending commands to them
+     */
+    int (*done)(void *arg);
+
+    /* Media size lookup, return <0 to fall back to DIOCGMEDIASIZE */
+    int (*mediasize)(const char *name, off_t *msize, void *arg);
+
+    /* Called for devices that could not be identified, with errno set */
+    void (*skipped)(const char *name, void *arg);
+
+    /* Called before a device is opened, returns DRVLIST_PROBE_* */
+    int (*probe)(const char *name, void *arg);
+
+    /*
+     * Called after each device: 'rc' as from drvlist_add(), 'stage'
+     * the step that failed (also for failures that did not stop the
+     * drive from being listed) or NULL, and 'err' its errno
+     */
+    void (*result)(const char *name, int rc, const char *stage, int err, void *arg);
+
+    /*
+     * Called for every path as it is found and for every drive when
+     * the enumeration is done. 'idx' is the drive's position in
+     * drvlist_disks() and stays valid; 'dp' and 'pp' only until the
+     * next device is probed. Return non-zero to stop the enumeration.
+     */
+    int (*event)(int ev, int idx, const DISK *dp, const DPATH *pp, void *arg);
+
+    void *arg;
+} DRVLIST_OPTS;
+
+/* Enumeration context - one per thread or enumeration */
+typedef struct drvlist DRVLIST;
+
+
+extern DRVLIST *
+drvlist_create(const DRVLIST_OPTS *opts);
+
+extern void
+drvlist_destroy(DRVLIST *ctx);
+
+/*
+ * Probe the given devices (names or /dev paths), or all drives known
+ * to the kernel if devc is 0. Returns 0, or -1 with errno set (and
+ * drvlist_errdev() naming the device, if any).
+ */
+extern int
+drvlist_enumerate(DRVLIST *ctx,
+		  char **devv,
+		  int devc);
+
+/* Probe one device. Returns 0, 1 if skipped or -1 on error */
+extern int
+drvlist_add(DRVLIST *ctx,
+	    const char *device);
+
+extern const char *
+drvlist_errdev(const DRVLIST *ctx);
+
+/* Drives found so far, in discovery order */
+extern int
+drvlist_count(const DRVLIST *ctx);
+
+extern DISK *
+drvlist_disks(DRVLIST *ctx,
+	      int *dc);
+
+/* Iterate: dp = drvlist_next(ctx, NULL); dp; dp = drvlist_next(ctx, dp) */
+extern DISK *
+drvlist_next(DRVLIST *ctx,
+	     const DISK *dp);
+
+
+/*
+ * Compact serialized drive tables (table.c). The path lists of decoded
+ * drives point into the buffer; *dvp is grown as needed and *dsp is
+ * its size.
+ */
+extern int
+drvlist_encode(const DISK *dv,
+	       int dc,
+	       char **bufp,
+	       size_t *lenp);
+
+extern int
+drvlist_decode(char *buf,
+	       size_t len,
+	       DISK **dvp,
+	       int *dsp);
+
+extern int
+drvlist_table_save(const char *path,
+		   const DISK *dv,
+		   int dc);
+
+extern int
+drvlist_table_load(const char *path,
+		   DISK **dvp,
+		   char **bufp);
+
+
+/*
+ * Inventory dump files (dump.c): every string column is stored once,
+ * sorted and front coded, and drives refer to the strings by index.
+ * A drive can be looked up by serial number without decoding the rest
+ * of the file. Drives and strings read from a dump belong to the
+ * handle and stay valid until it is closed.
+ */
+typedef struct drvlist_dump DRVLIST_DUMP;
+
+extern int
+drvlist_dump_save(const char *path,
+		  const DISK *dv,
+		  int dc);
+
+extern DRVLIST_DUMP *
+drvlist_dump_open(const char *path);
+
+extern int
+drvlist_dump_read(DRVLIST_DUMP *dp,
+		  DISK **dvp);
+
+extern int
+drvlist_dump_find(DRVLIST_DUMP *dp,
+		  const char *ident,
+		  DISK *out);
+
+extern void
+drvlist_dump_close(DRVLIST_DUMP *dp);
+
+
+/*
+ * Shared memory publication of a drive table (shm.c). Readers get a
+ * consistent private copy without system calls or locks.
+ */
+typedef struct drvlist_shm DRVLIST_SHM;
+
+#define DRVLIST_SHM_NAME "/drvlist"
+
+extern int
+drvlist_shm_publish(const char *name,
+		    const DISK *dv,
+		    int dc);
+
+extern DRVLIST_SHM *
+drvlist_shm_open(const char *name);
+
+extern int
+drvlist_shm_read(DRVLIST_SHM *sp,
+		 DISK **dvp,
+		 int *dcp);
+
+extern void
+drvlist_shm_close(DRVLIST_SHM *sp);
+
+
+/* Extra product prefix -> vendor rules (process wide, load before use) */
+extern int
+drvlist_vendor_rules_load(const char *path);
+
+extern int
+drvlist_vendor_normalize(const char *model,
+			 char *vendor,
+			 size_t vsize,
+			 char *product,
+			 size_t psize);
+
+
+/* String helpers */
+
+/* Set an inline DISK string and its length: DISK_SETSTR(dp, vendor, s, n, 1) */
+#define DISK_SETSTR(dp, f, s, n, trim) \
+    drvlist_setstr((dp)->f, sizeof((dp)->f), &(dp)->f##len, (s), (n), (trim))
+
+extern int
+drvlist_setstr(char *buf,
+	       size_t size,
+	       u_char *lenp,
+	       const char *s,
+	       size_t n,
+	       int trim);
+
+extern char *
+drvlist_strdupcat(char **old,
+		  const char *add);
+
+extern size_t
+drvlist_trimspan(const char *s,
+		 size_t n,
+		 size_t *offp);
+
+extern size_t
+drvlist_collapse(char *dst,
+		 const char *s,
+		 size_t n);
+
+extern int
+drvlist_allzero(const void *buf,
+		size_t len);
+
+extern int
+drvlist_strtrim(char *str,
+		int *len);
+
+extern char *
+drvlist_size2str(off_t size);
+
+extern int
+drvlist_size2buf(off_t size,
+		 char *buf,
+		 size_t bufsize);
+
+#endif
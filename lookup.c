@@ -0,0 +1,434 @@
+/*
+ * lookup.c
+ *
+ * Look up drives by serial number for drvlist.
+ *
+ * Copyright (c) 2024 Peter Eriksson <pen@lysator.liu.se>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <errno.h>
+
+#include "drvlist.h"
+
+
+typedef struct {
+    char *serial;
+    int found;
+} WANT;
+
+typedef struct {
+    WANT *wv;
+    int wc;
+    int ws;
+    int nfound;
+    uint32_t *hv;	/* Index into wv + 1, 0 = free slot */
+    size_t hsize;
+} WANTSET;
+
+
+static WANTSET wset;
+
+
+static uint32_t
+str_hash(const char *s,
+	 size_t len) {
+    uint32_t h = 2166136261U;
+    size_t i;
+
+    for (i = 0; i < len; i++)
+	h = (h ^ (uint8_t) s[i]) * 16777619U;
+    return h;
+}
+
+
+/* Length of a serial number without leading and trailing whitespace */
+static size_t
+serial_trim(const char **sp,
+	    size_t len) {
+    const char *s = *sp;
+
+    while (len > 0 && isspace((unsigned char) *s)) {
+	++s;
+	--len;
+    }
+    while (len > 0 && (isspace((unsigned char) s[len-1]) || s[len-1] == '\0'))
+	--len;
+
+    *sp = s;
+    return len;
+}
+
+
+static void
+wset_insert(uint32_t *hv,
+	    size_t hsize,
+	    int i) {
+    const char *s = wset.wv[i].serial;
+    size_t h = str_hash(s, strlen(s)) & (hsize-1);
+
+    while (hv[h])
+	h = (h+1) & (hsize-1);
+    hv[h] = i+1;
+}
+
+static int
+wset_rehash(size_t hsize) {
+    uint32_t *hv;
+    int i;
+
+    hv = calloc(hsize, sizeof(uint32_t));
+    if (!hv)
+	return -1;
+
+    for (i = 0; i < wset.wc; i++)
+	wset_insert(hv, hsize, i);
+
+    free(wset.hv);
+    wset.hv = hv;
+    wset.hsize = hsize;
+    return 0;
+}
+
+
+static WANT *
+wset_find(const char *s,
+	  size_t len) {
+    size_t h;
+
+    if (!wset.hv)
+	return NULL;
+
+    for (h = str_hash(s, len) & (wset.hsize-1); wset.hv[h]; h = (h+1) & (wset.hsize-1)) {
+	WANT *wp = &wset.wv[wset.hv[h]-1];
+
+	if (strncmp(wp->serial, s, len) == 0 && wp->serial[len] == '\0')
+	    return wp;
+    }
+
+    return NULL;
+}
+
+
+static int
+wset_add(const char *s,
+	 size_t len) {
+    WANT *wp;
+
+    len = serial_trim(&s, len);
+    if (len == 0 || wset_find(s, len))
+	return 0;
+
+    if (wset.wc >= wset.ws) {
+	wp = realloc(wset.wv, (wset.ws ? wset.ws*2 : 64)*sizeof(WANT));
+	if (!wp)
+	    return -1;
+	wset.wv = wp;
+	wset.ws = wset.ws ? wset.ws*2 : 64;
+    }
+    wp = &wset.wv[wset.wc];
+    wp->serial = strndup(s, len);
+    wp->found = 0;
+    if (!wp->serial)
+	return -1;
+    wset.wc++;
+
+    /* Keep the load factor at or below 0.5 */
+    if ((size_t) wset.wc*2 > wset.hsize)
+	return wset_rehash(wset.hsize ? wset.hsize*2 : 64);
+
+    wset_insert(wset.hv, wset.hsize, wset.wc-1);
+    return 0;
+}
+
+
+/*
+ * Add serial numbers to look for: a comma separated list, or
+ * "@file" with one serial per line.
+ */
+int
+lookup_add(const char *arg) {
+    const char *cp;
+
+    if (*arg == '@') {
+	FILE *fp;
+	char buf[1024];
+
+	fp = fopen(arg+1, "r");
+	if (!fp)
+	    return -1;
+	while (fgets(buf, sizeof(buf), fp))
+	    if (wset_add(buf, strlen(buf)) < 0) {
+		fclose(fp);
+		return -1;
+	    }
+	fclose(fp);
+	return 0;
+    }
+
+    while ((cp = strchr(arg, ',')) != NULL) {
+	if (wset_add(arg, cp-arg) < 0)
+	    return -1;
+	arg = cp+1;
+    }
+
+    return wset_add(arg, strlen(arg));
+}
+
+
+int
+lookup_active(void) {
+    return wset.wc > 0;
+}
+
+
+/*
+ * Check if a (possibly untrimmed) serial number is one we are looking
+ * for, and if so mark it as found.
+ */
+int
+lookup_want(const char *serial,
+	    size_t len) {
+    WANT *wp;
+
+    len = serial_trim(&serial, strnlen(serial, len));
+    wp = wset_find(serial, len);
+    if (!wp)
+	return 0;
+
+    if (!wp->found) {
+	wp->found = 1;
+	wset.nfound++;
+    }
+    return 1;
+}
+
+
+/* Requested serial number i, or NULL after the last one */
+const char *
+lookup_serial(int i) {
+    return i < wset.wc ? wset.wv[i].serial : NULL;
+}
+
+
+/* All requested serial numbers have been found */
+int
+lookup_done(void) {
+    return wset.wc > 0 && wset.nfound == wset.wc;
+}
+
+
+/* Report serial numbers that were not found. Returns the number missing */
+int
+lookup_missing(const char *argv0) {
+    int i, n = 0;
+
+    for (i = 0; i < wset.wc; i++)
+	if (!wset.wv[i].found) {
+	    fprintf(stderr, "%s: Error: %s: Serial number not found\n",
+		    argv0, wset.wv[i].serial);
+	    ++n;
+	}
+
+    return n;
+}
+
+
+/*
+ * Batch reverse lookup: map a list of serial numbers (from stdin) to
+ * the drives found by one enumeration.
+ *
+ * Serial numbers are matched exactly first. Since vendors sometimes
+ * truncate serial numbers (and some drives report truncated ones) an
+ * input serial that is a prefix of exactly one drive serial, or a
+ * drive serial that is a prefix of the input, also matches.
+ */
+
+#define LOOKUP_MINPREFIX 6
+
+#define SMAP_AMBIGUOUS (-2)
+
+typedef struct {
+    const char *key;
+    size_t len;
+    int val;
+} SMAPENT;
+
+typedef struct {
+    SMAPENT *ev;
+    size_t size;
+    size_t n;
+} SMAP;
+
+
+static int
+smap_init(SMAP *mp,
+	  size_t n) {
+    for (mp->size = 64; mp->size < n*2; mp->size <<= 1)
+	;
+    mp->n = 0;
+    mp->ev = calloc(mp->size, sizeof(SMAPENT));
+    return mp->ev ? 0 : -1;
+}
+
+static SMAPENT *
+smap_slot(SMAP *mp,
+	  const char *key,
+	  size_t len) {
+    size_t h;
+
+    for (h = str_hash(key, len) & (mp->size-1); mp->ev[h].key; h = (h+1) & (mp->size-1))
+	if (mp->ev[h].len == len && memcmp(mp->ev[h].key, key, len) == 0)
+	    break;
+    return &mp->ev[h];
+}
+
+/* Insert key, marking it ambiguous if already present with another value */
+static void
+smap_put(SMAP *mp,
+	 const char *key,
+	 size_t len,
+	 int val) {
+    SMAPENT *ep = smap_slot(mp, key, len);
+
+    if (ep->key) {
+	if (ep->val != val)
+	    ep->val = SMAP_AMBIGUOUS;
+	return;
+    }
+
+    ep->key = key;
+    ep->len = len;
+    ep->val = val;
+    mp->n++;
+}
+
+static int
+smap_get(SMAP *mp,
+	 const char *key,
+	 size_t len) {
+    SMAPENT *ep = smap_slot(mp, key, len);
+
+    return ep->key ? ep->val : -1;
+}
+
+
+int
+lookup_batch(FILE *in,
+	     FILE *out,
+	     const DISK *dv,
+	     int dc) {
+    SMAP exact, prefix;
+    char **sv = NULL;
+    int sc = 0;
+    char buf[1024];
+    size_t len, n, nprefix = 0;
+    int i, d, absent = 0;
+
+
+    /* Input serials, in input order */
+    while (fgets(buf, sizeof(buf), in)) {
+	const char *s = buf;
+	char **nsv;
+
+	len = serial_trim(&s, strlen(buf));
+	if (len == 0)
+	    continue;
+
+	nsv = realloc(sv, (sc+1)*sizeof(char *));
+	if (!nsv)
+	    return -1;
+	sv = nsv;
+	sv[sc] = strndup(s, len);
+	if (!sv[sc++])
+	    return -1;
+    }
+
+    for (d = 0; d < dc; d++)
+	nprefix += strlen(dv[d].ident);
+
+    if (smap_init(&exact, dc) < 0 || smap_init(&prefix, nprefix) < 0)
+	return -1;
+
+    /* Index every drive serial, and every prefix of it */
+    for (d = 0; d < dc; d++) {
+	const char *s = dv[d].ident;
+
+	len = serial_trim(&s, strlen(s));
+	smap_put(&exact, s, len, d);
+	for (; len >= LOOKUP_MINPREFIX; len--)
+	    smap_put(&prefix, s, len, d);
+    }
+
+    for (i = 0; i < sc; i++) {
+	const char *how = "exact";
+
+	len = strlen(sv[i]);
+	d = smap_get(&exact, sv[i], len);
+	if (d == -1) {
+	    how = "prefix";
+
+	    /* Input truncated: it is a prefix of a drive serial */
+	    if (len >= LOOKUP_MINPREFIX)
+		d = smap_get(&prefix, sv[i], len);
+
+	    /* Drive serial truncated: it is a prefix of the input */
+	    for (n = len-1; d == -1 && n >= LOOKUP_MINPREFIX; n--)
+		d = smap_get(&exact, sv[i], n);
+	}
+
+	if (d == SMAP_AMBIGUOUS) {
+	    fprintf(out, "%s : ambiguous\n", sv[i]);
+	    ++absent;
+	} else if (d < 0) {
+	    fprintf(out, "%s : absent\n", sv[i]);
+	    ++absent;
+	} else {
+	    const DISK *dp = &dv[d];
+
+	    fprintf(out, "%s : %s : %s : %s : %s\n",
+		    sv[i], how,
+		    dp->ident,
+		    dp->danames ? dp->danames : "-",
+		    dp->phys && dp->phys[0] ? dp->phys : "-");
+	}
+    }
+
+    for (i = 0; i < sc; i++)
+	free(sv[i]);
+    free(sv);
+    free(exact.ev);
+    free(prefix.ev);
+    return absent;
+}
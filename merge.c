@@ -0,0 +1,847 @@
+/*
+ * merge.c
+ *
+ * Fleet inventory merge (drvlist-merge) for drvlist.
+ *
+ * Copyright (c) 2024 Peter Eriksson <pen@lysator.liu.se>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Merges drvlist table output files from many hosts (one file per
+ * host, the host name taken from the file name) into fleet-wide
+ * reports: serial numbers seen on more than one host, firmware
+ * revisions per vendor/product and capacity per vendor.
+ *
+ * A file is either a --dump file, which has the full serial numbers
+ * and exact sizes, or table output. Table rows with the serial number
+ * cut to the -W width are skipped and reported, since cut serial
+ * numbers of different drives can be equal. Other cut values are kept
+ * as shown, and sizes are the rounded SIZE column.
+ *
+ * Input files are parsed by up to -j threads in parallel. Rows are
+ * spilled into MERGE_PARTS temporary files by serial number hash, and
+ * each partition is then deduplicated on its own, so memory use is
+ * bounded by the largest partition rather than the total row count.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#include "drvlist.h"
+
+
+#define MERGE_PARTS   256
+#define MERGE_BUFSIZE 8192
+
+
+typedef struct {
+    char **fv;
+    int fc;
+    int next;
+    pthread_mutex_t mtx;
+    FILE *pv[MERGE_PARTS];
+    unsigned long long rows;
+    int errors;
+} MERGEJOBS;
+
+/* Per-thread output buffer for one partition */
+typedef struct {
+    char *buf;
+    size_t len;
+} PBUF;
+
+
+/* One drive in the partition being deduplicated */
+typedef struct {
+    char *ident;
+    char *vendor;
+    char *product;
+    char *revision;
+    unsigned long long bytes;
+    char *hosts;
+    int nhosts;
+    char *line;
+} MDRIVE;
+
+/* Firmware/capacity aggregate per vendor, product and revision */
+typedef struct {
+    char *vendor;
+    char *product;
+    char *revision;
+    unsigned long long drives;
+    unsigned long long bytes;
+} MFW;
+
+typedef struct {
+    MFW *ev;
+    size_t size;
+    size_t used;
+} MFWMAP;
+
+
+static uint32_t
+str_hash(const char *s) {
+    uint32_t h = 2166136261U;
+
+    while (*s)
+	h = (h ^ (uint8_t) *s++) * 16777619U;
+    return h;
+}
+
+
+/* Parse a drvlist_size2str() value back into bytes */
+static unsigned long long
+str2size(const char *s) {
+    double d;
+    char *ep;
+
+    d = strtod(s, &ep);
+    if (ep == s)
+	return 0;
+
+    switch (toupper(*ep)) {
+    case 'P':
+	d *= 1000;
+	/* FALLTHROUGH */
+    case 'T':
+	d *= 1000;
+	/* FALLTHROUGH */
+    case 'G':
+	d *= 1000;
+	/* FALLTHROUGH */
+    case 'M':
+	d *= 1000;
+	/* FALLTHROUGH */
+    case 'K':
+	d *= 1000;
+    }
+    return (unsigned long long) d;
+}
+
+
+/* Host name from file name: strip the directory and a .txt/.out/.dump suffix */
+static char *
+file2host(const char *path,
+	  char *buf,
+	  size_t size) {
+    const char *cp;
+    size_t len;
+
+    cp = strrchr(path, '/');
+    cp = cp ? cp+1 : path;
+
+    len = strlen(cp);
+    if (len > 4 && (strcmp(cp+len-4, ".txt") == 0 || strcmp(cp+len-4, ".out") == 0))
+	len -= 4;
+    else if (len > 5 && strcmp(cp+len-5, ".dump") == 0)
+	len -= 5;
+    if (len >= size)
+	len = size-1;
+
+    memcpy(buf, cp, len);
+    buf[len] = '\0';
+    return buf;
+}
+
+
+static int
+pbuf_flush(PBUF *bp,
+	   FILE *fp) {
+    int rc = 0;
+
+    if (bp->len > 0 && fwrite(bp->buf, 1, bp->len, fp) != bp->len)
+	rc = -1;
+    bp->len = 0;
+    return rc;
+}
+
+
+/*
+ * Add one drive to its partition buffer as
+ *   ident \t host \t vendor \t product \t rev \t bytes \t names
+ */
+static int
+merge_add(const char *host,
+	  const char *ident,
+	  const char *vendor,
+	  const char *product,
+	  const char *rev,
+	  unsigned long long bytes,
+	  const char *names,
+	  PBUF *pbv,
+	  FILE **pv) {
+    char rec[2048];
+    int i, n;
+    PBUF *bp;
+
+    n = snprintf(rec, sizeof(rec), "%s\t%s\t%s\t%s\t%s\t%llu\t%s\n",
+		 ident, host, vendor, product, rev, bytes, names ? names : "");
+    if (n >= (int) sizeof(rec))
+	return 0;
+
+    i = str_hash(ident) % MERGE_PARTS;
+    bp = &pbv[i];
+    if (!bp->buf) {
+	bp->buf = malloc(MERGE_BUFSIZE);
+	if (!bp->buf)
+	    return -1;
+    }
+    if (bp->len + n > MERGE_BUFSIZE && pbuf_flush(bp, pv[i]) < 0)
+	return -1;
+    memcpy(bp->buf+bp->len, rec, n);
+    bp->len += n;
+    return 1;
+}
+
+
+/* True if a table value was cut to the -W width (and ends in "..") */
+static int
+is_cut(const char *s) {
+    size_t len = strlen(s);
+
+    return len >= 2 && strcmp(s+len-2, "..") == 0;
+}
+
+
+/*
+ * Parse one drvlist table row:
+ *   # : VENDOR : PRODUCT : REV. : IDENT : SIZE : NAMES [: ...]
+ * Returns 1 if added, 0 if not a drive row, 2 if the serial number was
+ * cut (different drives could then share it) or -1.
+ */
+static int
+merge_row(char *line,
+	  const char *host,
+	  PBUF *pbv,
+	  FILE **pv) {
+    char *fv[7], *cp;
+    int i;
+
+
+    for (cp = line; isspace(*cp); cp++)
+	;
+    if (!isdigit(*cp))
+	return 0;
+
+    for (i = 0; i < 7; i++) {
+	fv[i] = cp;
+	cp = strstr(cp, " : ");
+	if (cp) {
+	    *cp = '\0';
+	    cp += 3;
+	} else if (i < 6)
+	    return 0;
+	else
+	    break;
+	drvlist_strtrim(fv[i], NULL);
+    }
+    drvlist_strtrim(fv[6], NULL);
+    if (!*fv[4])
+	return 0;
+    if (is_cut(fv[4]))
+	return 2;
+
+    return merge_add(host, fv[4], fv[1], fv[2], fv[3], str2size(fv[5]), fv[6], pbv, pv);
+}
+
+
+/* Add the drives of a --dump file, with their exact sizes */
+static int
+merge_dump(DRVLIST_DUMP *dfp,
+	   const char *host,
+	   PBUF *pbv,
+	   FILE **pv) {
+    DISK *dv;
+    int i, dc, rc, rows = 0;
+
+
+    dc = drvlist_dump_read(dfp, &dv);
+    if (dc < 0)
+	return -1;
+
+    for (i = 0; i < dc; i++) {
+	DISK *dp = &dv[i];
+
+	if (!dp->ident[0])
+	    continue;
+	rc = merge_add(host, dp->ident, dp->vendor, dp->product, dp->revision,
+		       dp->msize, dp->danames, pbv, pv);
+	if (rc < 0)
+	    return -1;
+	rows += rc;
+    }
+    return rows;
+}
+
+
+static void *
+merge_job_thread(void *vp) {
+    MERGEJOBS *jp = (MERGEJOBS *) vp;
+    PBUF *pbv;
+    char host[256];
+    char *line = NULL;
+    size_t lsize = 0;
+    unsigned long long rows = 0;
+    int i, rc, cut, errors = 0;
+    DRVLIST_DUMP *dfp;
+    FILE *fp;
+
+    pbv = calloc(MERGE_PARTS, sizeof(PBUF));
+    if (!pbv)
+	return NULL;
+
+    for (;;) {
+	pthread_mutex_lock(&jp->mtx);
+	i = jp->next++;
+	pthread_mutex_unlock(&jp->mtx);
+
+	if (i >= jp->fc)
+	    break;
+
+	file2host(jp->fv[i], host, sizeof(host));
+
+	dfp = drvlist_dump_open(jp->fv[i]);
+	if (dfp) {
+	    rc = merge_dump(dfp, host, pbv, jp->pv);
+	    if (rc < 0) {
+		fprintf(stderr, "drvlist-merge: Error: %s: Load: %s\n",
+			jp->fv[i], strerror(errno));
+		++errors;
+	    } else
+		rows += rc;
+	    drvlist_dump_close(dfp);
+	    continue;
+	}
+
+	fp = errno == EINVAL ? fopen(jp->fv[i], "r") : NULL;
+	if (!fp) {
+	    fprintf(stderr, "drvlist-merge: Error: %s: Open: %s\n",
+		    jp->fv[i], strerror(errno));
+	    ++errors;
+	    continue;
+	}
+
+	cut = 0;
+	while (getline(&line, &lsize, fp) > 0) {
+	    rc = merge_row(line, host, pbv, jp->pv);
+	    if (rc < 0) {
+		fprintf(stderr, "drvlist-merge: Error: Spill write: %s\n",
+			strerror(errno));
+		++errors;
+		break;
+	    }
+	    if (rc == 2)
+		++cut;
+	    else
+		rows += rc;
+	}
+	fclose(fp);
+
+	if (cut) {
+	    fprintf(stderr, "drvlist-merge: Error: %s: %d rows with serial numbers cut to the -W width skipped (use drvlist -W0 or --dump)\n",
+		    jp->fv[i], cut);
+	    ++errors;
+	}
+    }
+
+    for (i = 0; i < MERGE_PARTS; i++) {
+	if (pbuf_flush(&pbv[i], jp->pv[i]) < 0)
+	    ++errors;
+	free(pbv[i].buf);
+    }
+    free(pbv);
+    free(line);
+
+    pthread_mutex_lock(&jp->mtx);
+    jp->rows += rows;
+    jp->errors += errors;
+    pthread_mutex_unlock(&jp->mtx);
+    return NULL;
+}
+
+
+static int
+mfw_rehash(MFWMAP *mp,
+	   size_t size) {
+    MFW *nev;
+    size_t i, h;
+
+    nev = calloc(size, sizeof(MFW));
+    if (!nev)
+	return -1;
+
+    for (i = 0; i < mp->size; i++) {
+	MFW *ep = &mp->ev[i];
+
+	if (!ep->vendor)
+	    continue;
+	h = (str_hash(ep->vendor) ^ str_hash(ep->product) ^ str_hash(ep->revision)) & (size-1);
+	while (nev[h].vendor)
+	    h = (h+1) & (size-1);
+	nev[h] = *ep;
+    }
+
+    free(mp->ev);
+    mp->ev = nev;
+    mp->size = size;
+    return 0;
+}
+
+static int
+mfw_add(MFWMAP *mp,
+	const MDRIVE *dp) {
+    MFW *ep;
+    size_t h;
+
+    if ((mp->used+1)*2 > mp->size && mfw_rehash(mp, mp->size ? mp->size*2 : 256) < 0)
+	return -1;
+
+    h = (str_hash(dp->vendor) ^ str_hash(dp->product) ^ str_hash(dp->revision)) & (mp->size-1);
+    for (;;) {
+	ep = &mp->ev[h];
+	if (!ep->vendor)
+	    break;
+	if (strcmp(ep->vendor, dp->vendor) == 0 &&
+	    strcmp(ep->product, dp->product) == 0 &&
+	    strcmp(ep->revision, dp->revision) == 0) {
+	    ep->drives++;
+	    ep->bytes += dp->bytes;
+	    return 0;
+	}
+	h = (h+1) & (mp->size-1);
+    }
+
+    ep->vendor = strdup(dp->vendor);
+    ep->product = strdup(dp->product);
+    ep->revision = strdup(dp->revision);
+    if (!ep->vendor || !ep->product || !ep->revision)
+	return -1;
+    ep->drives = 1;
+    ep->bytes = dp->bytes;
+    mp->used++;
+    return 0;
+}
+
+static int
+mfw_cmp(const void *a,
+	const void *b) {
+    const MFW *x = (const MFW *) a;
+    const MFW *y = (const MFW *) b;
+    int rc;
+
+    if (!x->vendor || !y->vendor)
+	return (y->vendor != NULL) - (x->vendor != NULL);
+    rc = strcmp(x->vendor, y->vendor);
+    if (rc == 0)
+	rc = strcmp(x->product, y->product);
+    if (rc == 0)
+	rc = strcmp(x->revision, y->revision);
+    return rc;
+}
+
+
+/* Append "<sep><a><b>" to a malloc'd string */
+static int
+strappend(char **sp,
+	  const char *sep,
+	  const char *a,
+	  const char *b) {
+    size_t olen = *sp ? strlen(*sp) : 0;
+    char *ns;
+
+    ns = realloc(*sp, olen+strlen(sep)+strlen(a)+strlen(b)+1);
+    if (!ns)
+	return -1;
+    strcpy(ns+olen, sep);
+    strcat(ns+olen, a);
+    strcat(ns+olen, b);
+    *sp = ns;
+    return 0;
+}
+
+
+/* "host" is already in a " "-separated list of "host:names" entries? */
+static char *
+host_find(char *hosts,
+	  const char *host) {
+    size_t len = strlen(host);
+    char *cp = hosts;
+
+    while (cp && *cp) {
+	if (strncmp(cp, host, len) == 0 && cp[len] == ':')
+	    return cp;
+	cp = strchr(cp, ' ');
+	if (cp)
+	    ++cp;
+    }
+    return NULL;
+}
+
+
+/*
+ * Add names to the names of the host entry starting at offset off in
+ * *sp, the way drvlist_strdupcat() adds them for a multipath drive.
+ */
+static int
+names_add(char **sp,
+	  size_t off,
+	  const char *names) {
+    char *start = *sp+off, *end, *seg, *ns;
+    size_t slen;
+
+    end = strchr(start, ' ');
+    if (!end)
+	end = start+strlen(start);
+    if (!*names || ((size_t) (end-start) == strlen(names) &&
+		    strncmp(start, names, end-start) == 0))
+	return 0;
+
+    seg = strndup(start, end-start);
+    if (!seg || !drvlist_strdupcat(&seg, names)) {
+	free(seg);
+	return -1;
+    }
+
+    slen = strlen(seg);
+    ns = malloc(off+slen+strlen(end)+1);
+    if (!ns) {
+	free(seg);
+	return -1;
+    }
+    memcpy(ns, *sp, off);
+    memcpy(ns+off, seg, slen);
+    strcpy(ns+off+slen, end);
+    free(seg);
+    free(*sp);
+    *sp = ns;
+    return 0;
+}
+
+
+/*
+ * Deduplicate one partition by ident. Rows for the same ident from the
+ * same host have their names merged, like do_device() does for
+ * multipath drives; rows from different hosts are reported as
+ * duplicate serial numbers.
+ */
+static int
+merge_partition(FILE *fp,
+		MFWMAP *fwp,
+		unsigned long long *drives,
+		unsigned long long *dups) {
+    MDRIVE *hv = NULL;
+    size_t hsize = 0, used = 0, i, h;
+    char *line = NULL, *fv[7], *cp, *hp;
+    size_t lsize = 0;
+    int rc = -1, k;
+
+
+    rewind(fp);
+    while (getline(&line, &lsize, fp) > 0) {
+	MDRIVE *dp;
+
+	if ((used+1)*2 > hsize) {
+	    size_t nsize = hsize ? hsize*2 : 1024;
+	    MDRIVE *nhv = calloc(nsize, sizeof(MDRIVE));
+
+	    if (!nhv)
+		goto End;
+	    for (i = 0; i < hsize; i++) {
+		if (!hv[i].ident)
+		    continue;
+		for (h = str_hash(hv[i].ident) & (nsize-1); nhv[h].ident; h = (h+1) & (nsize-1))
+		    ;
+		nhv[h] = hv[i];
+	    }
+	    free(hv);
+	    hv = nhv;
+	    hsize = nsize;
+	}
+
+	cp = line;
+	for (k = 0; k < 7; k++)
+	    if (!(fv[k] = strsep(&cp, "\t\n")))
+		break;
+	if (k < 7)
+	    continue;
+
+	for (h = str_hash(fv[0]) & (hsize-1); hv[h].ident; h = (h+1) & (hsize-1))
+	    if (strcmp(hv[h].ident, fv[0]) == 0)
+		break;
+	dp = &hv[h];
+
+	if (!dp->ident) {
+	    dp->line = line;
+	    dp->ident = fv[0];
+	    dp->vendor = fv[2];
+	    dp->product = fv[3];
+	    dp->revision = fv[4];
+	    dp->bytes = strtoull(fv[5], NULL, 10);
+	    dp->hosts = NULL;
+	    if (strappend(&dp->hosts, "", fv[1], ":") < 0 ||
+		strappend(&dp->hosts, "", fv[6], "") < 0)
+		goto End;
+	    dp->nhosts = 1;
+	    ++used;
+
+	    /* The line now belongs to the entry */
+	    line = NULL;
+	    lsize = 0;
+	    continue;
+	}
+
+	if ((hp = host_find(dp->hosts, fv[1])) != NULL) {
+	    /* Another path to the same drive on the same host */
+	    if (names_add(&dp->hosts, hp - dp->hosts + strlen(fv[1]) + 1, fv[6]) < 0)
+		goto End;
+	} else {
+	    if (strappend(&dp->hosts, " ", fv[1], ":") < 0 ||
+		strappend(&dp->hosts, "", fv[6], "") < 0)
+		goto End;
+	    dp->nhosts++;
+	}
+    }
+
+    for (i = 0; i < hsize; i++) {
+	MDRIVE *dp = &hv[i];
+
+	if (!dp->ident)
+	    continue;
+
+	if (mfw_add(fwp, dp) < 0)
+	    goto End;
+	++*drives;
+
+	if (dp->nhosts > 1) {
+	    if (++*dups == 1)
+		puts("Duplicate serial numbers:");
+	    printf("  %s : %s\n", dp->ident, dp->hosts);
+	}
+    }
+    rc = 0;
+
+ End:
+    for (i = 0; i < hsize; i++) {
+	free(hv[i].line);
+	free(hv[i].hosts);
+    }
+    free(hv);
+    free(line);
+    return rc;
+}
+
+
+/*
+ * drvlist-merge [-j<jobs>] [-T<tmpdir>] [<files>]
+ *
+ * File names are read from stdin (one per line) if none are given.
+ */
+int
+merge_main(int argc,
+	   char *argv[]) {
+    MERGEJOBS jobs;
+    MFWMAP fw;
+    pthread_t *tv;
+    char *tmpdir = getenv("TMPDIR");
+    char path[1024], *line = NULL, *s;
+    size_t lsize = 0, i;
+    unsigned long long drives = 0, dups = 0, tdrives, tbytes;
+    int nj = 16, j, k, rc = 0;
+    ssize_t n;
+
+
+    memset(&jobs, 0, sizeof(jobs));
+    memset(&fw, 0, sizeof(fw));
+
+    for (k = 1; k < argc && argv[k][0] == '-'; k++) {
+	int c = argv[k][1];
+	char *val = NULL;
+
+	if (strcmp(argv[k], "--") == 0) {
+	    ++k;
+	    break;
+	}
+
+	switch (c) {
+	case 'h':
+	    printf("Usage: %s [-j<jobs>] [-T<tmpdir>] [<files>]\n", argv[0]);
+	    puts("  Merge drvlist output files (one per host, named after the host).");
+	    puts("  File names are read from stdin if none are given.");
+	    exit(0);
+	case 'j':
+	case 'T':
+	    val = argv[k][2] ? argv[k]+2 : (k+1 < argc ? argv[++k] : NULL);
+	    if (!val) {
+		fprintf(stderr, "%s: Error: Missing value for -%c\n", argv[0], c);
+		exit(1);
+	    }
+	    if (c == 'T')
+		tmpdir = val;
+	    else if (sscanf(val, "%d", &nj) != 1 || nj < 1) {
+		fprintf(stderr, "%s: Error: %s: Invalid job count\n", argv[0], val);
+		exit(1);
+	    }
+	    break;
+	default:
+	    fprintf(stderr, "%s: Error: -%c: Invalid switch\n", argv[0], c);
+	    exit(1);
+	}
+    }
+
+    if (k < argc) {
+	jobs.fv = argv+k;
+	jobs.fc = argc-k;
+    } else {
+	while ((n = getline(&line, &lsize, stdin)) > 0) {
+	    char **nfv;
+
+	    if (line[n-1] == '\n')
+		line[--n] = '\0';
+	    if (!n)
+		continue;
+	    nfv = realloc(jobs.fv, (jobs.fc+1)*sizeof(char *));
+	    if (!nfv || !(nfv[jobs.fc] = strdup(line))) {
+		fprintf(stderr, "%s: Error: Memory allocation failure\n", argv[0]);
+		exit(1);
+	    }
+	    jobs.fv = nfv;
+	    jobs.fc++;
+	}
+	free(line);
+    }
+
+    if (!tmpdir)
+	tmpdir = "/tmp";
+
+    for (j = 0; j < MERGE_PARTS; j++) {
+	int fd;
+
+	snprintf(path, sizeof(path), "%s/drvlist-merge.XXXXXX", tmpdir);
+	fd = mkstemp(path);
+	if (fd < 0 || !(jobs.pv[j] = fdopen(fd, "w+"))) {
+	    fprintf(stderr, "%s: Error: %s: Unable to create spill file: %s\n",
+		    argv[0], path, strerror(errno));
+	    exit(1);
+	}
+	unlink(path);
+    }
+
+    if (nj > jobs.fc)
+	nj = jobs.fc > 0 ? jobs.fc : 1;
+
+    tv = calloc(nj, sizeof(*tv));
+    if (!tv) {
+	fprintf(stderr, "%s: Error: Memory allocation failure\n", argv[0]);
+	exit(1);
+    }
+
+    pthread_mutex_init(&jobs.mtx, NULL);
+
+    for (j = 0; j < nj; j++)
+	if (pthread_create(&tv[j], NULL, merge_job_thread, &jobs) != 0)
+	    break;
+
+    if (j == 0)
+	merge_job_thread(&jobs);
+
+    while (--j >= 0)
+	pthread_join(tv[j], NULL);
+
+    pthread_mutex_destroy(&jobs.mtx);
+    free(tv);
+
+    if (jobs.errors)
+	rc = 1;
+
+    for (j = 0; j < MERGE_PARTS; j++) {
+	if (fflush(jobs.pv[j]) != 0 ||
+	    merge_partition(jobs.pv[j], &fw, &drives, &dups) < 0) {
+	    fprintf(stderr, "%s: Error: Merge failed: %s\n",
+		    argv[0], strerror(errno));
+	    exit(1);
+	}
+	fclose(jobs.pv[j]);
+    }
+
+    qsort(fw.ev, fw.size, sizeof(MFW), mfw_cmp);
+
+    if (fw.used > 0) {
+	if (dups)
+	    putchar('\n');
+	puts("Firmware spread:");
+	for (i = 0; i < fw.used; i++) {
+	    MFW *ep = &fw.ev[i];
+
+	    if (i == 0 || strcmp(ep->vendor, ep[-1].vendor) || strcmp(ep->product, ep[-1].product))
+		printf("  %s %s :", ep->vendor, ep->product);
+	    printf(" %s (%llu)", ep->revision, ep->drives);
+	    if (i+1 == fw.used || strcmp(ep->vendor, ep[1].vendor) || strcmp(ep->product, ep[1].product))
+		putchar('\n');
+	}
+
+	puts("\nCapacity by vendor:");
+	tdrives = tbytes = 0;
+	for (i = 0; i < fw.used; i++) {
+	    MFW *ep = &fw.ev[i];
+
+	    tdrives += ep->drives;
+	    tbytes += ep->bytes;
+	    if (i+1 < fw.used && strcmp(ep->vendor, ep[1].vendor) == 0)
+		continue;
+
+	    s = drvlist_size2str(tbytes);
+	    printf("  %s : %llu drives : %s\n", ep->vendor, tdrives, s);
+	    free(s);
+	    tdrives = tbytes = 0;
+	}
+
+	for (i = 0; i < fw.used; i++)
+	    tbytes += fw.ev[i].bytes;
+	s = drvlist_size2str(tbytes);
+	printf("\nTotal: %d hosts : %llu rows : %llu drives : %llu duplicate serial numbers : %s\n",
+	       jobs.fc, jobs.rows, drives, dups, s);
+	free(s);
+    }
+
+    for (i = 0; i < fw.used; i++) {
+	free(fw.ev[i].vendor);
+	free(fw.ev[i].product);
+	free(fw.ev[i].revision);
+    }
+    free(fw.ev);
+    return rc;
+}
@@ -0,0 +1,295 @@
+/*
+ * negcache.c
+ *
+ * Negative cache of failing devices for drvlist.
+ *
+ * Copyright (c) 2024 Peter Eriksson <pen@lysator.liu.se>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Devices that fail (open errors, no ident) or are very slow to probe
+ * (ATA IDENTIFY timeouts) are remembered in a state file, one line per
+ * device:
+ *
+ *   <name> <stage> <errno> <failures> <last> <retry>
+ *
+ * Until <retry> a failed device is skipped and a slow one is probed
+ * without sending any identify commands. Each further failure doubles
+ * the backoff. An entry is forgotten when the device probes fine
+ * again, when its device node is newer than the last failure (devd
+ * recreated it) or with --forget.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/param.h>
+
+#include "drvlist.h"
+
+
+#define NC_BACKOFF_MIN  (5*60)
+#define NC_BACKOFF_MAX  (24*60*60)
+#define NC_SLOW         5	/* Seconds before a probe counts as slow */
+
+
+typedef struct {
+    char *name;
+    char *stage;
+    int err;
+    int fails;
+    time_t last;
+    time_t retry;
+} NCENT;
+
+static struct {
+    char *path;
+    NCENT *ev;
+    int ec;
+    int dirty;
+    struct timespec t0;		/* Start of the current probe */
+    int quick;			/* Current probe skips the identify step */
+} nc;
+
+
+static NCENT *
+nc_find(const char *name) {
+    int i;
+
+    for (i = 0; i < nc.ec; i++)
+	if (strcmp(nc.ev[i].name, name) == 0)
+	    return &nc.ev[i];
+    return NULL;
+}
+
+static void
+nc_remove(NCENT *ep) {
+    free(ep->name);
+    free(ep->stage);
+    *ep = nc.ev[--nc.ec];
+    nc.dirty = 1;
+}
+
+
+int
+negcache_load(const char *path) {
+    char buf[1024], name[256], stage[64];
+    long long last, retry;
+    int err, fails;
+    FILE *fp;
+    NCENT *nev;
+
+
+    nc.path = strdup(path);
+    if (!nc.path)
+	return -1;
+
+    fp = fopen(path, "r");
+    if (!fp)
+	return errno == ENOENT ? 0 : -1;
+
+    while (fgets(buf, sizeof(buf), fp)) {
+	if (sscanf(buf, "%255s %63s %d %d %lld %lld",
+		   name, stage, &err, &fails, &last, &retry) != 6)
+	    continue;
+
+	nev = realloc(nc.ev, (nc.ec+1)*sizeof(NCENT));
+	if (!nev)
+	    break;
+	nc.ev = nev;
+	nev = &nc.ev[nc.ec];
+	nev->name = strdup(name);
+	nev->stage = strdup(stage);
+	if (!nev->name || !nev->stage)
+	    break;
+	nev->err = err;
+	nev->fails = fails;
+	nev->last = last;
+	nev->retry = retry;
+	nc.ec++;
+    }
+
+    fclose(fp);
+    return 0;
+}
+
+
+int
+negcache_save(void) {
+    char tmp[MAXPATHLEN];
+    FILE *fp;
+    int i;
+
+    if (!nc.path || !nc.dirty)
+	return 0;
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", nc.path);
+    fp = fopen(tmp, "w");
+    if (!fp)
+	return -1;
+
+    for (i = 0; i < nc.ec; i++)
+	fprintf(fp, "%s %s %d %d %lld %lld\n",
+		nc.ev[i].name, nc.ev[i].stage, nc.ev[i].err, nc.ev[i].fails,
+		(long long) nc.ev[i].last, (long long) nc.ev[i].retry);
+
+    if (fclose(fp) != 0 || rename(tmp, nc.path) < 0) {
+	unlink(tmp);
+	return -1;
+    }
+    nc.dirty = 0;
+    return 0;
+}
+
+
+/* Forget one device, or all if name is NULL */
+int
+negcache_forget(const char *name) {
+    NCENT *ep;
+
+    if (!name) {
+	while (nc.ec > 0)
+	    nc_remove(&nc.ev[nc.ec-1]);
+	return 0;
+    }
+
+    ep = nc_find(name);
+    if (!ep)
+	return 1;
+    nc_remove(ep);
+    return 0;
+}
+
+
+/* Probe callback: skip or quick probe devices that are backing off */
+int
+negcache_probe(const char *name) {
+    char path[MAXPATHLEN];
+    struct stat sb;
+    NCENT *ep;
+    time_t now;
+
+
+    clock_gettime(CLOCK_MONOTONIC, &nc.t0);
+    nc.quick = 0;
+
+    if (strncmp(name, "/dev/", 5) == 0)
+	name += 5;
+
+    ep = nc_find(name);
+    if (!ep)
+	return DRVLIST_PROBE_ALL;
+
+    /* Recreated device node - try again */
+    snprintf(path, sizeof(path), "/dev/%s", name);
+    if (stat(path, &sb) == 0 && sb.st_ctime > ep->last) {
+	nc_remove(ep);
+	return DRVLIST_PROBE_ALL;
+    }
+
+    now = time(NULL);
+    if (now >= ep->retry)
+	return DRVLIST_PROBE_ALL;
+
+    if (f_verbose)
+	fprintf(stderr, "drvlist: %s: %s: %s (failed %d times, retry in %lds)\n",
+		name, ep->stage, strerror(ep->err), ep->fails, (long) (ep->retry-now));
+
+    if (strcmp(ep->stage, "slow") == 0 || strstr(ep->stage, "-identify")) {
+	nc.quick = 1;
+	return DRVLIST_PROBE_QUICK;
+    }
+    return DRVLIST_PROBE_SKIP;
+}
+
+
+/* Result callback: remember failures, forget devices that work again */
+void
+negcache_result(const char *name,
+		int rc,
+		const char *stage,
+		int err) {
+    struct timespec t1;
+    NCENT *ep, *nev;
+    time_t now, delay;
+    int i;
+
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    if (!stage && t1.tv_sec - nc.t0.tv_sec >= NC_SLOW) {
+	stage = "slow";
+	err = ETIMEDOUT;
+    }
+
+    if (strncmp(name, "/dev/", 5) == 0)
+	name += 5;
+
+    ep = nc_find(name);
+    if (!stage) {
+	/* A quick probe says nothing about the step that failed */
+	if (ep && !nc.quick)
+	    nc_remove(ep);
+	return;
+    }
+
+    if (!ep) {
+	nev = realloc(nc.ev, (nc.ec+1)*sizeof(NCENT));
+	if (!nev)
+	    return;
+	nc.ev = nev;
+	ep = &nc.ev[nc.ec];
+	memset(ep, 0, sizeof(*ep));
+	ep->name = strdup(name);
+	if (!ep->name)
+	    return;
+	nc.ec++;
+    }
+
+    free(ep->stage);
+    ep->stage = strdup(stage);
+    ep->err = err;
+    ep->fails++;
+
+    delay = NC_BACKOFF_MIN;
+    for (i = 1; i < ep->fails && delay < NC_BACKOFF_MAX; i++)
+	delay *= 2;
+    if (delay > NC_BACKOFF_MAX)
+	delay = NC_BACKOFF_MAX;
+
+    now = time(NULL);
+    ep->last = now;
+    ep->retry = now + delay;
+    nc.dirty = 1;
+}
@@ -0,0 +1,382 @@
+/*
+ * shm.c
+ *
+ * Shared memory inventory publisher and reader for libdrvlist.
+ *
+ * Copyright (c) 2024 Peter Eriksson <pen@lysator.liu.se>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * The publisher writes the drive table into a POSIX shared memory
+ * segment with two buffers. A new table is written into the inactive
+ * buffer and the active buffer index switched while the sequence
+ * counter is odd, i.e. between its two increments. Readers copy the
+ * active buffer and retry if the sequence counter changed meanwhile,
+ * so a consistent snapshot is taken with plain memory reads - no
+ * system calls and no locks. There must be only one publisher.
+ *
+ * The table is only republished if its contents changed (compared by
+ * hash). If it outgrows the segment a larger one is created and the
+ * old one marked stale, which makes readers attach to the new one.
+ *
+ * The table is stored in the drvlist_encode() format.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "libdrvlist.h"
+
+
+#define SHM_MAGIC    "DRVSHM01"
+#define SHM_MINSIZE  (64*1024)
+#define SHM_RETRIES  100	/* Attach attempts, 1 ms apart */
+
+
+typedef struct {
+    char magic[8];
+    uint32_t bufsize;		/* Size of each of the two buffers */
+    uint32_t stale;		/* Replaced by a new segment */
+    uint64_t seq;		/* Odd while switching buffers */
+    uint64_t gen;		/* Number of publications */
+    uint32_t active;		/* Buffer readers should use */
+    uint32_t len[2];
+    uint64_t hash[2];
+} SHMHDR;
+
+#define SHM_BUF(hp, i) ((char *) (hp) + sizeof(SHMHDR) + (size_t) (i)*(hp)->bufsize)
+
+
+struct drvlist_shm {
+    char *name;
+    SHMHDR *hp;
+    size_t size;
+    char *buf;			/* Private copy of the last snapshot */
+    size_t bsize;
+    DISK *dv;
+    int dc;
+    int ds;
+    uint64_t gen;
+};
+
+
+static uint64_t
+buf_hash(const char *buf,
+	 size_t len) {
+    uint64_t h = 14695981039346656037ULL;
+    size_t i;
+
+    for (i = 0; i < len; i++)
+	h = (h ^ (uint8_t) buf[i]) * 1099511628211ULL;
+    return h;
+}
+
+
+static SHMHDR *
+shm_map(const char *name,
+	int flags,
+	size_t bufsize,
+	size_t *sizep) {
+    struct stat sb;
+    SHMHDR *hp;
+    size_t size;
+    int fd;
+
+    fd = shm_open(name, flags, 0644);
+    if (fd < 0)
+	return NULL;
+
+    if (bufsize) {
+	size = sizeof(SHMHDR) + 2*bufsize;
+	if (ftruncate(fd, size) < 0) {
+	    close(fd);
+	    return NULL;
+	}
+    } else {
+	if (fstat(fd, &sb) < 0) {
+	    close(fd);
+	    return NULL;
+	}
+	size = sb.st_size;
+    }
+
+    if (size < sizeof(SHMHDR)) {
+	close(fd);
+	errno = EINVAL;
+	return NULL;
+    }
+
+    hp = mmap(NULL, size, PROT_READ|((flags & O_ACCMODE) == O_RDWR ? PROT_WRITE : 0),
+	      MAP_SHARED, fd, 0);
+    close(fd);
+    if (hp == MAP_FAILED)
+	return NULL;
+
+    if (!bufsize) {
+	int ok = memcmp(hp->magic, SHM_MAGIC, sizeof(hp->magic)) == 0;
+
+	/* The publisher writes the magic after the rest of the header */
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	if (!ok || sizeof(SHMHDR) + 2*(size_t) hp->bufsize > size) {
+	    munmap(hp, size);
+	    errno = EINVAL;
+	    return NULL;
+	}
+    }
+
+    *sizep = size;
+    return hp;
+}
+
+
+/*
+ * Map a published segment for reading. When the publisher replaces a
+ * segment it unlinks the old one before the new one is created and
+ * its header written, so for a moment the name is missing (ENOENT) or
+ * not yet initialised (EINVAL). Retry those for a while.
+ */
+static SHMHDR *
+shm_attach(const char *name,
+	   size_t *sizep) {
+    struct timespec ts = { 0, 1000000 };
+    SHMHDR *hp;
+    int i;
+
+    for (i = 0; ; i++) {
+	hp = shm_map(name, O_RDONLY, 0, sizep);
+	if (hp || (errno != ENOENT && errno != EINVAL) || i >= SHM_RETRIES)
+	    return hp;
+	nanosleep(&ts, NULL);
+    }
+}
+
+
+/*
+ * Publish a drive table. Returns 1 if published, 0 if unchanged since
+ * the last publication or -1 on error.
+ */
+int
+drvlist_shm_publish(const char *name,
+		    const DISK *dv,
+		    int dc) {
+    SHMHDR *hp = NULL, *ohp;
+    char *buf;
+    size_t len, size = 0, osize, bufsize;
+    uint64_t h, seq;
+    uint32_t b;
+    int rc = -1;
+
+
+    if (drvlist_encode(dv, dc, &buf, &len) < 0)
+	return -1;
+    h = buf_hash(buf, len);
+
+    /* Reuse the existing segment if it is ours and large enough */
+    ohp = shm_map(name, O_RDWR, 0, &osize);
+    if (ohp) {
+	if (!ohp->stale && ohp->bufsize >= len) {
+	    hp = ohp;
+	    size = osize;
+	    ohp = NULL;
+	} else {
+	    __atomic_store_n(&ohp->stale, 1, __ATOMIC_RELEASE);
+	    shm_unlink(name);
+	}
+    } else
+	shm_unlink(name);
+
+    if (!hp) {
+	bufsize = SHM_MINSIZE;
+	while (bufsize < 2*len)
+	    bufsize *= 2;
+
+	hp = shm_map(name, O_RDWR|O_CREAT|O_EXCL, bufsize, &size);
+	if (!hp)
+	    goto End;
+	hp->bufsize = bufsize;
+	hp->len[0] = hp->len[1] = 0;
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy(hp->magic, SHM_MAGIC, sizeof(hp->magic));
+    }
+
+    b = hp->active;
+    if (hp->gen > 0 && hp->len[b] == len && hp->hash[b] == h) {
+	rc = 0;
+	goto End;
+    }
+
+    /* Fill the inactive buffer and switch to it, all with seq odd */
+    seq = hp->seq;
+    __atomic_store_n(&hp->seq, seq+1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    b = !b;
+    memcpy(SHM_BUF(hp, b), buf, len);
+    __atomic_store_n(&hp->len[b], len, __ATOMIC_RELAXED);
+    __atomic_store_n(&hp->hash[b], h, __ATOMIC_RELAXED);
+    __atomic_store_n(&hp->active, b, __ATOMIC_RELAXED);
+    hp->gen++;
+
+    __atomic_store_n(&hp->seq, seq+2, __ATOMIC_RELEASE);
+    rc = 1;
+
+ End:
+    if (ohp)
+	munmap(ohp, osize);
+    if (hp)
+	munmap(hp, size);
+    free(buf);
+    return rc;
+}
+
+
+DRVLIST_SHM *
+drvlist_shm_open(const char *name) {
+    DRVLIST_SHM *sp;
+
+    sp = calloc(1, sizeof(*sp));
+    if (!sp)
+	return NULL;
+
+    sp->name = strdup(name);
+    sp->hp = shm_attach(name, &sp->size);
+    if (!sp->name || !sp->hp) {
+	int err = errno;
+
+	free(sp->name);
+	free(sp);
+	errno = err;
+	return NULL;
+    }
+
+    return sp;
+}
+
+void
+drvlist_shm_close(DRVLIST_SHM *sp) {
+    if (!sp)
+	return;
+
+    if (sp->hp)
+	munmap(sp->hp, sp->size);
+    free(sp->name);
+    free(sp->buf);
+    free(sp->dv);
+    free(sp);
+}
+
+
+/*
+ * Get a consistent snapshot of the published table. The drives and
+ * their strings belong to the handle and stay valid until the next
+ * call. Returns 1 if a new table was read, 0 if nothing was published
+ * since the last call (*dvp and *dcp still point to the old one) or
+ * -1 on error. Only attaching to a replaced segment and growing the
+ * private copy need system calls.
+ */
+int
+drvlist_shm_read(DRVLIST_SHM *sp,
+		 DISK **dvp,
+		 int *dcp) {
+    SHMHDR *hp;
+    uint64_t s1, s2, gen;
+    uint32_t b, len;
+    int n;
+
+
+    for (;;) {
+	hp = sp->hp;
+	if (__atomic_load_n(&hp->stale, __ATOMIC_ACQUIRE)) {
+	    SHMHDR *nhp;
+	    size_t nsize;
+
+	    nhp = shm_attach(sp->name, &nsize);
+	    if (!nhp)
+		return -1;
+	    munmap(sp->hp, sp->size);
+	    sp->hp = nhp;
+	    sp->size = nsize;
+	    sp->gen = 0;
+	    continue;
+	}
+
+	s1 = __atomic_load_n(&hp->seq, __ATOMIC_ACQUIRE);
+	if (s1 & 1)
+	    continue;
+
+	gen = __atomic_load_n(&hp->gen, __ATOMIC_RELAXED);
+	if (gen == sp->gen) {
+	    *dvp = sp->dv;
+	    *dcp = sp->dc;
+	    return 0;
+	}
+
+	b = __atomic_load_n(&hp->active, __ATOMIC_RELAXED);
+	len = __atomic_load_n(&hp->len[b & 1], __ATOMIC_RELAXED);
+	if (len > hp->bufsize)
+	    continue;
+
+	if (len > sp->bsize) {
+	    char *nb = realloc(sp->buf, hp->bufsize);
+
+	    if (!nb)
+		return -1;
+	    sp->buf = nb;
+	    sp->bsize = hp->bufsize;
+	}
+	memcpy(sp->buf, SHM_BUF(hp, b & 1), len);
+
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	s2 = __atomic_load_n(&hp->seq, __ATOMIC_RELAXED);
+	if (s1 == s2)
+	    break;
+    }
+
+    n = drvlist_decode(sp->buf, len, &sp->dv, &sp->ds);
+    if (n < 0) {
+	errno = EINVAL;
+	return -1;
+    }
+
+    sp->gen = gen;
+    sp->dc = n;
+    *dvp = sp->dv;
+    *dcp = n;
+    return 1;
+}
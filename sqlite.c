@@ -0,0 +1,233 @@
+/*
+ * sqlite.c
+ *
+ * SQLite export (-o sqlite:FILE) for drvlist.
+ *
+ * Copyright (c) 2024 Peter Eriksson <pen@lysator.liu.se>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Tables:
+ *
+ *   snapshots  One row per run: time, host and number of drives.
+ *   disks      One row per drive (serial number), with the snapshots
+ *              it was first and last seen in.
+ *   paths      One row per device node of a drive, with controller and
+ *              CAM path, and the snapshot it was last seen in.
+ *
+ * Rows are upserted, so repeated runs into the same file only touch
+ * what exists and keep first_seen. Paths that went away from a drive
+ * that was scanned in this run are deleted; drives without paths
+ * (--load, --published) keep their stored ones. Everything is written with
+ * prepared statements in a single transaction.
+ *
+ * Only built with -DHAVE_SQLITE3 (see the Makefile).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/param.h>
+
+#include "drvlist.h"
+
+#if HAVE_SQLITE3
+#include <sqlite3.h>
+
+
+static const char *sql_schema =
+    "PRAGMA journal_mode=WAL;"
+    "PRAGMA synchronous=NORMAL;"
+    "CREATE TABLE IF NOT EXISTS snapshots ("
+    " id INTEGER PRIMARY KEY,"
+    " time INTEGER NOT NULL,"
+    " host TEXT NOT NULL,"
+    " drives INTEGER NOT NULL);"
+    "CREATE TABLE IF NOT EXISTS disks ("
+    " ident TEXT PRIMARY KEY,"
+    " vendor TEXT, product TEXT, revision TEXT,"
+    " msize INTEGER, sectorsize INTEGER,"
+    " names TEXT, phys TEXT,"
+    " first_seen INTEGER REFERENCES snapshots(id),"
+    " last_seen INTEGER REFERENCES snapshots(id));"
+    "CREATE TABLE IF NOT EXISTS paths ("
+    " ident TEXT NOT NULL REFERENCES disks(ident),"
+    " name TEXT NOT NULL,"
+    " controller TEXT, path TEXT,"
+    " last_seen INTEGER REFERENCES snapshots(id),"
+    " PRIMARY KEY (ident, name));"
+    "CREATE INDEX IF NOT EXISTS disks_names ON disks(names);"
+    "CREATE INDEX IF NOT EXISTS paths_name ON paths(name);"
+    "CREATE INDEX IF NOT EXISTS paths_controller ON paths(controller);";
+
+static const char *sql_snapshot =
+    "INSERT INTO snapshots (time, host, drives) VALUES (?1, ?2, ?3)";
+
+static const char *sql_disk =
+    "INSERT INTO disks (ident, vendor, product, revision, msize, sectorsize,"
+    " names, phys, first_seen, last_seen)"
+    " VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9, ?9)"
+    " ON CONFLICT (ident) DO UPDATE SET"
+    " vendor = excluded.vendor, product = excluded.product,"
+    " revision = excluded.revision, msize = excluded.msize,"
+    " sectorsize = excluded.sectorsize, names = excluded.names,"
+    " phys = excluded.phys, last_seen = excluded.last_seen";
+
+static const char *sql_path =
+    "INSERT INTO paths (ident, name, controller, path, last_seen)"
+    " VALUES (?1, ?2, ?3, ?4, ?5)"
+    " ON CONFLICT (ident, name) DO UPDATE SET"
+    " controller = excluded.controller, path = excluded.path,"
+    " last_seen = excluded.last_seen";
+
+/* Paths of a drive that were not seen with it in this snapshot */
+static const char *sql_stale =
+    "DELETE FROM paths WHERE ident = ?1 AND last_seen < ?2";
+
+
+/* Bind a string, NULL if empty */
+static int
+bind_str(sqlite3_stmt *st,
+	 int i,
+	 const char *s) {
+    if (!s || !*s)
+	return sqlite3_bind_null(st, i);
+    return sqlite3_bind_text(st, i, s, -1, SQLITE_STATIC);
+}
+
+static int
+step(sqlite3_stmt *st) {
+    int rc = sqlite3_step(st);
+
+    sqlite3_reset(st);
+    return rc == SQLITE_DONE ? 0 : -1;
+}
+
+
+int
+sqlite_export(const char *file,
+	      const DISK *dv,
+	      int dc) {
+    sqlite3 *db = NULL;
+    sqlite3_stmt *s_snap = NULL, *s_disk = NULL, *s_path = NULL, *s_stale = NULL;
+    char host[MAXHOSTNAMELEN];
+    sqlite3_int64 snap;
+    int i, j, rc = -1;
+
+
+    if (sqlite3_open(file, &db) != SQLITE_OK ||
+	sqlite3_exec(db, sql_schema, NULL, NULL, NULL) != SQLITE_OK ||
+	sqlite3_prepare_v2(db, sql_snapshot, -1, &s_snap, NULL) != SQLITE_OK ||
+	sqlite3_prepare_v2(db, sql_disk, -1, &s_disk, NULL) != SQLITE_OK ||
+	sqlite3_prepare_v2(db, sql_path, -1, &s_path, NULL) != SQLITE_OK ||
+	sqlite3_prepare_v2(db, sql_stale, -1, &s_stale, NULL) != SQLITE_OK ||
+	sqlite3_exec(db, "BEGIN", NULL, NULL, NULL) != SQLITE_OK)
+	goto Fail;
+
+    if (gethostname(host, sizeof(host)) < 0)
+	strcpy(host, "-");
+    sqlite3_bind_int64(s_snap, 1, (sqlite3_int64) time(NULL));
+    sqlite3_bind_text(s_snap, 2, host, -1, SQLITE_STATIC);
+    sqlite3_bind_int(s_snap, 3, dc);
+    if (step(s_snap) < 0)
+	goto Fail;
+    snap = sqlite3_last_insert_rowid(db);
+
+    for (i = 0; i < dc; i++) {
+	const DISK *dp = &dv[i];
+
+	bind_str(s_disk, 1, dp->ident);
+	bind_str(s_disk, 2, dp->vendor);
+	bind_str(s_disk, 3, dp->product);
+	bind_str(s_disk, 4, dp->revision);
+	sqlite3_bind_int64(s_disk, 5, (sqlite3_int64) dp->msize);
+	sqlite3_bind_int(s_disk, 6, dp->sectorsize);
+	bind_str(s_disk, 7, dp->danames);
+	bind_str(s_disk, 8, dp->phys);
+	sqlite3_bind_int64(s_disk, 9, snap);
+	if (step(s_disk) < 0)
+	    goto Fail;
+
+	for (j = 0; j < dp->pc; j++) {
+	    const DPATH *pp = &dp->pv[j];
+
+	    bind_str(s_path, 1, dp->ident);
+	    bind_str(s_path, 2, pp->name);
+	    bind_str(s_path, 3, pp->ctrl);
+	    bind_str(s_path, 4, pp->path);
+	    sqlite3_bind_int64(s_path, 5, snap);
+	    if (step(s_path) < 0)
+		goto Fail;
+	}
+
+	/* Drives from --load or --published carry no paths: keep the stored ones */
+	if (dp->pc > 0) {
+	    bind_str(s_stale, 1, dp->ident);
+	    sqlite3_bind_int64(s_stale, 2, snap);
+	    if (step(s_stale) < 0)
+		goto Fail;
+	}
+    }
+
+    if (sqlite3_exec(db, "COMMIT", NULL, NULL, NULL) != SQLITE_OK)
+	goto Fail;
+    rc = 0;
+    goto End;
+
+ Fail:
+    fprintf(stderr, "drvlist: Error: %s: %s\n",
+	    file, db ? sqlite3_errmsg(db) : strerror(ENOMEM));
+    if (db)
+	sqlite3_exec(db, "ROLLBACK", NULL, NULL, NULL);
+ End:
+    sqlite3_finalize(s_snap);
+    sqlite3_finalize(s_disk);
+    sqlite3_finalize(s_path);
+    sqlite3_finalize(s_stale);
+    sqlite3_close(db);
+    return rc;
+}
+
+#else
+
+int
+sqlite_export(const char *file,
+	      const DISK *dv,
+	      int dc) {
+    fprintf(stderr, "drvlist: Error: %s: Built without SQLite support\n", file);
+    errno = ENOTSUP;
+    return -1;
+}
+
+#endif
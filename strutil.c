@@ -0,0 +1,177 @@
+/*
+ * strutil.c
+ *
+ * String helpers of libdrvlist that do not need CAM.
+ *
+ * Copyright (c) 2024 Peter Eriksson <pen@lysator.liu.se>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <sys/types.h>
+
+#include "libdrvlist.h"
+
+
+char *
+drvlist_strdupcat(char **old,
+		  const char *add) {
+    size_t olen = 0;
+    size_t alen = 0;
+    
+    if (*old) {
+	if (strcmp(*old, add) == 0)
+	    return 0;
+	
+	olen += strlen(*old);
+    }
+    
+    if (olen > 0)
+	++alen;
+    alen += strlen(add);
+
+    if (*old && strcmp(*old, add) > 0) {
+	char *new = malloc(olen+alen+1);
+	if (!new)
+	    return NULL;
+	strcpy(new, add);
+	strcat(new, ",");
+	strcat(new, *old);
+	free(*old);
+	*old = new;
+    } else {
+	*old = realloc(*old, olen+alen+1);
+	if (!*old)
+	    return NULL;
+	
+	if (olen > 0)
+	    (*old)[olen++] = ',';
+	
+	strcpy((*old)+olen, add);
+    }
+    
+    return *old;
+}
+
+
+int
+drvlist_strtrim(char *str,
+		int *len) {
+    size_t off;
+    int n;
+
+    
+    if (!str)
+	return 0;
+
+    n = drvlist_trimspan(str, strlen(str), &off);
+    if (off > 0)
+	memmove(str, str+off, n);
+    str[n] = '\0';
+    if (len && n > *len)
+	*len = n;
+    return n;
+}
+
+
+/*
+ * Copy at most 'n' bytes of 's' (up to a NUL) into an inline DISK
+ * string of 'size' bytes, optionally without leading and trailing
+ * whitespace, and store the length in *lenp. Returns the length.
+ */
+int
+drvlist_setstr(char *buf,
+	       size_t size,
+	       u_char *lenp,
+	       const char *s,
+	       size_t n,
+	       int trim) {
+    const char *e;
+    size_t off, len;
+
+    if (!s)
+	n = 0;
+    if (n > 0 && (e = memchr(s, '\0', n)) != NULL)
+	n = e-s;
+    if (trim) {
+	n = drvlist_trimspan(s, n, &off);
+	s += off;
+    }
+
+    len = n < size-1 ? n : size-1;
+    memcpy(buf, s, len);
+    if (trim)
+	while (len > 0 && isspace((unsigned char) buf[len-1]))
+	    --len;
+    buf[len] = '\0';
+
+    *lenp = len;
+    return len;
+}
+
+
+int
+drvlist_size2buf(off_t size,
+		 char *buf,
+		 size_t bufsize) {
+    double ds = size;
+    
+    if (size < 2000)
+	return snprintf(buf, bufsize, "%lu", size);
+
+    ds /= 1000;
+    if (ds < 2000)
+	return snprintf(buf, bufsize, "%.0fK", ds);
+    
+    ds /= 1000;
+    if (ds < 2000)
+	return snprintf(buf, bufsize, "%.0fM", ds);
+    
+    ds /= 1000;
+    if (ds < 2000)
+	return snprintf(buf, bufsize, "%.0fG", ds);
+    
+    ds /= 1000;
+    if (ds < 2000)
+	return snprintf(buf, bufsize, "%.0fT", ds);
+    
+    ds /= 1000;
+    return snprintf(buf, bufsize, "%.0fP", ds);
+}
+
+char *
+drvlist_size2str(off_t size) {
+    char buf[256];
+
+    drvlist_size2buf(size, buf, sizeof(buf));
+    return strdup(buf);
+}
@@ -0,0 +1,331 @@
+/*
+ * summary.c
+ *
+ * Inventory summary (--summary) for drvlist.
+ *
+ * Copyright (c) 2024 Peter Eriksson <pen@lysator.liu.se>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Drive counts and capacity grouped by vendor/product/revision, by
+ * controller and by media type, and the number of paths per drive,
+ * all gathered in one pass over the drives. Groups are kept in open
+ * addressing hash tables, so the pass stays linear however many
+ * drives and groups there are; only the groups are sorted for output.
+ *
+ * The media type is "nvme" for NVMe drives, "optical" for cd(4) and
+ * otherwise "ssd" or "hdd" from the GEOM::rotation_rate attribute
+ * ("?" if the drive does not report it). The attribute is only read
+ * for drives from a local scan: the names of drives from a dump or
+ * the shared memory table may mean other drives, or none, here.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/ioctl.h>
+#include <sys/disk.h>
+#include <sys/param.h>
+
+#include "drvlist.h"
+
+
+/* Paths per drive are counted up to this, the last bucket is N+ */
+#define SUMMARY_MAXPATHS 4
+
+
+typedef struct {
+    char *key;
+    uint32_t hash;
+    int drives;
+    int sized;			/* Drives with a known size */
+    off_t bytes;
+} GROUP;
+
+typedef struct {
+    const char *title;
+    GROUP *gv;
+    size_t gc;
+    uint32_t *hv;		/* Group index + 1, 0 = free slot */
+    size_t hsize;
+} GROUPS;
+
+
+static uint32_t
+key_hash(const char *s) {
+    uint32_t h = 2166136261U;
+
+    while (*s)
+	h = (h ^ (uint8_t) *s++) * 16777619U;
+    return h;
+}
+
+
+/* Rebuild the index at twice the size, load factor <= 0.5 */
+static int
+groups_grow(GROUPS *gp) {
+    size_t nsize = gp->hsize ? gp->hsize*2 : 64;
+    uint32_t *hv = calloc(nsize, sizeof(uint32_t));
+    size_t i, h;
+
+    if (!hv)
+	return -1;
+
+    for (i = 0; i < gp->gc; i++) {
+	for (h = gp->gv[i].hash & (nsize-1); hv[h]; h = (h+1) & (nsize-1))
+	    ;
+	hv[h] = i+1;
+    }
+
+    free(gp->hv);
+    gp->hv = hv;
+    gp->hsize = nsize;
+    return 0;
+}
+
+static int
+groups_add(GROUPS *gp,
+	   const char *key,
+	   off_t bytes) {
+    uint32_t hash = key_hash(key);
+    GROUP *g;
+    size_t h;
+
+
+    if ((gp->gc+1)*2 > gp->hsize && groups_grow(gp) < 0)
+	return -1;
+
+    for (h = hash & (gp->hsize-1); gp->hv[h]; h = (h+1) & (gp->hsize-1)) {
+	g = &gp->gv[gp->hv[h]-1];
+	if (g->hash == hash && strcmp(g->key, key) == 0)
+	    goto Found;
+    }
+
+    /* The group array grows in powers of two */
+    if ((gp->gc & (gp->gc-1)) == 0) {
+	GROUP *gv = realloc(gp->gv, (gp->gc ? gp->gc*2 : 1)*sizeof(GROUP));
+
+	if (!gv)
+	    return -1;
+	gp->gv = gv;
+    }
+    g = &gp->gv[gp->gc];
+    memset(g, 0, sizeof(*g));
+    g->key = strdup(key);
+    if (!g->key)
+	return -1;
+    g->hash = hash;
+    gp->hv[h] = ++gp->gc;
+
+ Found:
+    g->drives++;
+    if (bytes > 0) {
+	g->sized++;
+	g->bytes += bytes;
+    }
+    return 0;
+}
+
+static void
+groups_free(GROUPS *gp) {
+    size_t i;
+
+    for (i = 0; i < gp->gc; i++)
+	free(gp->gv[i].key);
+    free(gp->gv);
+    free(gp->hv);
+}
+
+
+/* Most drives first, then by key */
+static int
+group_cmp(const void *a,
+	  const void *b) {
+    const GROUP *ga = (const GROUP *) a;
+    const GROUP *gb = (const GROUP *) b;
+
+    if (ga->drives != gb->drives)
+	return ga->drives > gb->drives ? -1 : 1;
+    return strcmp(ga->key, gb->key);
+}
+
+static void
+groups_print(GROUPS *gp) {
+    char total[16], avg[16];
+    size_t i;
+
+
+    qsort(gp->gv, gp->gc, sizeof(GROUP), group_cmp);
+
+    putchar('\n');
+    if (isatty(1))
+	printf("\033[1;4m%6s : %8s : %8s : %s\033[0m\n",
+	       "DRIVES", "CAPACITY", "AVERAGE", gp->title);
+    else
+	printf("%s:\n", gp->title);
+
+    for (i = 0; i < gp->gc; i++) {
+	const GROUP *g = &gp->gv[i];
+
+	if (g->sized > 0) {
+	    drvlist_size2buf(g->bytes, total, sizeof(total));
+	    drvlist_size2buf(g->bytes / g->sized, avg, sizeof(avg));
+	} else {
+	    strcpy(total, "?");
+	    strcpy(avg, "?");
+	}
+
+	printf("%6d : %8s : %8s : %s\n",
+	       g->drives, total, avg, g->key);
+    }
+}
+
+
+static const char *
+media_type(const DISK *dp,
+	   int local) {
+    char path[MAXPATHLEN];
+    struct diocgattr_arg arg;
+    const char *name = dp->pc > 0 ? dp->pv[0].name : dp->danames;
+    size_t n;
+    int fd, rc;
+
+
+    if (!name)
+	return "?";
+    if (strncmp(name, "nda", 3) == 0 || strncmp(name, "nvd", 3) == 0)
+	return "nvme";
+    if (strncmp(name, "cd", 2) == 0)
+	return "optical";
+    if (!local)
+	return "?";
+
+    n = strcspn(name, ",");
+    snprintf(path, sizeof(path), "/dev/%.*s", (int) n, name);
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+	return "?";
+
+    memset(&arg, 0, sizeof(arg));
+    strcpy(arg.name, "GEOM::rotation_rate");
+    arg.len = sizeof(arg.value.u16);
+    rc = ioctl(fd, DIOCGATTR, &arg);
+    close(fd);
+
+    /* 0 = not reported, 1 = non-rotating, otherwise RPM */
+    if (rc < 0 || arg.value.u16 == 0)
+	return "?";
+    return arg.value.u16 == 1 ? "ssd" : "hdd";
+}
+
+/* Number of paths, from the drive names if the paths are not known */
+static int
+disk_npaths(const DISK *dp) {
+    const char *s;
+    int n;
+
+    if (dp->pc > 0 || !dp->danames)
+	return dp->pc;
+    for (n = 1, s = dp->danames; (s = strchr(s, ',')) != NULL; s++)
+	++n;
+    return n;
+}
+
+
+int
+summary(const DISK *dv,
+	int dc,
+	int local) {
+    GROUPS model, ctrl, media;
+    char key[DRV_VENDORSIZE+DRV_PRODUCTSIZE+DRV_REVSIZE+8];
+    int hist[SUMMARY_MAXPATHS+1];
+    off_t bytes = 0;
+    int i, j, k, np, rc = -1;
+
+
+    memset(&model, 0, sizeof(model));
+    memset(&ctrl, 0, sizeof(ctrl));
+    memset(&media, 0, sizeof(media));
+    memset(hist, 0, sizeof(hist));
+    model.title = "VENDOR PRODUCT REVISION";
+    ctrl.title = "CONTROLLER";
+    media.title = "MEDIA";
+
+    for (i = 0; i < dc; i++) {
+	const DISK *dp = &dv[i];
+
+	bytes += dp->msize;
+
+	snprintf(key, sizeof(key), "%s %s %s",
+		 *dp->vendor ? dp->vendor : "?",
+		 *dp->product ? dp->product : "?",
+		 *dp->revision ? dp->revision : "?");
+	if (groups_add(&model, key, dp->msize) < 0 ||
+	    groups_add(&media, media_type(dp, local), dp->msize) < 0)
+	    goto End;
+
+	/* Count each drive once per controller */
+	for (j = 0; j < dp->pc; j++) {
+	    if (!dp->pv[j].ctrl)
+		continue;
+	    for (k = 0; k < j && (!dp->pv[k].ctrl || strcmp(dp->pv[k].ctrl, dp->pv[j].ctrl)); k++)
+		;
+	    if (k == j && groups_add(&ctrl, dp->pv[j].ctrl, dp->msize) < 0)
+		goto End;
+	}
+
+	np = disk_npaths(dp);
+	hist[np < SUMMARY_MAXPATHS ? np : SUMMARY_MAXPATHS]++;
+    }
+
+    drvlist_size2buf(bytes, key, sizeof(key));
+    printf("Drives: %d, capacity: %s\n", dc, key);
+
+    groups_print(&model);
+    if (ctrl.gc > 0)
+	groups_print(&ctrl);
+    groups_print(&media);
+
+    printf("\nPaths per drive: 1: %d, 2: %d, 3: %d, %d+: %d (single path: %d, multipath: %d)\n",
+	   hist[1], hist[2], hist[3], SUMMARY_MAXPATHS, hist[SUMMARY_MAXPATHS],
+	   hist[1], dc-hist[0]-hist[1]);
+    rc = 0;
+
+ End:
+    groups_free(&model);
+    groups_free(&ctrl);
+    groups_free(&media);
+    return rc;
+}
@@ -0,0 +1,317 @@
+/*
+ * table.c
+ *
+ * Compact serialized drive tables for libdrvlist.
+ *
+ * Copyright (c) 2024 Peter Eriksson <pen@lysator.liu.se>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Table format: uint32 count, then per drive uint64 msize, uint32
+ * sectorsize and the ident, danames, vendor, product, revision,
+ * driver, path, phys and size strings, each NUL terminated (empty
+ * for NULL). Numbers are in host byte order - tables are only meant
+ * for the host that wrote them.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "libdrvlist.h"
+
+
+#define TABLE_NSTR   9
+
+
+static int
+put_str(char **bp,
+	size_t *size,
+	size_t *len,
+	const char *s) {
+    size_t n = s ? strlen(s)+1 : 1;
+
+    if (*len+n > *size) {
+	size_t nsize = (*size ? *size*2 : 4096);
+	char *nb;
+
+	while (nsize < *len+n)
+	    nsize *= 2;
+	nb = realloc(*bp, nsize);
+	if (!nb)
+	    return -1;
+	*bp = nb;
+	*size = nsize;
+    }
+
+    if (s)
+	memcpy(*bp+*len, s, n);
+    else
+	(*bp)[*len] = '\0';
+    *len += n;
+    return 0;
+}
+
+static int
+put_bin(char **bp,
+	size_t *size,
+	size_t *len,
+	const void *p,
+	size_t n) {
+    if (*len+n > *size) {
+	size_t nsize = (*size ? *size*2 : 4096);
+	char *nb;
+
+	while (nsize < *len+n)
+	    nsize *= 2;
+	nb = realloc(*bp, nsize);
+	if (!nb)
+	    return -1;
+	*bp = nb;
+	*size = nsize;
+    }
+
+    memcpy(*bp+*len, p, n);
+    *len += n;
+    return 0;
+}
+
+
+int
+drvlist_encode(const DISK *dv,
+	       int dc,
+	       char **bufp,
+	       size_t *lenp) {
+    char *buf = NULL;
+    size_t size = 0, len = 0;
+    uint32_t n = dc;
+    uint64_t msize;
+    int i;
+
+    if (put_bin(&buf, &size, &len, &n, sizeof(n)) < 0)
+	goto Fail;
+
+    for (i = 0; i < dc; i++) {
+	const DISK *dp = &dv[i];
+	uint32_t ss = dp->sectorsize;
+
+	msize = dp->msize;
+	if (put_bin(&buf, &size, &len, &msize, sizeof(msize)) < 0 ||
+	    put_bin(&buf, &size, &len, &ss, sizeof(ss)) < 0 ||
+	    put_str(&buf, &size, &len, dp->ident) < 0 ||
+	    put_str(&buf, &size, &len, dp->danames) < 0 ||
+	    put_str(&buf, &size, &len, dp->vendor) < 0 ||
+	    put_str(&buf, &size, &len, dp->product) < 0 ||
+	    put_str(&buf, &size, &len, dp->revision) < 0 ||
+	    put_str(&buf, &size, &len, dp->driver) < 0 ||
+	    put_str(&buf, &size, &len, dp->path) < 0 ||
+	    put_str(&buf, &size, &len, dp->phys) < 0 ||
+	    put_str(&buf, &size, &len, dp->size) < 0)
+	    goto Fail;
+    }
+
+    *bufp = buf;
+    *lenp = len;
+    return 0;
+
+ Fail:
+    free(buf);
+    return -1;
+}
+
+
+/*
+ * Next NUL-terminated string at *cp, NULL if empty. A string that is
+ * not terminated before end fails the whole decode.
+ */
+static int
+get_str(char **cp,
+	char *end,
+	char **sp) {
+    char *s = *cp;
+    char *e = memchr(s, '\0', end-s);
+
+    if (!e)
+	return -1;
+    *cp = e+1;
+    *sp = *s ? s : NULL;
+    return 0;
+}
+
+int
+drvlist_decode(char *buf,
+	       size_t len,
+	       DISK **dvp,
+	       int *dsp) {
+    char *cp = buf, *end = buf+len, *s;
+    uint32_t n, ss, i;
+    uint64_t msize;
+
+    if (len < sizeof(n))
+	return -1;
+    memcpy(&n, cp, sizeof(n));
+    cp += sizeof(n);
+
+    /* Every record takes at least its fixed fields and the NULs */
+    if (n > INT_MAX ||
+	n > (len-sizeof(n)) / (sizeof(msize)+sizeof(ss)+TABLE_NSTR))
+	return -1;
+
+    if ((int) n > *dsp) {
+	DISK *ndv = realloc(*dvp, n*sizeof(DISK));
+
+	if (!ndv)
+	    return -1;
+	*dvp = ndv;
+	*dsp = n;
+    }
+
+    for (i = 0; i < n; i++) {
+	DISK *dp = &(*dvp)[i];
+
+	if (end-cp < (ssize_t) (sizeof(msize)+sizeof(ss)+TABLE_NSTR))
+	    return -1;
+	memset(dp, 0, sizeof(*dp));
+	memcpy(&msize, cp, sizeof(msize));
+	cp += sizeof(msize);
+	memcpy(&ss, cp, sizeof(ss));
+	cp += sizeof(ss);
+	dp->msize = msize;
+	dp->sectorsize = ss;
+
+	if (get_str(&cp, end, &s) < 0)
+	    return -1;
+	DISK_SETSTR(dp, ident, s, DRV_IDENTSIZE, 0);
+	if (get_str(&cp, end, &dp->danames) < 0 ||
+	    get_str(&cp, end, &s) < 0)
+	    return -1;
+	DISK_SETSTR(dp, vendor, s, DRV_VENDORSIZE, 0);
+	if (get_str(&cp, end, &s) < 0)
+	    return -1;
+	DISK_SETSTR(dp, product, s, DRV_PRODUCTSIZE, 0);
+	if (get_str(&cp, end, &s) < 0)
+	    return -1;
+	DISK_SETSTR(dp, revision, s, DRV_REVSIZE, 0);
+	if (get_str(&cp, end, &dp->driver) < 0 ||
+	    get_str(&cp, end, &dp->path) < 0 ||
+	    get_str(&cp, end, &dp->phys) < 0 ||
+	    get_str(&cp, end, &s) < 0)
+	    return -1;
+	DISK_SETSTR(dp, size, s, DRV_SIZESIZE, 0);
+    }
+
+    /* Trailing bytes mean a different encoding */
+    if (cp != end)
+	return -1;
+
+    return n;
+}
+
+
+int
+drvlist_table_save(const char *path,
+		   const DISK *dv,
+		   int dc) {
+    char tmp[1024], *buf;
+    size_t len;
+    int fd, rc = -1;
+
+    if (drvlist_encode(dv, dc, &buf, &len) < 0)
+	return -1;
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    fd = open(tmp, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+    if (fd >= 0) {
+	ssize_t n = write(fd, buf, len);
+
+	if (n >= 0 && n < (ssize_t) len)
+	    errno = ENOSPC;		/* Short write */
+
+	/* Close in any case, but a failed close fails the save */
+	if (close(fd) < 0)
+	    n = -1;
+	if (n == (ssize_t) len && rename(tmp, path) == 0)
+	    rc = 0;
+	else {
+	    int err = errno;
+
+	    unlink(tmp);
+	    errno = err;
+	}
+    }
+
+    free(buf);
+    return rc;
+}
+
+
+/*
+ * Read a table file. The drives point into *bufp, both are malloc'd.
+ * Returns the number of drives or -1.
+ */
+int
+drvlist_table_load(const char *path,
+		   DISK **dvp,
+		   char **bufp) {
+    struct stat sb;
+    char *buf = NULL;
+    DISK *dv = NULL;
+    int fd, n = -1, ds = 0;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+	return -1;
+
+    if (fstat(fd, &sb) < 0 || !(buf = malloc(sb.st_size > 0 ? sb.st_size : 1)) ||
+	read(fd, buf, sb.st_size) != sb.st_size)
+	goto End;
+
+    n = drvlist_decode(buf, sb.st_size, &dv, &ds);
+    if (n < 0)
+	errno = EINVAL;
+
+ End:
+    close(fd);
+    if (n < 0) {
+	free(buf);
+	free(dv);
+	return -1;
+    }
+    *dvp = dv;
+    *bufp = buf;
+    return n;
+}
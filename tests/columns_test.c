@@ -0,0 +1,502 @@
+/*
+ * columns_test.c
+ *
+ * Tests and benchmark for the drive table column store (columns.c).
+ *
+ * Usage: columns_test [-b <rounds>] [<drives>]
+ *
+ * Without -b the column widths, cutting and row order are checked,
+ * and that large tables (radix sorted) come out in the same order as
+ * the comparison function used for small ones gives.
+ * With -b a table of <drives> (default 100000) rows is prepared for
+ * printing both ways: as the column store does it, and as it was done
+ * before it, by trimming the fields of every DISK in place and
+ * sorting the DISK array itself.
+ *
+ * Copyright (c) 2024 Peter Eriksson <pen@lysator.liu.se>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+
+#include "drvlist.h"
+#include "test.h"
+
+
+int f_debug = 0;
+
+
+/*
+ * A dual-path JBOD drive: vendor/product/revision space padded as
+ * from SCSI inquiry, driver and path as CAM reports them.
+ */
+static void
+disk_fill(DISK *dp,
+	  int i,
+	  int n) {
+    char buf[128];
+
+    memset(dp, 0, sizeof(*dp));
+    snprintf(dp->ident, sizeof(dp->ident), "ZL2%05d", i);
+    snprintf(dp->vendor, sizeof(dp->vendor), "%-8s", i % 3 ? "SEAGATE" : "WDC");
+    snprintf(dp->product, sizeof(dp->product), "%-16s", i % 3 ? "ST18000NM004J" : "WUH721818AL5204");
+    snprintf(dp->revision, sizeof(dp->revision), "%-4s", i % 3 ? "E004" : "C870");
+    drvlist_size2buf(18000207937536LL, dp->size, sizeof(dp->size));
+
+    snprintf(buf, sizeof(buf), "da%d,da%d", i, i+n);
+    dp->danames = strdup(buf);
+    snprintf(buf, sizeof(buf), "mpr%d,mpr%d", i % 4, i % 4 + 4);
+    dp->driver = strdup(buf);
+    snprintf(buf, sizeof(buf), "mpr%d bus %d target %d lun 0,mpr%d bus %d target %d lun 0",
+	     i % 4, i / 4096, i / 4 % 1024, i % 4 + 4, i / 4096, i / 4 % 1024);
+    dp->path = strdup(buf);
+    snprintf(buf, sizeof(buf), "enc@n5003048%07x/type@0/slot@%d", i / 96, i % 96 + 1);
+    dp->phys = strdup(buf);
+}
+
+static void
+disk_clear(DISK *dp) {
+    free(dp->danames);
+    free(dp->driver);
+    free(dp->path);
+    free(dp->phys);
+}
+
+
+static int
+col_is(const COLS *cp,
+       int c,
+       int i,
+       const char *s) {
+    return cp->len[c][i] == strlen(s) && memcmp(cp->str[c][i], s, cp->len[c][i]) == 0;
+}
+
+static void
+test_build(void) {
+    DISK dv[3];
+    COLS cols;
+    int i;
+
+
+    for (i = 0; i < 3; i++)
+	disk_fill(&dv[i], i, 3);
+    strcpy(dv[1].vendor, "  ");
+    free(dv[2].path);
+    dv[2].path = strdup("  mpr1 bus 0 target 2 lun 0,mpr5 bus 0 target 2 lun 0,mpr9 bus 1 target 2 lun 0  ");
+
+    TEST(cols_build(&cols, dv, 3, 20) == 0);
+    TEST(cols.n == 3);
+    TEST(col_is(&cols, COL_VENDOR, 0, "WDC"));
+    TEST(col_is(&cols, COL_VENDOR, 1, "?"));
+    TEST(col_is(&cols, COL_PRODUCT, 0, "WUH721818AL5204"));
+    TEST(col_is(&cols, COL_PATH, 2, "mpr1 bus 0 target 2 lun 0,mpr5 bus 0 target 2 lun 0,mpr9 bus 1 target 2 lun 0"));
+    TEST(col_is(&cols, COL_ZPOOL, 0, "-"));
+
+    /* Widest value, at least the heading, at most -W */
+    TEST(cols.width[COL_VENDOR] == 7);
+    TEST(cols.width[COL_PRODUCT] == 15);
+    TEST(cols.width[COL_PATH] == 20);
+    TEST(cols.width[COL_FW] == 2);
+    cols_free(&cols);
+
+    TEST(cols_build(&cols, dv, 3, 0) == 0);
+    TEST(cols.width[COL_PATH] == (int) strlen("mpr1 bus 0 target 2 lun 0,mpr5 bus 0 target 2 lun 0,mpr9 bus 1 target 2 lun 0"));
+    cols_free(&cols);
+
+    /* An empty table gets the heading widths */
+    TEST(cols_build(&cols, dv, 0, 20) == 0);
+    TEST(cols.n == 0 && cols.width[COL_IDENT] == 7);
+    cols_free(&cols);
+
+    for (i = 0; i < 3; i++)
+	disk_clear(&dv[i]);
+}
+
+
+static void
+test_sort(void) {
+    static const char *paths[] = {
+	"mpr1 bus 0 target 10 lun 0",
+	"mpr1 bus 0 target 9 lun 0",
+	"mpr0 bus 0 target 100 lun 0",
+	"mpr1 bus 0 target 009 lun 0",
+	"mpr1 bus 0 target 9 lun 0",
+    };
+    static const int order[] = { 2, 1, 3, 4, 0 };
+    DISK dv[5];
+    COLS cols;
+    int i, ok;
+
+
+    for (i = 0; i < 5; i++) {
+	disk_fill(&dv[i], i, 5);
+	free(dv[i].driver);
+	free(dv[i].path);
+	dv[i].driver = strdup(i == 2 ? "mpr0" : "mpr1");
+	dv[i].path = strdup(paths[i]);
+    }
+
+    /* Natural order, ties (9 and 009) keep discovery order */
+    TEST(cols_build(&cols, dv, 5, 20) == 0);
+    TEST(cols_sort(&cols, NULL) == 0);
+    for (ok = 1, i = 0; i < 5; i++)
+	if (cols.order[i] != order[i])
+	    ok = 0;
+    TEST(ok);
+
+    cols_reorder(&cols, dv);
+    TEST(strcmp(dv[0].path, paths[2]) == 0 && strcmp(dv[4].path, paths[0]) == 0);
+    cols_free(&cols);
+
+    for (i = 0; i < 5; i++)
+	disk_clear(&dv[i]);
+}
+
+
+/*
+ * Check that rows a and b, adjacent in a sorted large table, are in
+ * the order the comparison function (the qsort() path used for small
+ * tables) puts them in.
+ */
+static int
+pair_ordered(const DISK *dv,
+	     int a,
+	     int b,
+	     const char *key) {
+    DISK pv[2];
+    COLS cols;
+    int lo = a < b ? a : b, ok;
+
+
+    pv[0] = dv[lo];
+    pv[1] = dv[lo == a ? b : a];
+    if (cols_build(&cols, pv, 2, 0) < 0 || cols_sort(&cols, key) < 0)
+	return 0;
+    ok = (cols.order[0] == 0) == (lo == a);
+    cols_free(&cols);
+    return ok;
+}
+
+/* A path of tokens that encode awkwardly: digit runs of all lengths, separators */
+static char *
+random_path(void) {
+    static const char *tok[] = { "x", "mpr", " ", ",", "-", ".", ":", "z", "lun ", "target " };
+    char buf[256];
+    int i, k, len = 0, n = 1 + random() % 12;
+
+
+    for (i = 0; i < n && len < 200; i++) {
+	if (random() % 3 == 0) {
+	    k = random() % 3 == 0 ? 1 + random() % 50 : 1 + random() % 4;
+	    while (k-- > 0)
+		buf[len++] = random() % 4 == 0 ? '0' : '0' + random() % 10;
+	} else {
+	    const char *t = tok[random() % (sizeof(tok)/sizeof(tok[0]))];
+
+	    k = 1 + (t[0] == 'x' ? random() % 45 : 0);
+	    while (k-- > 0)
+		len += snprintf(buf+len, sizeof(buf)-len, "%s", t);
+	}
+    }
+    buf[len] = '\0';
+    return strdup(buf);
+}
+
+static void
+test_radix(void) {
+    DISK *dv;
+    COLS cols;
+    char buf[64];
+    int i, n = 1100, bad = 0, bad_ident = 0;
+
+
+    srandom(1);
+    dv = calloc(n, sizeof(DISK));
+    for (i = 0; i < n; i++) {
+	disk_fill(&dv[i], i, n);
+	free(dv[i].driver);
+	free(dv[i].path);
+	dv[i].driver = random() % 2 ? random_path() : strdup("mpr0");
+	dv[i].path = random_path();
+	snprintf(dv[i].ident, sizeof(dv[i].ident), "%.*s%ld",
+		 (int) (random() % 40), "WD-WX3192D0LLLLLLLLLLLLLLLLLLLLLLLLLLLLLLLLLL", random() % 100000);
+    }
+
+    /* A digit run cut off at the end of the encoded path key */
+    free(dv[7].driver);
+    free(dv[7].path);
+    free(dv[8].driver);
+    free(dv[8].path);
+    dv[7].driver = strdup("mpr0");
+    dv[8].driver = strdup("mpr0");
+    memset(buf, 'x', 38);
+    strcpy(buf+38, "12345");
+    dv[7].path = strdup(buf);
+    strcpy(buf+38, " z");
+    dv[8].path = strdup(buf);
+
+    TEST(cols_build(&cols, dv, n, 0) == 0 && cols_sort(&cols, NULL) == 0);
+    for (i = 1; i < n; i++)
+	if (!pair_ordered(dv, cols.order[i-1], cols.order[i], NULL))
+	    ++bad;
+    cols_free(&cols);
+
+    TEST(cols_build(&cols, dv, n, 0) == 0 && cols_sort(&cols, "ident") == 0);
+    for (i = 1; i < n; i++)
+	if (!pair_ordered(dv, cols.order[i-1], cols.order[i], "ident"))
+	    ++bad_ident;
+    cols_free(&cols);
+
+    if (bad || bad_ident)
+	fprintf(stderr, "%d (path) and %d (ident) of %d adjacent rows out of order\n",
+		bad, bad_ident, n-1);
+    TEST(bad == 0);
+    TEST(bad_ident == 0);
+
+    for (i = 0; i < n; i++)
+	disk_clear(&dv[i]);
+    free(dv);
+}
+
+
+/* The table preparation before the column store, for comparison */
+static int
+row_strtrim(char *str,
+	    int *len) {
+    int i, j, n;
+
+    if (!str)
+	return 0;
+
+    for (i = 0; str[i] && isspace(str[i]); i++)
+	;
+    if (i > 0) {
+	for (j = 0; str[i]; j++, i++)
+	    str[j] = str[i];
+	str[j] = '\0';
+    }
+
+    n = strlen(str);
+    while (n > 0 && isspace(str[n-1]))
+	--n;
+    str[n] = '\0';
+    if (len && n > *len)
+	*len = n;
+    return n;
+}
+
+static int
+row_strntrim(char *str,
+	     int *len,
+	     int max) {
+    int rlen = row_strtrim(str, len);
+
+    if (max > 0 && rlen+2 > max) {
+	str[max-2] = '.';
+	str[max-1] = '.';
+	str[max] = '\0';
+	rlen = max;
+	if (len)
+	    *len = rlen;
+    }
+    return rlen;
+}
+
+static int
+row_cmp(const void *a,
+	const void *b) {
+    const DISK *da = (const DISK *) a;
+    const DISK *db = (const DISK *) b;
+    int d;
+
+    d = strcmp(da->driver, db->driver);
+    if (d)
+	return d;
+    return strcmp(da->path, db->path);
+}
+
+static int
+row_prepare(DISK *dv,
+	    int dc,
+	    int maxwidth) {
+    int wv[COL_MAX];
+    int i;
+
+    memset(wv, 0, sizeof(wv));
+    for (i = 0; i < dc; i++) {
+	row_strntrim(dv[i].ident, &wv[COL_IDENT], maxwidth);
+	row_strntrim(dv[i].vendor, &wv[COL_VENDOR], maxwidth);
+	row_strntrim(dv[i].product, &wv[COL_PRODUCT], maxwidth);
+	row_strntrim(dv[i].revision, &wv[COL_REVISION], maxwidth);
+	row_strntrim(dv[i].danames, &wv[COL_NAMES], maxwidth);
+	row_strntrim(dv[i].driver, &wv[COL_DRIVER], maxwidth);
+	row_strntrim(dv[i].path, &wv[COL_PATH], maxwidth);
+	row_strntrim(dv[i].phys, &wv[COL_PHYS], maxwidth);
+	row_strntrim(dv[i].size, &wv[COL_SIZE], maxwidth);
+	row_strntrim(dv[i].lat_p50, &wv[COL_P50], maxwidth);
+	row_strntrim(dv[i].lat_p99, &wv[COL_P99], maxwidth);
+	row_strntrim(dv[i].lat_p999, &wv[COL_P999], maxwidth);
+	row_strntrim(dv[i].zpool, &wv[COL_ZPOOL], maxwidth);
+	row_strntrim(dv[i].zguid, &wv[COL_ZGUID], maxwidth);
+	row_strntrim(dv[i].mpath, &wv[COL_MPATH], maxwidth);
+	row_strntrim(dv[i].labels, &wv[COL_LABELS], maxwidth);
+	row_strntrim(dv[i].parts, &wv[COL_PARTS], maxwidth);
+    }
+
+    qsort(dv, dc, sizeof(*dv), row_cmp);
+    return wv[COL_PATH];
+}
+
+
+/* Fresh copies, so both ways start from the same memory state */
+static void
+disk_copy(DISK *dv,
+	  const DISK *orig,
+	  int dc) {
+    int i;
+
+    memcpy(dv, orig, dc*sizeof(*dv));
+    for (i = 0; i < dc; i++) {
+	dv[i].danames = strdup(orig[i].danames);
+	dv[i].driver = strdup(orig[i].driver);
+	dv[i].path = strdup(orig[i].path);
+	dv[i].phys = strdup(orig[i].phys);
+    }
+}
+
+/*
+ * Each round starts from the same unsorted, untrimmed drives. Trimming
+ * in place (the old way) changes the strings, so both ways work on
+ * copies made outside the timed part.
+ */
+static void
+bench(DISK *orig,
+      int dc,
+      int rounds) {
+    DISK *dv;
+    COLS cols;
+    uint64_t t, t1, t2, trow = 0, tbuild = 0, tsort = 0, treorder = 0;
+    int r, i;
+
+
+    dv = malloc(dc*sizeof(*dv));
+    if (!dv) {
+	fprintf(stderr, "columns_test: Error: Memory allocation failure\n");
+	exit(1);
+    }
+
+    for (r = 0; r < rounds; r++) {
+	disk_copy(dv, orig, dc);
+	t = test_now_ns();
+	row_prepare(dv, dc, 0);
+	trow += test_now_ns() - t;
+	for (i = 0; i < dc; i++)
+	    disk_clear(&dv[i]);
+
+	disk_copy(dv, orig, dc);
+	t = test_now_ns();
+	if (cols_build(&cols, dv, dc, 0) < 0)
+	    break;
+	t1 = test_now_ns();
+	if (cols_sort(&cols, NULL) < 0)
+	    break;
+	t2 = test_now_ns();
+	cols_reorder(&cols, dv);
+	treorder += test_now_ns() - t2;
+	tsort += t2 - t1;
+	tbuild += t1 - t;
+	cols_free(&cols);
+	for (i = 0; i < dc; i++)
+	    disk_clear(&dv[i]);
+    }
+    free(dv);
+
+    printf("row layout:   %8.2f ms/round  (trim DISK fields in place, strcmp() qsort of DISKs)\n",
+	   trow / 1e6 / rounds);
+    printf("column store: %8.2f ms/round  (build %.2f, natural order sort %.2f, reorder %.2f)\n",
+	   (tbuild + tsort + treorder) / 1e6 / rounds,
+	   tbuild / 1e6 / rounds, tsort / 1e6 / rounds, treorder / 1e6 / rounds);
+    printf("%d drives, %d rounds, %lu byte DISK\n", dc, rounds, (unsigned long) sizeof(DISK));
+}
+
+
+int
+main(int argc,
+     char *argv[]) {
+    DISK *dv;
+    int i, c, rounds = 0, drives = 100000;
+
+
+    while ((c = getopt(argc, argv, "b:")) != -1) {
+	switch (c) {
+	case 'b':
+	    rounds = atoi(optarg);
+	    break;
+	default:
+	    goto Usage;
+	}
+    }
+    if (optind < argc)
+	drives = atoi(argv[optind++]);
+    if (optind < argc || drives < 1 || rounds < 0)
+	goto Usage;
+
+    test_build();
+    test_sort();
+    test_radix();
+    if (rounds == 0)
+	return test_done(argv[0]);
+
+    dv = calloc(drives, sizeof(DISK));
+    if (!dv) {
+	fprintf(stderr, "%s: Error: Memory allocation failure\n", argv[0]);
+	exit(1);
+    }
+
+    /* Discovery order: all first paths, shuffled by controller */
+    for (i = 0; i < drives; i++)
+	disk_fill(&dv[i], (int) ((i * 7919ULL) % drives), drives);
+
+    bench(dv, drives, rounds);
+
+    for (i = 0; i < drives; i++)
+	disk_clear(&dv[i]);
+    free(dv);
+    return test_done(argv[0]);
+
+ Usage:
+    fprintf(stderr, "Usage: %s [-b <rounds>] [<drives>]\n", argv[0]);
+    exit(1);
+}
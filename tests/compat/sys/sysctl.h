@@ -0,0 +1,22 @@
+/*
+ * sys/sysctl.h for building the tests on systems without it (Linux).
+ * The tests provide their own sysctlbyname() that serves fixtures.
+ */
+
+#ifndef TESTS_COMPAT_SYS_SYSCTL_H
+#define TESTS_COMPAT_SYS_SYSCTL_H 1
+
+#if defined(__FreeBSD__)
+#include_next <sys/sysctl.h>
+#else
+#include <stddef.h>
+
+extern int
+sysctlbyname(const char *name,
+	     void *oldp,
+	     size_t *oldlenp,
+	     const void *newp,
+	     size_t newlen);
+#endif
+
+#endif
@@ -0,0 +1,332 @@
+/*
+ * fixstr_test.c
+ *
+ * Tests and microbenchmarks for the identify string helpers (fixstr.c).
+ *
+ * Usage: fixstr_test [-b <rounds>]
+ *
+ * The helpers as built for this CPU (SSE2/AVX2 or NEON) are compared
+ * with the same file built with -DFIXSTR_SCALAR (scalar_*) and with
+ * plain isspace() loops, over every length up to 80 at every alignment
+ * within 16 bytes. With -b the vector and scalar versions are timed on
+ * typical field sizes.
+ *
+ * Copyright (c) 2024 Peter Eriksson <pen@lysator.liu.se>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <sys/types.h>
+
+#include "libdrvlist.h"
+#include "test.h"
+
+
+#define MAXLEN 80
+
+extern size_t
+scalar_trimspan(const char *s,
+		size_t n,
+		size_t *offp);
+
+extern size_t
+scalar_collapse(char *dst,
+		const char *s,
+		size_t n);
+
+extern int
+scalar_allzero(const void *buf,
+	       size_t len);
+
+
+/* Bytes around the edges of the whitespace ranges, and all of them */
+static const unsigned char charset[] = {
+    ' ', '\t', '\n', '\v', '\f', '\r', 0x08, 0x0e, 0x1f, '!',
+    0x00, 'A', '0', 0x7f, 0x80, 0x85, 0x89, 0xa0, 0xff,
+};
+
+
+static size_t
+ref_trimspan(const char *s,
+	     size_t n,
+	     size_t *offp) {
+    size_t i = 0;
+
+    while (i < n && isspace((unsigned char) s[i]))
+	++i;
+    *offp = i;
+    while (n > i && isspace((unsigned char) s[n-1]))
+	--n;
+    return n-i;
+}
+
+static size_t
+ref_collapse(char *dst,
+	     const char *s,
+	     size_t n) {
+    size_t i, o = 0;
+
+    for (i = 0; i < n; i++)
+	if (!isspace((unsigned char) s[i]) || i == 0 || !isspace((unsigned char) s[i-1]))
+	    dst[o++] = s[i];
+    return o;
+}
+
+
+/* Run all three versions on s[0..n-1], return 0 if they differ */
+static int
+check_one(const char *s,
+	  size_t n) {
+    char d1[MAXLEN+16], d2[MAXLEN+16], d3[MAXLEN+16], in[MAXLEN+16];
+    size_t o1, o2, o3, l1, l2, l3;
+
+
+    l1 = drvlist_trimspan(s, n, &o1);
+    l2 = scalar_trimspan(s, n, &o2);
+    l3 = ref_trimspan(s, n, &o3);
+    if (l1 != l3 || o1 != o3 || l2 != l3 || o2 != o3)
+	return 0;
+
+    l1 = drvlist_collapse(d1, s, n);
+    l2 = scalar_collapse(d2, s, n);
+    l3 = ref_collapse(d3, s, n);
+    if (l1 != l3 || l2 != l3 || memcmp(d1, d3, l3) != 0 || memcmp(d2, d3, l3) != 0)
+	return 0;
+
+    /* In place */
+    memcpy(in, s, n);
+    l1 = drvlist_collapse(in, in, n);
+    if (l1 != l3 || memcmp(in, d3, l3) != 0)
+	return 0;
+
+    return 1;
+}
+
+
+static void
+test_blank(void) {
+    char buf[MAXLEN+32];
+    size_t n, a, i, k;
+    int bad = 0, c;
+
+
+    for (a = 0; a < 16; a++) {
+	char *s = buf + a;
+
+	for (n = 0; n <= MAXLEN; n++) {
+	    /* All whitespace, of each kind and mixed */
+	    for (c = 0; c < 6; c++) {
+		memset(s, charset[c], n);
+		bad += !check_one(s, n);
+	    }
+	    for (i = 0; i < n; i++)
+		s[i] = charset[i % 6];
+	    bad += !check_one(s, n);
+
+	    /* One other byte in whitespace, at every position */
+	    for (k = 6; k < sizeof(charset); k++)
+		for (i = 0; i < n; i++) {
+		    memset(s, ' ', n);
+		    s[i] = charset[k];
+		    bad += !check_one(s, n);
+		}
+
+	    /* A padded field: text, runs of whitespace, padding */
+	    for (i = 0; i < n; i++)
+		s[i] = (i * 7 + n) % 5 < 2 ? charset[(i + a) % 6] : 'a' + i % 26;
+	    bad += !check_one(s, n);
+	}
+    }
+
+    /* Random bytes from the set */
+    srandom(1);
+    for (k = 0; k < 200000; k++) {
+	a = random() % 16;
+	n = random() % (MAXLEN+1);
+	for (i = 0; i < n; i++)
+	    buf[a+i] = charset[random() % sizeof(charset)];
+	bad += !check_one(buf+a, n);
+    }
+
+    if (bad)
+	fprintf(stderr, "%d trim/collapse inputs differ\n", bad);
+    TEST(bad == 0);
+}
+
+
+static void
+test_zero(void) {
+    static char buf[4096+64];
+    size_t n, a, i;
+    int bad = 0;
+
+
+    for (a = 0; a < 16; a++)
+	for (n = 0; n <= 160; n++) {
+	    memset(buf, 0, sizeof(buf));
+	    if (drvlist_allzero(buf+a, n) != 1 || scalar_allzero(buf+a, n) != 1)
+		++bad;
+
+	    /* One non-zero byte at every position, and just outside */
+	    for (i = 0; i < n; i++) {
+		buf[a+i] = i % 2 ? (char) 0x80 : 1;
+		if (drvlist_allzero(buf+a, n) != 0 || scalar_allzero(buf+a, n) != 0)
+		    ++bad;
+		buf[a+i] = 0;
+	    }
+	    buf[a+n] = 1;
+	    if (drvlist_allzero(buf+a, n) != 1)
+		++bad;
+	    if (a > 0) {
+		buf[a-1] = 1;
+		if (drvlist_allzero(buf+a, n) != 1)
+		    ++bad;
+	    }
+	}
+
+    /* IDENTIFY sized buffers */
+    memset(buf, 0, sizeof(buf));
+    TEST(drvlist_allzero(buf, 512) == 1 && drvlist_allzero(buf, 4096) == 1);
+    buf[511] = 1;
+    TEST(drvlist_allzero(buf, 512) == 0 && drvlist_allzero(buf, 511) == 1);
+    buf[511] = 0;
+    buf[4095] = 1;
+    TEST(drvlist_allzero(buf, 4096) == 0);
+
+    if (bad)
+	fprintf(stderr, "%d all-zero inputs differ\n", bad);
+    TEST(bad == 0);
+}
+
+
+static volatile size_t sink;
+
+/* Identify fields as drives return them: text, then space padding */
+static void
+bench(int rounds) {
+    static const struct {
+	const char *name;
+	const char *text;
+	size_t len;
+    } fv[] = {
+	{ "inquiry vendor",   "WDC",                 8 },
+	{ "inquiry product",  "WUH721818AL5204",    16 },
+	{ "ATA serial",       "   2JKLNMEB",        20 },
+	{ "ATA model",        "WDC  WUH721818ALE6L4", 40 },
+	{ "NVMe model",       "INTEL SSDPEDMW400G4", 40 },
+	{ NULL, NULL, 0 }
+    };
+    static char zbuf[4096];
+    char buf[64], dst[64];
+    size_t off;
+    uint64_t t0, t1, t2;
+    int i, r;
+
+
+    printf("%-18s %5s %12s %12s %12s %12s\n",
+	   "field", "bytes", "trim", "trim scalar", "collapse", "coll. scalar");
+    for (i = 0; fv[i].name; i++) {
+	size_t n = fv[i].len;
+	uint64_t tt, ts;
+
+	memset(buf, ' ', n);
+	memcpy(buf, fv[i].text, strlen(fv[i].text));
+
+	t0 = test_now_ns();
+	for (r = 0; r < rounds; r++)
+	    sink += drvlist_trimspan(buf, n, &off) + off;
+	t1 = test_now_ns();
+	for (r = 0; r < rounds; r++)
+	    sink += scalar_trimspan(buf, n, &off) + off;
+	t2 = test_now_ns();
+	tt = t1-t0;
+	ts = t2-t1;
+
+	t0 = test_now_ns();
+	for (r = 0; r < rounds; r++)
+	    sink += drvlist_collapse(dst, buf, n);
+	t1 = test_now_ns();
+	for (r = 0; r < rounds; r++)
+	    sink += scalar_collapse(dst, buf, n);
+	t2 = test_now_ns();
+
+	printf("%-18s %5lu %9.2f ns %9.2f ns %9.2f ns %9.2f ns\n",
+	       fv[i].name, (unsigned long) n,
+	       (double) tt / rounds, (double) ts / rounds,
+	       (double) (t1-t0) / rounds, (double) (t2-t1) / rounds);
+    }
+
+    printf("\n%-18s %5s %12s %12s\n", "zero check", "bytes", "allzero", "scalar");
+    for (i = 512; i <= 4096; i *= 8) {
+	t0 = test_now_ns();
+	for (r = 0; r < rounds; r++)
+	    sink += drvlist_allzero(zbuf, i);
+	t1 = test_now_ns();
+	for (r = 0; r < rounds; r++)
+	    sink += scalar_allzero(zbuf, i);
+	t2 = test_now_ns();
+	printf("%-18s %5d %9.2f ns %9.2f ns\n",
+	       i == 512 ? "ATA IDENTIFY" : "NVMe identify", i,
+	       (double) (t1-t0) / rounds, (double) (t2-t1) / rounds);
+    }
+}
+
+
+int
+main(int argc,
+     char *argv[]) {
+    int c, rounds = 0;
+
+
+    while ((c = getopt(argc, argv, "b:")) != -1) {
+	switch (c) {
+	case 'b':
+	    rounds = atoi(optarg);
+	    break;
+	default:
+	    goto Usage;
+	}
+    }
+    if (optind < argc || rounds < 0)
+	goto Usage;
+
+    test_blank();
+    test_zero();
+    if (rounds > 0)
+	bench(rounds);
+    return test_done(argv[0]);
+
+ Usage:
+    fprintf(stderr, "Usage: %s [-b <rounds>]\n", argv[0]);
+    exit(1);
+}
@@ -0,0 +1,356 @@
+/*
+ * geom_test.c
+ *
+ * Tests and benchmark for the kern.geom.confxml parser (geom.c).
+ *
+ * Usage: geom_test <confxml.small>
+ *        geom_test [-b <rounds>] <confxml> <drives> <paths>
+ *
+ * The first form checks the hand written fixture, the second one a
+ * mesh written by mkconfxml with the same drive and path counts, and
+ * with -b also times parsing and annotating it.
+ *
+ * Copyright (c) 2024 Peter Eriksson <pen@lysator.liu.se>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/sysctl.h>
+
+#include "drvlist.h"
+#include "test.h"
+
+
+int f_debug = 0;
+
+static char *fixture;
+static size_t fixture_len;
+
+
+/* Serve the fixture as kern.geom.confxml, for geom_load() */
+int
+sysctlbyname(const char *name,
+	     void *oldp,
+	     size_t *oldlenp,
+	     const void *newp,
+	     size_t newlen) {
+    if (strcmp(name, "kern.geom.confxml") != 0) {
+	errno = ENOENT;
+	return -1;
+    }
+
+    if (oldp) {
+	if (*oldlenp < fixture_len+1) {
+	    errno = ENOMEM;
+	    return -1;
+	}
+	memcpy(oldp, fixture, fixture_len+1);
+    }
+    *oldlenp = fixture_len+1;
+    return 0;
+}
+
+
+/* Number of items in a comma separated list, 0 if NULL */
+static int
+list_count(const char *list) {
+    int n = 1;
+
+    if (!list)
+	return 0;
+    while ((list = strchr(list, ',')) != NULL) {
+	++list;
+	++n;
+    }
+    return n;
+}
+
+static int
+list_has(const char *list,
+	 const char *item) {
+    size_t len = strlen(item);
+
+    while (list && *list) {
+	if (strncmp(list, item, len) == 0 && (list[len] == ',' || list[len] == '\0'))
+	    return 1;
+	list = strchr(list, ',');
+	if (list)
+	    ++list;
+    }
+    return 0;
+}
+
+
+static void
+disk_init(DISK *dp,
+	  const char *name1,
+	  const char *name2) {
+    memset(dp, 0, sizeof(*dp));
+    dp->pv = calloc(2, sizeof(DPATH));
+    dp->pv[dp->pc++].name = strdup(name1);
+    if (name2)
+	dp->pv[dp->pc++].name = strdup(name2);
+}
+
+static void
+disk_clear(DISK *dp) {
+    int i;
+
+    for (i = 0; i < dp->pc; i++)
+	free(dp->pv[i].name);
+    free(dp->pv);
+    free(dp->parts);
+    free(dp->labels);
+    free(dp->mpath);
+    memset(dp, 0, sizeof(*dp));
+}
+
+
+static void
+test_errors(void) {
+    static const char *bad[] = {
+	"<mesh><class><name>DISK</name></class>",		/* Unclosed */
+	"<mesh><class></geom></mesh>",				/* Mismatched */
+	"<mesh><geom id=\"0x1></geom></mesh>",			/* Unterminated value */
+	"<mesh><geom id=0x1></geom></mesh>",			/* Unquoted value */
+	"<mesh></mesh></mesh>",					/* Extra close */
+	"<mesh><a><b><c><d><e><f><g><h><i><j><k><l><m><n><o><p><q>",	/* Too deep */
+	"<mesh",
+	NULL
+    };
+    int i;
+
+    for (i = 0; bad[i]; i++) {
+	errno = 0;
+	TEST(geom_parse(bad[i], strlen(bad[i])) < 0 && errno == EINVAL);
+    }
+
+    /* An empty mesh is fine, but knows no providers */
+    TEST(geom_parse("<mesh></mesh>", 13) == 0);
+    {
+	off_t msize = 0;
+
+	TEST(geom_mediasize("da0", &msize) < 0);
+    }
+}
+
+
+static void
+test_small(void) {
+    DISK dv[3];
+    off_t msize = 0;
+
+
+    TEST(geom_parse(fixture, fixture_len) == 0);
+
+    TEST(geom_mediasize("da0", &msize) == 0 && msize == 12000138625024LL);
+    TEST(geom_mediasize("da0p1", &msize) < 0);		/* Not a DISK provider */
+    TEST(geom_mediasize("da99", &msize) < 0);
+
+    disk_init(&dv[0], "da0", NULL);
+    disk_init(&dv[1], "da1", "da2");
+    disk_init(&dv[2], "da99", NULL);
+    TEST(geom_annotate(dv, 3) == 0);
+
+    TEST(dv[0].msize == 12000138625024LL && dv[0].sectorsize == 512);
+    TEST(strcmp(dv[0].size, "12T") == 0);
+    TEST(list_count(dv[0].parts) == 2 &&
+	 list_has(dv[0].parts, "da0p1") && list_has(dv[0].parts, "da0p2"));
+    TEST(list_count(dv[0].labels) == 2 &&
+	 list_has(dv[0].labels, "diskid/DISK-5PGTSWAC") && list_has(dv[0].labels, "gpt/zfs0"));
+    TEST(dv[0].mpath == NULL);
+
+    /* Both paths reach the multipath geom; everything listed once */
+    TEST(dv[1].mpath && strcmp(dv[1].mpath, "disk1") == 0);
+    TEST(list_count(dv[1].parts) == 2 &&
+	 list_has(dv[1].parts, "multipath/disk1p1") && list_has(dv[1].parts, "multipath/disk1p2"));
+    TEST(dv[1].labels && strcmp(dv[1].labels, "gpt/data&1") == 0);
+    TEST(dv[1].sectorsize == 4096);
+
+    TEST(dv[2].msize == 0 && !dv[2].parts && !dv[2].labels && !dv[2].mpath);
+
+    disk_clear(&dv[0]);
+    disk_clear(&dv[1]);
+    disk_clear(&dv[2]);
+
+    /* Same result through the sysctl */
+    TEST(geom_load() == 0);
+    TEST(geom_mediasize("da2", &msize) == 0 && msize == 18000207937536LL);
+}
+
+
+static void
+test_large(DISK *dv,
+	   int drives,
+	   int paths) {
+    char buf[128];
+    int i, bad = 0;
+
+
+    TEST(geom_parse(fixture, fixture_len) == 0);
+    TEST(geom_annotate(dv, drives) == 0);
+
+    for (i = 0; i < drives; i++) {
+	DISK *dp = &dv[i];
+
+	snprintf(buf, sizeof(buf), "disk%d", i);
+	if (!dp->mpath || strcmp(dp->mpath, buf) != 0 ||
+	    dp->sectorsize != 4096 || dp->msize != 18000207937536LL ||
+	    list_count(dp->parts) != 2 || list_count(dp->labels) != 4) {
+	    ++bad;
+	    continue;
+	}
+
+	snprintf(buf, sizeof(buf), "multipath/disk%dp2", i);
+	if (!list_has(dp->parts, buf))
+	    ++bad;
+	snprintf(buf, sizeof(buf), "gpt/zfs%d", i);
+	if (!list_has(dp->labels, buf))
+	    ++bad;
+	snprintf(buf, sizeof(buf), "diskid/DISK-ZL2%05d", i);
+	if (!list_has(dp->labels, buf))
+	    ++bad;
+    }
+
+    if (bad)
+	fprintf(stderr, "%d of %d drives annotated wrongly (%d paths)\n", bad, drives, paths);
+    TEST(bad == 0);
+}
+
+
+static void
+bench_large(DISK *dv,
+	    int drives,
+	    int rounds) {
+    uint64_t t0, t1, t2;
+    int r, i;
+
+
+    t0 = test_now_ns();
+    for (r = 0; r < rounds; r++)
+	if (geom_parse(fixture, fixture_len) < 0)
+	    break;
+    t1 = test_now_ns();
+
+    for (r = 0; r < rounds; r++) {
+	for (i = 0; i < drives; i++) {
+	    free(dv[i].parts);
+	    free(dv[i].labels);
+	    free(dv[i].mpath);
+	    dv[i].parts = dv[i].labels = dv[i].mpath = NULL;
+	    dv[i].msize = 0;
+	    dv[i].sectorsize = 0;
+	}
+	geom_annotate(dv, drives);
+    }
+    t2 = test_now_ns();
+
+    printf("geom_parse:    %8.3f ms/round  %7.1f MB/s  (%lu bytes, %d rounds)\n",
+	   (t1-t0) / 1e6 / rounds,
+	   fixture_len * (double) rounds / ((t1-t0) / 1e9) / 1e6,
+	   (unsigned long) fixture_len, rounds);
+    printf("geom_annotate: %8.3f ms/round  %7.2f us/drive  (%d drives)\n",
+	   (t2-t1) / 1e6 / rounds,
+	   (t2-t1) / 1e3 / rounds / drives,
+	   drives);
+}
+
+
+int
+main(int argc,
+     char *argv[]) {
+    DISK *dv;
+    char name1[32], name2[32];
+    int i, c, rounds = 0, drives, paths;
+
+
+    while ((c = getopt(argc, argv, "b:")) != -1) {
+	switch (c) {
+	case 'b':
+	    rounds = atoi(optarg);
+	    break;
+	default:
+	    goto Usage;
+	}
+    }
+
+    if (optind >= argc)
+	goto Usage;
+
+    fixture = test_readfile(argv[optind], &fixture_len);
+    if (!fixture) {
+	fprintf(stderr, "%s: Error: %s: %s\n", argv[0], argv[optind], strerror(errno));
+	exit(1);
+    }
+
+    if (optind+1 == argc) {
+	test_errors();
+	test_small();
+	return test_done(argv[0]);
+    }
+
+    if (optind+3 != argc)
+	goto Usage;
+
+    drives = atoi(argv[optind+1]);
+    paths = atoi(argv[optind+2]);
+    if (drives < 1 || paths < 1)
+	goto Usage;
+
+    dv = calloc(drives, sizeof(DISK));
+    if (!dv) {
+	fprintf(stderr, "%s: Error: Memory allocation failure\n", argv[0]);
+	exit(1);
+    }
+    for (i = 0; i < drives; i++) {
+	snprintf(name1, sizeof(name1), "da%d", i);
+	snprintf(name2, sizeof(name2), "da%d", i + drives);
+	disk_init(&dv[i], name1, paths > 1 ? name2 : NULL);
+    }
+
+    test_large(dv, drives, paths);
+    if (rounds > 0)
+	bench_large(dv, drives, rounds);
+
+    for (i = 0; i < drives; i++)
+	disk_clear(&dv[i]);
+    free(dv);
+    free(fixture);
+    return test_done(argv[0]);
+
+ Usage:
+    fprintf(stderr, "Usage: %s [-b <rounds>] <confxml> [<drives> <paths>]\n", argv[0]);
+    exit(1);
+}
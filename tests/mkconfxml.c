@@ -0,0 +1,235 @@
+/*
+ * mkconfxml.c
+ *
+ * Write a kern.geom.confxml document for a large JBOD host, in the
+ * layout FreeBSD produces: DISK, DEV, PART, LABEL and MULTIPATH
+ * classes, dual-pathed SAS drives under gmultipath, GPT partitions
+ * with gpt/ and gptid/ labels and diskid/ labels on the raw disks.
+ *
+ * Usage: mkconfxml [<drives> [<paths>]]   (default 500 drives, 2 paths, at most 3)
+ *
+ * Drive i is reached through da(i + k*drives) for path k, its
+ * multipath geom is "disk<i>" with partitions multipath/disk<i>p1 and
+ * p2, labelled gpt/boot<i>, gpt/zfs<i> and gptid/<uuid>.
+ *
+ * Copyright (c) 2024 Peter Eriksson <pen@lysator.liu.se>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+
+#define MEDIASIZE  18000207937536ULL
+#define SECTORSIZE 4096
+
+/* Object ids: class in the top byte, then object number */
+#define ID(c, n)   (0xfffff80000000000ULL | ((unsigned long long) (c) << 32) | (unsigned) (n))
+
+enum { C_DISK = 1, C_DEV, C_PART, C_LABEL, C_MULTIPATH };
+
+enum { O_GEOM, O_PROV, O_CONS, O_PROV2, O_CONS2, O_PROV3, O_CONS3, O_NOBJ };
+
+static const int pcons[] = { O_CONS, O_CONS2, O_CONS3 };
+
+static int ndrives = 500;
+static int npaths = 2;
+
+
+static unsigned long long
+oid(int cls,
+    int n,
+    int obj) {
+    return ID(cls, n*O_NOBJ + obj);
+}
+
+static void
+provider(int cls,
+	 int n,
+	 int obj,
+	 const char *name,
+	 unsigned long long size,
+	 const char *config) {
+    printf("      <provider id=\"0x%llx\">\n", oid(cls, n, obj));
+    printf("        <geom ref=\"0x%llx\"/>\n", oid(cls, n, O_GEOM));
+    printf("        <mode>r1w1e2</mode>\n");
+    printf("        <name>%s</name>\n", name);
+    printf("        <mediasize>%llu</mediasize>\n", size);
+    printf("        <sectorsize>%d</sectorsize>\n", SECTORSIZE);
+    printf("        <stripesize>0</stripesize>\n");
+    printf("        <stripeoffset>0</stripeoffset>\n");
+    printf("        <config>\n%s        </config>\n", config);
+    printf("      </provider>\n");
+}
+
+static void
+consumer(int cls,
+	 int n,
+	 int obj,
+	 unsigned long long prov) {
+    printf("      <consumer id=\"0x%llx\">\n", oid(cls, n, obj));
+    printf("        <geom ref=\"0x%llx\"/>\n", oid(cls, n, O_GEOM));
+    printf("        <provider ref=\"0x%llx\"/>\n", prov);
+    printf("        <mode>r1w1e1</mode>\n");
+    printf("        <config>\n        </config>\n");
+    printf("      </consumer>\n");
+}
+
+static void
+geom_start(int cls,
+	   int n,
+	   const char *name) {
+    printf("    <geom id=\"0x%llx\">\n", oid(cls, n, O_GEOM));
+    printf("      <class ref=\"0x%llx\"/>\n", ID(cls, 0xffffffff));
+    printf("      <name>%s</name>\n", name);
+    printf("      <rank>%d</rank>\n", cls == C_DISK ? 1 : 2);
+    printf("      <config>\n      </config>\n");
+}
+
+static void
+class_start(int cls,
+	    const char *name) {
+    printf("  <class id=\"0x%llx\">\n", ID(cls, 0xffffffff));
+    printf("    <name>%s</name>\n", name);
+}
+
+
+int
+main(int argc,
+     char *argv[]) {
+    char name[64], cfg[1024];
+    int i, k, d;
+
+
+    if (argc > 1)
+	ndrives = atoi(argv[1]);
+    if (argc > 2)
+	npaths = atoi(argv[2]);
+    if (ndrives < 1 || npaths < 1 || npaths > 3) {
+	fprintf(stderr, "Usage: %s [<drives> [<paths>]]\n", argv[0]);
+	exit(1);
+    }
+
+    printf("<?xml version=\"1.0\" encoding=\"iso-8859-1\"?>\n<mesh>\n");
+
+    class_start(C_DISK, "DISK");
+    for (d = 0; d < ndrives*npaths; d++) {
+	i = d % ndrives;
+	snprintf(name, sizeof(name), "da%d", d);
+	snprintf(cfg, sizeof(cfg),
+		 "          <fwheads>255</fwheads>\n"
+		 "          <fwsectors>63</fwsectors>\n"
+		 "          <rotationrate>7200</rotationrate>\n"
+		 "          <ident>ZL2%05d</ident>\n"
+		 "          <lunid>5000c500%08x</lunid>\n"
+		 "          <descr>SEAGATE ST18000NM004J &amp; co</descr>\n",
+		 i, i);
+	geom_start(C_DISK, d, name);
+	provider(C_DISK, d, O_PROV, name, MEDIASIZE, cfg);
+	printf("    </geom>\n");
+    }
+    printf("  </class>\n");
+
+    /* devfs has a consumer on every provider */
+    class_start(C_DEV, "DEV");
+    for (d = 0; d < ndrives*npaths; d++) {
+	snprintf(name, sizeof(name), "da%d", d);
+	geom_start(C_DEV, d, name);
+	consumer(C_DEV, d, O_CONS, oid(C_DISK, d, O_PROV));
+	printf("    </geom>\n");
+    }
+    printf("  </class>\n");
+
+    /* diskid/ labels are only created on the first path */
+    class_start(C_LABEL, "LABEL");
+    for (i = 0; i < ndrives; i++) {
+	snprintf(name, sizeof(name), "da%d", i);
+	geom_start(C_LABEL, i, name);
+	consumer(C_LABEL, i, O_CONS, oid(C_DISK, i, O_PROV));
+	snprintf(name, sizeof(name), "diskid/DISK-ZL2%05d", i);
+	provider(C_LABEL, i, O_PROV, name, MEDIASIZE, "          <length>0</length>\n");
+	printf("    </geom>\n");
+
+	/* Partition labels */
+	snprintf(name, sizeof(name), "multipath/disk%dp1", i);
+	geom_start(C_LABEL, ndrives+i, name);
+	consumer(C_LABEL, ndrives+i, O_CONS, oid(C_PART, i, O_PROV));
+	snprintf(name, sizeof(name), "gpt/boot%d", i);
+	provider(C_LABEL, ndrives+i, O_PROV, name, 524288, "");
+	printf("    </geom>\n");
+
+	snprintf(name, sizeof(name), "multipath/disk%dp2", i);
+	geom_start(C_LABEL, 2*ndrives+i, name);
+	consumer(C_LABEL, 2*ndrives+i, O_CONS, oid(C_PART, i, O_PROV2));
+	snprintf(name, sizeof(name), "gpt/zfs%d", i);
+	provider(C_LABEL, 2*ndrives+i, O_PROV, name, MEDIASIZE - 1048576, "");
+	snprintf(name, sizeof(name), "gptid/6c1e%04x-8d2f-11ee-a0b5-0cc47a%06x", i & 0xffff, i);
+	provider(C_LABEL, 2*ndrives+i, O_PROV2, name, MEDIASIZE - 1048576, "");
+	printf("    </geom>\n");
+    }
+    printf("  </class>\n");
+
+    class_start(C_PART, "PART");
+    for (i = 0; i < ndrives; i++) {
+	snprintf(name, sizeof(name), "multipath/disk%d", i);
+	geom_start(C_PART, i, name);
+	consumer(C_PART, i, O_CONS, oid(C_MULTIPATH, i, O_PROV));
+	snprintf(name, sizeof(name), "multipath/disk%dp1", i);
+	provider(C_PART, i, O_PROV, name, 524288,
+		 "          <start>40</start>\n"
+		 "          <end>1063</end>\n"
+		 "          <index>1</index>\n"
+		 "          <type>freebsd-boot</type>\n");
+	snprintf(name, sizeof(name), "multipath/disk%dp2", i);
+	provider(C_PART, i, O_PROV2, name, MEDIASIZE - 1048576,
+		 "          <index>2</index>\n"
+		 "          <type>freebsd-zfs</type>\n");
+	printf("    </geom>\n");
+    }
+    printf("  </class>\n");
+
+    class_start(C_MULTIPATH, "MULTIPATH");
+    for (i = 0; i < ndrives; i++) {
+	snprintf(name, sizeof(name), "disk%d", i);
+	geom_start(C_MULTIPATH, i, name);
+	for (k = 0; k < npaths; k++)
+	    consumer(C_MULTIPATH, i, pcons[k], oid(C_DISK, i + k*ndrives, O_PROV));
+	snprintf(name, sizeof(name), "multipath/disk%d", i);
+	provider(C_MULTIPATH, i, O_PROV, name, MEDIASIZE - SECTORSIZE, "");
+	printf("    </geom>\n");
+    }
+    printf("  </class>\n");
+
+    /* A class without geoms, as in real meshes */
+    class_start(C_MULTIPATH+1, "VFS");
+    printf("  </class>\n");
+
+    printf("</mesh>\n");
+    return 0;
+}
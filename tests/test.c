@@ -0,0 +1,111 @@
+/*
+ * test.c
+ *
+ * Minimal helpers for the drvlist unit tests and benchmarks.
+ *
+ * Copyright (c) 2024 Peter Eriksson <pen@lysator.liu.se>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "test.h"
+
+
+int test_failed = 0;
+int test_count = 0;
+
+
+void
+test_check(int ok,
+	   const char *what,
+	   const char *file,
+	   int line) {
+    ++test_count;
+    if (!ok) {
+	fprintf(stderr, "%s:%d: FAILED: %s\n", file, line, what);
+	++test_failed;
+    }
+}
+
+
+int
+test_done(const char *prog) {
+    const char *bp = strrchr(prog, '/');
+
+    printf("%s: %d checks, %d failed\n", bp ? bp+1 : prog, test_count, test_failed);
+    return test_failed ? 1 : 0;
+}
+
+
+uint64_t
+test_now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+
+char *
+test_readfile(const char *path,
+	      size_t *lenp) {
+    FILE *fp;
+    struct stat sb;
+    char *buf;
+    size_t n;
+
+
+    fp = fopen(path, "r");
+    if (!fp)
+	return NULL;
+
+    if (fstat(fileno(fp), &sb) < 0 || (buf = malloc(sb.st_size+1)) == NULL) {
+	fclose(fp);
+	return NULL;
+    }
+
+    n = fread(buf, 1, sb.st_size, fp);
+    fclose(fp);
+    if (n != (size_t) sb.st_size) {
+	free(buf);
+	errno = EIO;
+	return NULL;
+    }
+
+    buf[n] = '\0';
+    *lenp = n;
+    return buf;
+}
@@ -0,0 +1,245 @@
+/*
+ * topo.c
+ *
+ * Multipath and controller topology report for drvlist.
+ *
+ * Copyright (c) 2024 Peter Eriksson <pen@lysator.liu.se>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "drvlist.h"
+
+
+typedef struct {
+    char *ctrl;
+    int drives;
+    int primary;
+    int secondary;
+    int single;
+} CTRL;
+
+
+static CTRL *
+ctrl_get(CTRL **cvp,
+	 int *ccp,
+	 const char *name) {
+    CTRL *cp;
+    int i;
+
+    for (i = 0; i < *ccp && strcmp((*cvp)[i].ctrl, name); i++)
+	;
+    if (i < *ccp)
+	return &(*cvp)[i];
+
+    cp = realloc(*cvp, (*ccp+1)*sizeof(CTRL));
+    if (!cp)
+	return NULL;
+    *cvp = cp;
+    cp = &cp[(*ccp)++];
+    memset(cp, 0, sizeof(*cp));
+    cp->ctrl = strdup(name);
+    return cp;
+}
+
+
+/*
+ * Number of distinct controllers the paths of a drive go through.
+ * Paths without a known controller are not counted.
+ */
+static int
+disk_nctrl(const DISK *dp) {
+    int i, j, n = 0;
+
+    for (i = 0; i < dp->pc; i++) {
+	if (!dp->pv[i].ctrl)
+	    continue;
+	for (j = 0; j < i && (!dp->pv[j].ctrl || strcmp(dp->pv[j].ctrl, dp->pv[i].ctrl)); j++)
+	    ;
+	if (j == i)
+	    ++n;
+    }
+
+    return n;
+}
+
+
+static void
+dot_quote(const char *s) {
+    putchar('"');
+    for (; s && *s; s++) {
+	if (*s == '"' || *s == '\\')
+	    putchar('\\');
+	putchar(*s);
+    }
+    putchar('"');
+}
+
+/*
+ * Graphviz (DOT) output: one node per controller and drive, one edge
+ * per path. Secondary paths are dashed, drives without controller
+ * redundancy are marked red.
+ */
+static void
+topology_dot(const DISK *dv,
+	     int dc,
+	     const CTRL *cv,
+	     int cc) {
+    int i, j;
+
+    puts("graph drvlist {");
+    puts("  rankdir=LR;");
+
+    for (i = 0; i < cc; i++) {
+	printf("  ");
+	dot_quote(cv[i].ctrl);
+	printf(" [shape=box, drives=%d, primary=%d, secondary=%d];\n",
+	       cv[i].drives, cv[i].primary, cv[i].secondary);
+    }
+
+    for (i = 0; i < dc; i++) {
+	const DISK *dp = &dv[i];
+
+	printf("  ");
+	dot_quote(dp->ident);
+	printf(" [shape=ellipse, label=");
+	dot_quote(dp->danames);
+	printf(", paths=%d, controllers=%d", dp->pc, disk_nctrl(dp));
+	if (dp->pc > 1 && disk_nctrl(dp) < 2)
+	    printf(", color=red");
+	puts("];");
+
+	for (j = 0; j < dp->pc; j++) {
+	    if (!dp->pv[j].ctrl)
+		continue;
+	    printf("  ");
+	    dot_quote(dp->pv[j].ctrl);
+	    printf(" -- ");
+	    dot_quote(dp->ident);
+	    printf(" [label=");
+	    dot_quote(dp->pv[j].name);
+	    printf(", role=%s%s];\n",
+		   j == 0 ? "primary" : "secondary",
+		   j == 0 ? "" : ", style=dashed");
+	}
+    }
+
+    puts("}");
+}
+
+
+/*
+ * Print how drive paths are spread over controllers. The first path
+ * found for a drive is counted as its primary path, any further paths
+ * as secondary.
+ */
+int
+topology(const DISK *dv,
+	 int dc,
+	 int f_dot) {
+    CTRL *cv = NULL, *cp;
+    int cc = 0;
+    int i, j, k, nc, nwarn = 0;
+    int hist[5];
+
+
+    memset(hist, 0, sizeof(hist));
+
+    for (i = 0; i < dc; i++) {
+	const DISK *dp = &dv[i];
+
+	nc = disk_nctrl(dp);
+	hist[dp->pc < 4 ? dp->pc : 4]++;
+
+	for (j = 0; j < dp->pc; j++) {
+	    if (!dp->pv[j].ctrl)
+		continue;
+
+	    cp = ctrl_get(&cv, &cc, dp->pv[j].ctrl);
+	    if (!cp)
+		return -1;
+
+	    if (j == 0)
+		cp->primary++;
+	    else
+		cp->secondary++;
+
+	    /* Count each drive once per controller */
+	    for (k = 0; k < j && (!dp->pv[k].ctrl || strcmp(dp->pv[k].ctrl, dp->pv[j].ctrl)); k++)
+		;
+	    if (k == j) {
+		cp->drives++;
+		if (dp->pc > 1 && nc == 1)
+		    cp->single++;
+	    }
+	}
+
+	if (dp->pc > 1 && nc < 2)
+	    ++nwarn;
+    }
+
+    if (f_dot) {
+	topology_dot(dv, dc, cv, cc);
+    } else {
+	if (isatty(1))
+	    printf("\033[1;4m%-10s : %6s : %7s : %9s : %s\033[0m\n",
+		   "CONTROLLER", "DRIVES", "PRIMARY", "SECONDARY", "NO-REDUNDANCY");
+
+	for (i = 0; i < cc; i++)
+	    printf("%-10s : %6d : %7d : %9d : %d\n",
+		   cv[i].ctrl, cv[i].drives,
+		   cv[i].primary, cv[i].secondary,
+		   cv[i].single);
+
+	printf("\nPaths per drive: 1: %d, 2: %d, 3: %d, 4+: %d\n",
+	       hist[1], hist[2], hist[3], hist[4]);
+
+	if (nwarn > 0) {
+	    printf("\nMultipath drives with all paths through one controller:\n");
+	    for (i = 0; i < dc; i++) {
+		const DISK *dp = &dv[i];
+
+		if (dp->pc > 1 && disk_nctrl(dp) < 2)
+		    printf("  %s : %s : %s\n",
+			   dp->ident,
+			   dp->danames,
+			   dp->pv[0].ctrl ? dp->pv[0].ctrl : "?");
+	    }
+	}
+    }
+
+    for (i = 0; i < cc; i++)
+	free(cv[i].ctrl);
+    free(cv);
+    return 0;
+}
@@ -0,0 +1,347 @@
+/*
+ * vendor.c
+ *
+ * Vendor name normalization for drvlist.
+ *
+ * Copyright (c) 2024 Peter Eriksson <pen@lysator.liu.se>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * ATA, USB and NVMe drives report a single model string ("WDC WD40EFRX",
+ * "SSDSC2KB480G8", "Micron_5300_MTFD...") instead of a separate vendor.
+ * The rules below map product prefixes to vendor names.
+ *
+ * A "word" rule only matches a whole leading word (followed by a space,
+ * '_' or '-') and strips it from the product. A plain prefix rule keeps
+ * the product as is. The longest matching rule wins.
+ *
+ * All rules are compiled into a trie (case insensitive) so a model
+ * string is normalized in a single pass no matter how many rules exist.
+ *
+ * User rules file format, one rule per line ('#' comments):
+ *
+ *   prefix : vendor [: word]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "libdrvlist.h"
+
+
+typedef struct {
+    const char *prefix;
+    const char *vendor;
+    int word;
+} VRULE;
+
+static const VRULE builtin_rules[] = {
+    { "WDC",      "WDC",      1 },
+    { "WD",       "WDC",      0 },
+    { "HGST",     "HGST",     1 },
+    { "HUH",      "HGST",     0 },
+    { "HUS",      "HGST",     0 },
+    { "HTS",      "HGST",     0 },
+    { "SEAGATE",  "SEAGATE",  1 },
+    { "ST",       "SEAGATE",  0 },
+    { "TOSHIBA",  "TOSHIBA",  1 },
+    { "MG0",      "TOSHIBA",  0 },
+    { "MQ0",      "TOSHIBA",  0 },
+    { "THNS",     "TOSHIBA",  0 },
+    { "INTEL",    "INTEL",    1 },
+    { "SSDSC",    "INTEL",    0 },
+    { "SAMSUNG",  "SAMSUNG",  1 },
+    { "MZ",       "SAMSUNG",  0 },
+    { "MICRON",   "MICRON",   1 },
+    { "MTFD",     "MICRON",   0 },
+    { "CRUCIAL",  "CRUCIAL",  1 },
+    { "CT",       "CRUCIAL",  0 },
+    { "KINGSTON", "KINGSTON", 1 },
+    { "SANDISK",  "SANDISK",  1 },
+    { "KIOXIA",   "KIOXIA",   1 },
+    { "HP",       "HP",       1 },
+    { NULL, NULL, 0 }
+};
+
+
+/* Number of distinct (case folded) characters usable in rule prefixes */
+#define VT_MAXCLASS 64
+
+typedef struct {
+    uint16_t next[VT_MAXCLASS];
+    const VRULE *rule;
+} VNODE;
+
+typedef struct {
+    VRULE *rv;			/* User rules */
+    int rc;
+    uint8_t cmap[256];		/* Character -> class, 0 = not in any rule */
+    int ncls;
+    VNODE *nv;
+    int nc;
+    int compiled;
+} VTRIE;
+
+
+/* Process wide: rules are loaded before use and only read afterwards */
+static VTRIE vtrie;
+static pthread_mutex_t vtrie_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+
+static int
+rule_add(const char *prefix,
+	 const char *vendor,
+	 int word) {
+    VRULE *rp;
+
+    rp = realloc(vtrie.rv, (vtrie.rc+1)*sizeof(VRULE));
+    if (!rp)
+	return -1;
+
+    vtrie.rv = rp;
+    rp = &rp[vtrie.rc++];
+    rp->prefix = prefix;
+    rp->vendor = vendor;
+    rp->word = word;
+    return 0;
+}
+
+
+/*
+ * Add rules from a file. User rules take precedence over the built-in
+ * ones for the same prefix.
+ */
+int
+drvlist_vendor_rules_load(const char *path) {
+    FILE *fp;
+    char buf[1024], *cp, *fv[3];
+    int n, line = 0;
+
+
+    fp = fopen(path, "r");
+    if (!fp)
+	return -1;
+
+    while (fgets(buf, sizeof(buf), fp)) {
+	++line;
+
+	cp = buf;
+	for (n = 0; n < 3 && (fv[n] = strsep(&cp, ":")) != NULL; n++)
+	    drvlist_strtrim(fv[n], NULL);
+
+	if (n == 0 || !fv[0][0] || fv[0][0] == '#')
+	    continue;
+
+	if (n < 2 || !fv[1][0]) {
+	    fprintf(stderr, "drvlist: Error: %s: line %d: Missing vendor\n", path, line);
+	    fclose(fp);
+	    errno = EINVAL;
+	    return -1;
+	}
+
+	if (rule_add(strdup(fv[0]), strdup(fv[1]),
+		     n > 2 && (strcmp(fv[2], "word") == 0 || strcmp(fv[2], "1") == 0)) < 0) {
+	    fclose(fp);
+	    return -1;
+	}
+    }
+
+    fclose(fp);
+    pthread_mutex_lock(&vtrie_mtx);
+    vtrie.compiled = 0;
+    pthread_mutex_unlock(&vtrie_mtx);
+    return 0;
+}
+
+
+static int
+vtrie_node(void) {
+    VNODE *np;
+
+    if (vtrie.nc >= UINT16_MAX) {
+	errno = E2BIG;
+	return -1;
+    }
+
+    np = realloc(vtrie.nv, (vtrie.nc+1)*sizeof(VNODE));
+    if (!np)
+	return -1;
+
+    vtrie.nv = np;
+    np = &np[vtrie.nc];
+    memset(np->next, 0, sizeof(np->next));
+    np->rule = NULL;
+    return vtrie.nc++;
+}
+
+static int
+vtrie_insert(const VRULE *rp) {
+    const char *cp;
+    int n = 0;
+
+    for (cp = rp->prefix; *cp; cp++) {
+	int c = tolower((unsigned char) *cp);
+	int cls = vtrie.cmap[c];
+
+	if (!cls) {
+	    if (vtrie.ncls >= VT_MAXCLASS) {
+		fprintf(stderr, "drvlist: Error: %s: Too many distinct characters in vendor rules\n",
+			rp->prefix);
+		errno = EINVAL;
+		return -1;
+	    }
+	    cls = vtrie.cmap[c] = vtrie.cmap[toupper(c)] = vtrie.ncls++;
+	}
+
+	if (!vtrie.nv[n].next[cls]) {
+	    int nn = vtrie_node();
+
+	    if (nn < 0)
+		return -1;
+	    vtrie.nv[n].next[cls] = nn;
+	}
+	n = vtrie.nv[n].next[cls];
+    }
+
+    vtrie.nv[n].rule = rp;
+    return 0;
+}
+
+static int
+vtrie_compile(void) {
+    int i;
+
+
+    free(vtrie.nv);
+    vtrie.nv = NULL;
+    vtrie.nc = 0;
+    memset(vtrie.cmap, 0, sizeof(vtrie.cmap));
+    vtrie.ncls = 1;
+
+    if (vtrie_node() < 0)
+	return -1;
+
+    /* User rules are inserted last so they override built-in ones */
+    for (i = 0; builtin_rules[i].prefix; i++)
+	if (vtrie_insert(&builtin_rules[i]) < 0)
+	    return -1;
+    for (i = 0; i < vtrie.rc; i++)
+	if (vtrie_insert(&vtrie.rv[i]) < 0)
+	    return -1;
+
+    vtrie.compiled = 1;
+    return 0;
+}
+
+
+static int
+is_wordsep(int c) {
+    return c == ' ' || c == '_' || c == '-';
+}
+
+
+/*
+ * Split a model string into vendor and product names (truncated to
+ * the buffer sizes), using the longest matching rule or else the first
+ * word. Returns 1 if a vendor was found, 0 if not and -1 on error.
+ */
+int
+drvlist_vendor_normalize(const char *model,
+			 char *vendor,
+			 size_t vsize,
+			 char *product,
+			 size_t psize) {
+    const char *cp;
+    const VRULE *best = NULL;
+    int n = 0, bestlen = 0, len;
+
+
+    *vendor = *product = '\0';
+    if (!model)
+	return 0;
+
+    pthread_mutex_lock(&vtrie_mtx);
+    if (!vtrie.compiled && vtrie_compile() < 0) {
+	pthread_mutex_unlock(&vtrie_mtx);
+	return -1;
+    }
+    pthread_mutex_unlock(&vtrie_mtx);
+
+    while (isspace((unsigned char) *model))
+	++model;
+
+    for (cp = model; *cp; cp++) {
+	n = vtrie.nv[n].next[vtrie.cmap[(unsigned char) *cp]];
+	if (!n)
+	    break;
+
+	if (vtrie.nv[n].rule) {
+	    const VRULE *rp = vtrie.nv[n].rule;
+
+	    if (!rp->word || cp[1] == '\0' || is_wordsep(cp[1])) {
+		best = rp;
+		bestlen = cp-model+1;
+	    }
+	}
+    }
+
+    if (best) {
+	const VRULE *rp = best;
+
+	cp = model;
+	if (rp->word) {
+	    cp += bestlen;
+	    while (is_wordsep(*cp))
+		++cp;
+	}
+
+	snprintf(vendor, vsize, "%s", rp->vendor);
+	snprintf(product, psize, "%s", *cp ? cp : model);
+	return 1;
+    }
+
+    /* No rule - use the first word as vendor, if followed by something */
+    cp = strchr(model, ' ');
+    if (cp && cp[1] != '\0' && !isspace((unsigned char) cp[1])) {
+	len = cp-model;
+	while (isspace((unsigned char) *cp))
+	    ++cp;
+	snprintf(vendor, vsize, "%.*s", len, model);
+	snprintf(product, psize, "%s", cp);
+	return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,377 @@
+/*
+ * zfs.c
+ *
+ * ZFS pool membership from on-disk vdev labels for drvlist.
+ *
+ * Copyright (c) 2024 Peter Eriksson <pen@lysator.liu.se>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Every ZFS vdev carries four 256 KiB labels, two at the start and two
+ * at the end of the device. Bytes 16K-128K of a label hold the vdev
+ * configuration as an XDR encoded nvlist, followed by an embedded
+ * checksum trailer with a magic number.
+ *
+ * Only the config nvlist of label 0 (or label 2, if label 0 is bad) is
+ * read, with O_DIRECT into an aligned buffer, and the top level pool
+ * name, vdev GUID and pool state are decoded directly from the XDR
+ * stream. This works for imported, exported and offline pools alike,
+ * and does not need libzfs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/ioctl.h>
+#include <sys/disk.h>
+#include <sys/param.h>
+
+#include "drvlist.h"
+
+
+#define VDEV_LABEL_SIZE   (256*1024)
+#define VDEV_PHYS_OFFSET  (16*1024)
+#define VDEV_PHYS_SIZE    (112*1024)
+#define ZEC_MAGIC         0x0210da7ab10c7a11ULL
+#define ZEC_SIZE          40
+
+#define NV_ENCODE_XDR     1
+
+#define DATA_TYPE_UINT64  8
+#define DATA_TYPE_STRING  9
+
+/* Pool states, from sys/fs/zfs.h */
+static const char *pool_states[] = {
+    "active",
+    "exported",
+    "destroyed",
+    "spare",
+    "l2cache",
+    "uninitialized",
+    "unavail",
+    "potentially-active",
+};
+
+/* Max partitions probed per drive when the whole disk has no label */
+#define ZFS_MAXPART 16
+
+
+typedef struct {
+    char name[256];
+    uint64_t guid;
+    uint64_t pool_guid;
+    uint64_t state;
+    int have_name;
+    int have_state;
+} ZLABEL;
+
+
+int f_zfs_jobs = 32;
+
+
+static uint32_t
+xdr_u32(const uint8_t *p) {
+    return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | p[3];
+}
+
+static uint64_t
+xdr_u64(const uint8_t *p) {
+    return ((uint64_t) xdr_u32(p) << 32) | xdr_u32(p+4);
+}
+
+
+/*
+ * Decode the top level pairs of an XDR encoded nvlist. Nested lists
+ * (vdev_tree etc) are skipped using the encoded pair size.
+ */
+static int
+nvlist_decode(const uint8_t *buf,
+	      size_t len,
+	      ZLABEL *lp) {
+    const uint8_t *p = buf, *end = buf+len;
+
+    /* nvs header: encoding, endian, 2 reserved */
+    if (len < 12 || p[0] != NV_ENCODE_XDR)
+	return -1;
+    p += 4;
+
+    /* nvl_version, nvl_nvflag */
+    p += 8;
+
+    while (p+8 <= end) {
+	const uint8_t *pair = p, *vp;
+	uint32_t esize, nlen, type;
+	const char *name;
+
+	esize = xdr_u32(p);
+	if (esize == 0)
+	    return 0;
+	if (esize < 20 || esize > (size_t) (end-pair))
+	    return -1;
+
+	nlen = xdr_u32(p+8);
+	if (12 + ((nlen+3) & ~3U) + 8 > esize)
+	    return -1;
+	name = (const char *) p+12;
+	vp = p+12 + ((nlen+3) & ~3U);
+	type = xdr_u32(vp);
+	vp += 8;		/* type, nelem */
+
+	if (type == DATA_TYPE_UINT64 && vp+8 <= pair+esize) {
+	    uint64_t v = xdr_u64(vp);
+
+	    if (nlen == 5 && memcmp(name, "state", 5) == 0) {
+		lp->state = v;
+		lp->have_state = 1;
+	    } else if (nlen == 4 && memcmp(name, "guid", 4) == 0)
+		lp->guid = v;
+	    else if (nlen == 9 && memcmp(name, "pool_guid", 9) == 0)
+		lp->pool_guid = v;
+	} else if (type == DATA_TYPE_STRING && vp+4 <= pair+esize &&
+		   nlen == 4 && memcmp(name, "name", 4) == 0) {
+	    uint32_t slen = xdr_u32(vp);
+
+	    if (vp+4+slen <= pair+esize && slen < sizeof(lp->name)) {
+		memcpy(lp->name, vp+4, slen);
+		lp->name[slen] = '\0';
+		lp->have_name = 1;
+	    }
+	}
+
+	p = pair+esize;
+    }
+
+    return -1;
+}
+
+
+static int
+label_read(int fd,
+	   off_t off,
+	   uint8_t *buf,
+	   ZLABEL *lp) {
+    uint64_t magic;
+
+    if (pread(fd, buf, VDEV_PHYS_SIZE, off + VDEV_PHYS_OFFSET) != VDEV_PHYS_SIZE)
+	return -1;
+
+    /* The embedded checksum trailer is in the byte order of the writer */
+    memcpy(&magic, buf + VDEV_PHYS_SIZE - ZEC_SIZE, sizeof(magic));
+    if (magic != ZEC_MAGIC && __builtin_bswap64(magic) != ZEC_MAGIC)
+	return -1;
+
+    memset(lp, 0, sizeof(*lp));
+    if (nvlist_decode(buf, VDEV_PHYS_SIZE - ZEC_SIZE, lp) < 0 || !lp->have_state)
+	return -1;
+
+    return 0;
+}
+
+
+/* Read label 0, or label 2 if label 0 is damaged */
+static int
+zfs_probe(const char *name,
+	  uint8_t *buf,
+	  ZLABEL *lp) {
+    char path[MAXPATHLEN];
+    off_t msize = 0;
+    int fd, rc;
+
+
+    snprintf(path, sizeof(path), "/dev/%s", name);
+    fd = open(path, O_RDONLY|O_DIRECT);
+    if (fd < 0)
+	return -1;
+
+    if (ioctl(fd, DIOCGMEDIASIZE, &msize) < 0 || msize < 4*VDEV_LABEL_SIZE) {
+	close(fd);
+	return -1;
+    }
+    msize &= ~((off_t) VDEV_LABEL_SIZE-1);
+
+    rc = label_read(fd, 0, buf, lp);
+    if (rc < 0)
+	rc = label_read(fd, msize - 2*VDEV_LABEL_SIZE, buf, lp);
+
+    close(fd);
+    return rc;
+}
+
+
+static void
+zlabel_append(char **pool,
+	      char **guid,
+	      const char *part,
+	      const ZLABEL *lp) {
+    char buf[512];
+
+    if (lp->have_name)
+	snprintf(buf, sizeof(buf), "%s", lp->name);
+    else
+	buf[0] = '\0';
+
+    if (lp->state != 0 || !lp->have_name)
+	snprintf(buf+strlen(buf), sizeof(buf)-strlen(buf), "%s%s",
+		 lp->have_name ? "/" : "",
+		 lp->state < sizeof(pool_states)/sizeof(pool_states[0]) ?
+		 pool_states[lp->state] : "?");
+
+    if (part)
+	snprintf(buf+strlen(buf), sizeof(buf)-strlen(buf), "@%s", part);
+    drvlist_strdupcat(pool, buf);
+
+    snprintf(buf, sizeof(buf), "%016llx", (unsigned long long) lp->guid);
+    drvlist_strdupcat(guid, buf);
+}
+
+
+static void
+zfs_disk(DISK *dp,
+	 uint8_t *buf) {
+    char name[MAXPATHLEN];
+    ZLABEL label;
+    char *cp;
+    int i;
+
+
+    if (!dp->danames)
+	return;
+
+    snprintf(name, sizeof(name), "%s", dp->danames);
+    cp = strchr(name, ',');
+    if (cp)
+	*cp = '\0';
+
+    if (zfs_probe(name, buf, &label) == 0) {
+	zlabel_append(&dp->zpool, &dp->zguid, NULL, &label);
+	return;
+    }
+
+    /* No label on the whole disk, try its partitions */
+    if (dp->parts) {
+	char *parts = strdup(dp->parts), *pp, *pn;
+
+	for (pp = parts; pp && (pn = strsep(&pp, ",")) != NULL; ) {
+	    if (zfs_probe(pn, buf, &label) == 0)
+		zlabel_append(&dp->zpool, &dp->zguid, pn, &label);
+	}
+	free(parts);
+	return;
+    }
+
+    cp = name+strlen(name);
+    for (i = 1; i <= ZFS_MAXPART; i++) {
+	snprintf(cp, sizeof(name)-(cp-name), "p%d", i);
+	if (zfs_probe(name, buf, &label) == 0)
+	    zlabel_append(&dp->zpool, &dp->zguid, cp, &label);
+    }
+}
+
+
+typedef struct {
+    DISK *dv;
+    int dc;
+    int next;
+    pthread_mutex_t mtx;
+} ZFSJOBS;
+
+static void *
+zfs_job_thread(void *vp) {
+    ZFSJOBS *jp = (ZFSJOBS *) vp;
+    void *buf = NULL;
+    int i;
+
+    if (posix_memalign(&buf, 4096, VDEV_PHYS_SIZE) != 0)
+	return NULL;
+
+    for (;;) {
+	pthread_mutex_lock(&jp->mtx);
+	i = jp->next++;
+	pthread_mutex_unlock(&jp->mtx);
+
+	if (i >= jp->dc)
+	    break;
+
+	zfs_disk(&jp->dv[i], buf);
+    }
+
+    free(buf);
+    return NULL;
+}
+
+
+/*
+ * Fill in ZFS pool membership for all drives, reading labels from up
+ * to f_zfs_jobs drives in parallel.
+ */
+int
+zfs_labels(DISK *dv,
+	   int dc) {
+    ZFSJOBS jobs;
+    pthread_t *tv;
+    int i, nj;
+
+
+    if (dc <= 0)
+	return 0;
+
+    nj = f_zfs_jobs > 0 ? f_zfs_jobs : 1;
+    if (nj > dc)
+	nj = dc;
+
+    tv = calloc(nj, sizeof(*tv));
+    if (!tv)
+	return -1;
+
+    jobs.dv = dv;
+    jobs.dc = dc;
+    jobs.next = 0;
+    pthread_mutex_init(&jobs.mtx, NULL);
+
+    for (i = 0; i < nj; i++)
+	if (pthread_create(&tv[i], NULL, zfs_job_thread, &jobs) != 0)
+	    break;
+
+    if (i == 0)
+	zfs_job_thread(&jobs);
+
+    while (--i >= 0)
+	pthread_join(tv[i], NULL);
+
+    pthread_mutex_destroy(&jobs.mtx);
+    free(tv);
+    return 0;
+}